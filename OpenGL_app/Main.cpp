@@ -13,11 +13,22 @@
 // Project-specific headers
 #include "camera.h"
 #include "shader.h"
+#include "shader_variants.h"
 #include "model.h"
 #include "skybox.h"
 #include "lighting.h"
 #include "sphere.h"
 #include "cube.h"
+#include "gl_extensions.h"
+#include "cascaded_shadow_map.h"
+#include "shadow_atlas.h"
+#include "frustum.h"
+#include "gpu_timer.h"
+#include "occlusion_culler.h"
+#include "occlusion_rasterizer.h"
+#include "texture_cache.h"
+#include "texture_memory.h"
+#include "simulation.h"
 
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
@@ -44,10 +55,9 @@ float lastX = SCR_WIDTH / 2.0f;
 float lastY = SCR_HEIGHT / 2.0f;
 bool firstMouse = true;
 
-// timing
+// timing (frame time moves the camera only; the scene runs on the Simulation's fixed tick)
 float deltaTime = 0.0f;
-float lastFrame = 0.0f;
-int skyboxTime = 0;
+double lastFrame = 0.0;
 
 glm::vec3 manualOffset = glm::vec3(0.0f, 0.0f, 0.0f); // Default manual adjustment
 
@@ -61,6 +71,35 @@ float shininessValue = 60.0f;    // Shininess (default = 32)
 bool blinn = false;
 bool blinnKeyPressed = false;
 
+bool fog = true;
+bool fogKeyPressed = false;
+
+LightVolumeMode lightVolumeMode = LIGHT_VOLUMES_OFF;
+bool lightVolumeKeyPressed = false;
+
+bool shadows = true;
+bool shadowsKeyPressed = false;
+
+bool depthPrepass = false;
+bool depthPrepassKeyPressed = false;
+
+OcclusionCuller::Mode occlusionMode = OcclusionCuller::OCCLUSION_OFF;
+bool occlusionKeyPressed = false;
+
+bool cpuOcclusion = false;
+bool cpuOcclusionKeyPressed = false;
+
+bool meshletCulling = false;
+bool meshletCullingKeyPressed = false;
+
+// the full-screen lighting pass fills the background with the sky, instead of a skybox pass after it
+bool skyInLightingPass = true;
+bool skyInLightingPassKeyPressed = false;
+
+// shader permutation keys, one bit per #define feature (see ShaderVariants)
+enum GeometryPassFeature { GEOMETRY_TEXTURED = 1 << 0 };
+enum LightingPassFeature { LIGHTING_BLINN = 1 << 0, LIGHTING_FOG = 1 << 1, LIGHTING_SHADOWS = 1 << 2, LIGHTING_SKY = 1 << 3 };
+
 int main()
 {
 	// glfw: initialize and configure
@@ -69,6 +108,7 @@ int main()
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	glfwWindowHint(GLFW_STENCIL_BITS, 8); // light volumes are stencil-marked in the default framebuffer
 
 #ifdef __APPLE__
 	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
@@ -93,6 +133,8 @@ int main()
 		std::cout << "Failed to initialize GLAD" << std::endl;
 		return -1;
 	}
+	loadGLExtensions((GLADloadproc)glfwGetProcAddress);
+	TextureMemory::shared().setBudget(TextureMemory::defaultBudget());
 
 
 	stbi_set_flip_vertically_on_load(true);
@@ -103,15 +145,43 @@ int main()
 	// -----------------------------
 	glEnable(GL_DEPTH_TEST);
 
-	// build and compile shaders
+	// point lights are fixed for the whole run, so their count is baked into the lighting shader
+	std::vector<glm::vec3> pointLightPositions;
+//	pointLightPositions.push_back(glm::vec3(2.0f, 1.0f, -2.0f)); // Point Light 1
+	pointLightPositions.push_back(glm::vec3(0.0f,0.0f, 0.0f)); // Point Light 2
+	pointLightPositions.push_back(glm::vec3(0.0f, 1.0f, 3.0f)); // Point Light 2
+
+	pointLightPositions.push_back(glm::vec3(2.0f, 4.0f, 0.0f)); // Point Light 2
+	pointLightPositions.push_back(glm::vec3(3.0f, 0.0f, 1.0f)); // Point Light 2
+
+	// build and compile shaders (linked programs are cached in shader_cache/ after the first run)
 	// -------------------------
+	// shaders watch their sources and recompile in the background when they are saved
+	Shader::hotReloadEnabled() = true;
+	double shaderSetupStart = glfwGetTime();
 //	Shader lightingShader("shader.vs", "shader.fs");
 	Shader lightCubeShader("light_cube.vs", "light_cube.fs");
 	Shader skyboxShader("skybox_shader.vs", "skybox_shader.fs");
-
-
-	Shader shaderGeometryPass("g_buffer.vs", "g_buffer.fs");
-	Shader shaderLightingPass("deferred.vs", "deferred.fs");
+	Shader shadowDepthShader("shadow_depth.vs", "shadow_depth.fs");
+	Shader depthPrepassShader("depth_prepass.vs", "depth_prepass.fs");
+	Shader hiZDownsampleShader("hiz_downsample.vs", "hiz_downsample.fs");
+	Shader occlusionTestShader("occlusion_test.vs", "occlusion_test.fs", std::vector<std::string>(), OcclusionCuller::feedbackVaryings());
+
+
+	// the textured variant reads the model's textures through its MaterialTable
+	ShaderVariants geometryPassVariants("g_buffer.vs", "g_buffer.fs", { "TEXTURED" }, MaterialTable::shaderDefines());
+	ShaderVariants lightingPassVariants("deferred.vs", "deferred.fs", { "BLINN", "FOG", "SHADOWS", "SKY" },
+		{ "NR_POINT_LIGHTS " + std::to_string(pointLightPositions.size()), "NR_SPOT_LIGHTS 2" });
+	// ambient + directional part of the lighting pass when point/spot lights are drawn as volumes
+	ShaderVariants ambientPassVariants("deferred.vs", "deferred.fs", { "BLINN", "FOG", "SHADOWS" },
+		{ "NR_POINT_LIGHTS 0", "NR_SPOT_LIGHTS 0" });
+	ShaderVariants lightVolumeVariants("light_volume.vs", "light_volume.fs", { "BLINN", "FOG", "SPOT_LIGHT", "FULLSCREEN", "SHADOWS" });
+	// every combination is cheap to build (and cached), so toggling B/O/V/C never stalls a frame
+	geometryPassVariants.precompileAll();
+	lightingPassVariants.precompileAll();
+	ambientPassVariants.precompileAll();
+	lightVolumeVariants.precompileAll();
+	std::cout << "Shader setup: " << (glfwGetTime() - shaderSetupStart) * 1000.0 << " ms" << std::endl;
 
 
 	// load models
@@ -178,12 +248,17 @@ int main()
 	// tell OpenGL which color attachments we'll use (of this framebuffer) for rendering 
 	unsigned int attachments[3] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
 	glDrawBuffers(3, attachments);
-	// create and attach depth buffer (renderbuffer)
-	unsigned int rboDepth;
-	glGenRenderbuffers(1, &rboDepth);
-	glBindRenderbuffer(GL_RENDERBUFFER, rboDepth);
-	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, SCR_WIDTH, SCR_HEIGHT);
-	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, rboDepth);
+	// create and attach depth buffer (a texture, the occlusion culler builds its Hi-Z pyramid from it)
+	unsigned int gDepthStencil;
+	glGenTextures(1, &gDepthStencil);
+	glBindTexture(GL_TEXTURE_2D, gDepthStencil);
+	// depth24/stencil8 matches the default framebuffer, so the depth blit is always a plain copy
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH24_STENCIL8, SCR_WIDTH, SCR_HEIGHT, 0, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, gDepthStencil, 0);
+	for (unsigned int target : { gPosition, gNormal, gAlbedoSpec, gDepthStencil })
+		TextureMemory::shared().track(target, GL_TEXTURE_2D, TEXTURES_RENDER_TARGETS);
 	// finally check if framebuffer is complete
 	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
 		std::cout << "Framebuffer not complete!" << std::endl;
@@ -204,17 +279,15 @@ int main()
 	lightColors.push_back(glm::vec3(0.0f, 0.0f, 1.0f)); // Cool light
 
 
-	// shader configuration
-	// --------------------
-	shaderLightingPass.use();
-	shaderLightingPass.setInt("gPosition", 0);
-	shaderLightingPass.setInt("gNormal", 1);
-	shaderLightingPass.setInt("gAlbedoSpec", 2);
-
 	Cube lightcubespecial;
 
 
 	Lighting lighting;
+	CascadedShadowMap sunShadows;
+	ShadowAtlas lightShadows;
+	OcclusionCuller occlusionCuller(SCR_WIDTH, SCR_HEIGHT);
+	OcclusionCuller::Mode culledMode = occlusionMode;
+	OcclusionRasterizer occlusionRasterizer;
 
 
 	float planeVertices[] = {
@@ -241,6 +314,28 @@ int main()
 	glEnableVertexAttribArray(2);
 	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
 	glBindVertexArray(0);
+	// positions only, for the depth pre-pass and shadow maps
+	float planePositions[6 * 3];
+	for (int i = 0; i < 6; i++)
+		for (int j = 0; j < 3; j++)
+			planePositions[i * 3 + j] = planeVertices[i * 8 + j];
+	const unsigned int planeIndices[6] = { 0, 1, 2, 3, 4, 5 };
+	unsigned int planeDepthVAO, planeDepthVBO;
+	glGenVertexArrays(1, &planeDepthVAO);
+	glGenBuffers(1, &planeDepthVBO);
+	glBindVertexArray(planeDepthVAO);
+	glBindBuffer(GL_ARRAY_BUFFER, planeDepthVBO);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(planePositions), planePositions, GL_STATIC_DRAW);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+	glBindVertexArray(0);
+
+	// GPU time of the passes the depth pre-pass trades between, printed once a second
+	GpuTimer depthPrepassTimer, geometryPassTimer, lightingPassTimer;
+	double lastTimingReport = glfwGetTime();
+
+	// started last, so loading time does not count as simulated time
+	Simulation simulation;
 
 
 	while (!glfwWindowShouldClose(window))
@@ -251,76 +346,50 @@ int main()
 		updateDeltaTime();
 		processInput(window);
 
-		prepareFrame();
+		lightCubeShader.reloadIfChanged();
+		skyboxShader.reloadIfChanged();
+		shadowDepthShader.reloadIfChanged();
+		depthPrepassShader.reloadIfChanged();
+		hiZDownsampleShader.reloadIfChanged();
+		occlusionTestShader.reloadIfChanged();
+		geometryPassVariants.reloadIfChanged();
+		lightingPassVariants.reloadIfChanged();
+		ambientPassVariants.reloadIfChanged();
+		lightVolumeVariants.reloadIfChanged();
 
-		// ----------- GEOMETRY PASS ----------------
-		glBindFramebuffer(GL_FRAMEBUFFER, gBuffer);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		prepareFrame();
 
+		// ----------- SCENE UPDATE -----------------
 		glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
 		glm::mat4 view = camera.GetViewMatrix();
 
-		shaderGeometryPass.use();
-		shaderGeometryPass.setMat4("projection", projection);
-		shaderGeometryPass.setMat4("view", view);
-
-		shaderGeometryPass.setBool("useTexture", true);
-		float time = static_cast<float>(glfwGetTime()); 
+		// the scene between the simulation's last two ticks
+		SimulationState state = simulation.sample();
 		glm::mat4 model = glm::mat4(1.0f);
 
-		
-		float xPos = 15.0f + abs(sin(time)) * 5.0f; 
-		float zPos = 15.0f + abs(cos(time)) * 5.0f; 
-		model = glm::translate(model, glm::vec3(xPos, 1.0f, zPos));
-		float angle = time; 
-		model = glm::rotate(model, angle, glm::vec3(0.0f, 0.0f, 1.0f)); 
+		model = glm::translate(model, state.backpackPosition);
+		model = glm::rotate(model, state.backpackAngle, glm::vec3(0.0f, 0.0f, 1.0f)); 
 
 		model = glm::scale(model, glm::vec3(1.0f, 1.0f, 1.0f));
 
-		shaderGeometryPass.setMat4("model", model);
-
-		ourModel.Draw(shaderGeometryPass);
-
-
-
-
-		shaderGeometryPass.setVec3("fixedColor", 1.0f, 0.7f, 0.1f);  
-
-		shaderGeometryPass.setBool("useTexture", false);
-
-		// Render the sphere model
 	// Static sphere (no movement)
 		glm::mat4 staticSphereModel = glm::mat4(1.0f);
 		staticSphereModel = glm::translate(staticSphereModel, glm::vec3(0.0f, 0.0f, 5.0f));
 		staticSphereModel = glm::scale(staticSphereModel, glm::vec3(0.5f));
 
 		staticSphere.updateModelMatrix(staticSphereModel);
-		staticSphere.setShaderAttributes(shaderGeometryPass);
-		staticSphere.render();
-
-
-		shaderGeometryPass.setVec3("fixedColor", 0.5f, 0.7f, 0.1f);  // Green ambient
 
 		// Sphere movement (oscillating along X-axis)
 		glm::mat4 movingSphereModel = glm::mat4(1.0f);
 		movingSphereModel = glm::translate(movingSphereModel, glm::vec3(5.0f, 0.0f, 0.0f));
 		movingSphereModel = glm::scale(movingSphereModel, glm::vec3(0.5f));
 
-		float sphereMovementRange = 2.0f;  // How far the sphere moves
-		float sphereSpeed = 1.0f;  // Speed of movement
-
 		glm::vec3 centerPosition = glm::vec3(5.0f, 0.0f, 0.0f);
-		glm::vec3 animatedOffset = glm::vec3(
-			sin(glfwGetTime() * sphereSpeed) * sphereMovementRange,  // Moves back & forth along X-axis
-			0.0f,
-			0.0f
-		);
+		glm::vec3 animatedOffset = state.sphereOffset; // Moves back & forth along X-axis
 
 		// Apply translation for animation
 		movingSphereModel = glm::translate(movingSphereModel, animatedOffset);
 		movingSphere.updateModelMatrix(movingSphereModel);
-		movingSphere.setShaderAttributes(shaderGeometryPass);
-		movingSphere.render();
 		glm::vec3 spherePosition = centerPosition + animatedOffset;
 		// THIRD-PERSON CAMERA (Following Behind the Sphere)
 		if(isFollowingSphere) {
@@ -350,10 +419,7 @@ int main()
 		cubeModel = glm::translate(cubeModel, glm::vec3(10.0f, 0.0f, 0.0f));
 		cubeModel = glm::scale(cubeModel, glm::vec3(3.0f));                  
 
-		// Update cube's model matrix and render it
 		cube.updateModelMatrix(cubeModel);
-		cube.setShaderAttributes(shaderGeometryPass);
-		cube.render();
 
 		spherePosition = centerPosition + animatedOffset;
 		glm::vec3 normalDirection = glm::normalize(animatedOffset); 
@@ -365,43 +431,293 @@ int main()
 
 		glm::vec3 spotlightDirection = glm::normalize((cubePosition - spotlightPosition) + manualOffset);
 
-		shaderGeometryPass.setVec3("fixedColor", 0.5f, 0.1f, 0.7f);  
-
-		glBindVertexArray(planeVAO);
-		glDrawArrays(GL_TRIANGLES, 0, 6);
+		// bounding sphere of an object drawn with modelMatrix from a mesh of the given radius
+		auto casterBounds = [](const glm::mat4& modelMatrix, float meshRadius) {
+			float scale = std::max(glm::length(glm::vec3(modelMatrix[0])),
+				std::max(glm::length(glm::vec3(modelMatrix[1])), glm::length(glm::vec3(modelMatrix[2]))));
+			ShadowCasterBounds bounds = { glm::vec3(modelMatrix[3]), meshRadius * scale };
+			return bounds;
+		};
 
+		// level of detail from the screen size of each object, used by every pass this frame
+		auto screenSize = [&](const ShadowCasterBounds& bounds) {
+			return LodSelector::screenSize(bounds.center, bounds.radius, camera.Position, glm::radians(camera.Zoom));
+		};
+		ourModel.selectLod(screenSize(casterBounds(model, ourModel.boundingRadius)));
+		staticSphere.selectLod(screenSize(casterBounds(staticSphereModel, 1.0f)));
+		movingSphere.selectLod(screenSize(casterBounds(movingSphereModel, 1.0f)));
+
+		// every object with its bounds and a position-only draw, shared by all depth-only
+		// passes: the depth pre-pass and the shadow maps
+		std::vector<ShadowCaster> shadowCasters;
+		ShadowCaster staticSphereCaster = { casterBounds(staticSphereModel, 1.0f), false,
+			[&](Shader& shader) { staticSphere.setShaderAttributes(shader); staticSphere.renderDepthOnly(); } };
+		ShadowCaster cubeCaster = { casterBounds(cubeModel, 0.8660254f), false,
+			[&](Shader& shader) { cube.setShaderAttributes(shader); cube.renderDepthOnly(); } };
+		// the plane is drawn with the cube's model matrix in the geometry pass as well
+		ShadowCaster planeCaster = { casterBounds(cubeModel, 14.142136f), false,
+			[&](Shader& shader) {
+				shader.setMat4("model", cubeModel);
+				glBindVertexArray(planeDepthVAO);
+				glDrawArrays(GL_TRIANGLES, 0, 6);
+			} };
+		ShadowCaster backpackCaster = { casterBounds(model, ourModel.boundingRadius), true,
+			[&](Shader& shader) { shader.setMat4("model", model); ourModel.DrawDepthOnly(); } };
+		ShadowCaster movingSphereCaster = { casterBounds(movingSphereModel, 1.0f), true,
+			[&](Shader& shader) { movingSphere.setShaderAttributes(shader); movingSphere.renderDepthOnly(); } };
+		shadowCasters.push_back(staticSphereCaster);
+		shadowCasters.push_back(cubeCaster);
+		shadowCasters.push_back(planeCaster);
+		shadowCasters.push_back(backpackCaster);
+		shadowCasters.push_back(movingSphereCaster);
+
+		// main-view culling; the depth pre-pass and shadow views inside the camera frustum reuse the result
+		glm::mat4 viewProjection = projection * view;
+		Frustum mainViewFrustum(viewProjection);
+		std::vector<size_t> visibleCasters;
+		for (size_t i = 0; i < shadowCasters.size(); i++) {
+			if (mainViewFrustum.intersectsSphere(shadowCasters[i].bounds.center, shadowCasters[i].bounds.radius))
+				visibleCasters.push_back(i);
+		}
 
+		// ----------- GEOMETRY PASS ----------------
+		glBindFramebuffer(GL_FRAMEBUFFER, gBuffer);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+		if (depthPrepass) {
+			// lay down the final depth with positions only, so the G-buffer pass below writes
+			// every pixel exactly once (GL_EQUAL) instead of once per overlapping surface
+			depthPrepassTimer.begin();
+			glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+			depthPrepassShader.use();
+			depthPrepassShader.setMat4("projection", projection);
+			depthPrepassShader.setMat4("view", view);
+			for (size_t i : visibleCasters)
+				shadowCasters[i].draw(depthPrepassShader);
+			glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+			glDepthFunc(GL_EQUAL);
+			glDepthMask(GL_FALSE);
+			depthPrepassTimer.end();
+		}
+		geometryPassTimer.begin();
 
-		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		Shader& texturedGeometryPass = geometryPassVariants.get(GEOMETRY_TEXTURED);
+		Shader& shaderGeometryPass = geometryPassVariants.get(0);
+		shaderGeometryPass.use();
+		shaderGeometryPass.setMat4("projection", projection);
+		shaderGeometryPass.setMat4("view", view);
+		texturedGeometryPass.use();
+		texturedGeometryPass.setMat4("projection", projection);
+		texturedGeometryPass.setMat4("view", view);
+
+		// world-space bounds of every draw that can be culled: the backpack meshes, the two
+		// spheres and the cube, in the order drawGeometry issues them
+		auto occlusionObject = [](const glm::mat4& modelMatrix, const glm::vec3& center, float radius, unsigned int indexCount, unsigned int firstIndex) {
+			float scale = std::max(glm::length(glm::vec3(modelMatrix[0])),
+				std::max(glm::length(glm::vec3(modelMatrix[1])), glm::length(glm::vec3(modelMatrix[2]))));
+			OcclusionObject object = { glm::vec3(modelMatrix * glm::vec4(center, 1.0f)), radius * scale, indexCount, firstIndex };
+			return object;
+		};
+		size_t meshCount = ourModel.meshes.size();
+		std::vector<OcclusionObject> occlusionObjects;
+		for (const Mesh& mesh : ourModel.meshes)
+			occlusionObjects.push_back(occlusionObject(model, mesh.boundsCenter, mesh.boundsRadius, mesh.currentLod().indexCount, mesh.currentLod().firstIndex));
+		occlusionObjects.push_back(occlusionObject(staticSphereModel, glm::vec3(0.0f), 1.0f, staticSphere.getIndexCount(), staticSphere.getFirstIndex()));
+		occlusionObjects.push_back(occlusionObject(movingSphereModel, glm::vec3(0.0f), 1.0f, movingSphere.getIndexCount(), movingSphere.getFirstIndex()));
+		occlusionObjects.push_back(occlusionObject(cubeModel, glm::vec3(0.0f), 0.8660254f, cube.getIndexCount(), 0));
+
+		// CPU occlusion: the cube and the plane hide whatever is behind them before any draw
+		std::vector<bool> cpuVisible(occlusionObjects.size(), true);
+		int cpuCulled = 0;
+		if (cpuOcclusion) {
+			occlusionRasterizer.beginFrame(viewProjection);
+			occlusionRasterizer.addOccluder(cube.getPositions().data(), cube.getIndices().data(), cube.getIndices().size(), cubeModel);
+			// the plane is drawn with the cube's model matrix in the geometry pass as well
+			occlusionRasterizer.addOccluder(planePositions, planeIndices, 6, cubeModel);
+			occlusionRasterizer.rasterize();
+			for (size_t i = 0; i < occlusionObjects.size(); i++) {
+				glm::vec3 extent(occlusionObjects[i].radius);
+				cpuVisible[i] = occlusionRasterizer.isVisible(occlusionObjects[i].center - extent, occlusionObjects[i].center + extent);
+				if (!cpuVisible[i])
+					cpuCulled++;
+			}
+		}
 
-		// --------------lIGHTING PASS -------------
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		// meshlet culling: clusters of the full-detail backpack meshes that are off screen or face
+		// away from the camera are left out of the G-buffer pass
+		unsigned int meshletTriangles = 0, meshletTrianglesTotal = 0;
+		if (meshletCulling) {
+			for (size_t i = 0; i < meshCount; i++) {
+				Mesh& mesh = ourModel.meshes[i];
+				if (mesh.getLod() != 0)
+					continue;
+				meshletTriangles += mesh.cullMeshlets(model, mainViewFrustum, camera.Position);
+				meshletTrianglesTotal += static_cast<unsigned int>(mesh.indices.size() / 3);
+			}
+		}
 
-		shaderLightingPass.use();
-		shaderLightingPass.setInt("gPosition", 0);
-		shaderLightingPass.setInt("gNormal", 1);
-		shaderLightingPass.setInt("gAlbedoSpec", 2);
+		// texture streaming: the backpack's textures ask for the mips its visible meshes need, then
+		// finished reads are uploaded and unneeded levels dropped within the budget
+		ourModel.requestTextureMips(model, mainViewFrustum, camera.Position, glm::radians(camera.Zoom), (float)SCR_HEIGHT, 0.1f);
+		TextureStreamer::shared().update();
+
+		// draws the scene into the G-buffer. With indirect set every object takes its draw from
+		// the occlusion culler's command for the pass, where a culled object has no instances;
+		// objects the CPU rasterizer found hidden are not drawn at all. The plane is the floor
+		// everything stands on and is never culled.
+		auto drawGeometry = [&](bool indirect, OcclusionCuller::Pass pass, bool drawPlane) {
+			if (indirect)
+				occlusionCuller.bindCommands(pass);
+
+			texturedGeometryPass.use();
+			texturedGeometryPass.setMat4("model", model);
+			ourModel.materials.bind(texturedGeometryPass);
+			for (size_t i = 0; i < meshCount; i++) {
+				if (!cpuVisible[i])
+					continue;
+				if (indirect)
+					ourModel.meshes[i].DrawIndirect(texturedGeometryPass, occlusionCuller.command(pass, i));
+				else if (meshletCulling && ourModel.meshes[i].getLod() == 0)
+					ourModel.meshes[i].DrawVisibleMeshlets(texturedGeometryPass);
+				else
+					ourModel.meshes[i].Draw(texturedGeometryPass);
+			}
+
+			shaderGeometryPass.use();
+			shaderGeometryPass.setVec3("fixedColor", 1.0f, 0.7f, 0.1f);  
+
+			// Render the sphere model
+			if (cpuVisible[meshCount]) {
+				staticSphere.setShaderAttributes(shaderGeometryPass);
+				if (indirect)
+					staticSphere.renderIndirect(occlusionCuller.command(pass, meshCount));
+				else
+					staticSphere.render();
+			}
+
+			shaderGeometryPass.setVec3("fixedColor", 0.5f, 0.7f, 0.1f);  // Green ambient
+
+			if (cpuVisible[meshCount + 1]) {
+				movingSphere.setShaderAttributes(shaderGeometryPass);
+				if (indirect)
+					movingSphere.renderIndirect(occlusionCuller.command(pass, meshCount + 1));
+				else
+					movingSphere.render();
+			}
+
+			// Update cube's model matrix and render it
+			if (cpuVisible[meshCount + 2]) {
+				cube.setShaderAttributes(shaderGeometryPass);
+				if (indirect)
+					cube.renderIndirect(occlusionCuller.command(pass, meshCount + 2));
+				else
+					cube.render();
+			}
+
+			if (drawPlane) {
+				// its own model matrix: the cube above may have been culled
+				shaderGeometryPass.setMat4("model", cubeModel);
+				shaderGeometryPass.setVec3("fixedColor", 0.5f, 0.1f, 0.7f);  
+
+				glBindVertexArray(planeVAO);
+				glDrawArrays(GL_TRIANGLES, 0, 6);
+			}
+			if (indirect)
+				glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+		};
 
-		shaderLightingPass.setInt("blinn", blinn);
+		bool occlusionCulling = occlusionMode != OcclusionCuller::OCCLUSION_OFF && OcclusionCuller::isSupported();
+		if (occlusionMode != culledMode) {
+			// the pyramid and history may be from long ago
+			occlusionCuller.invalidate();
+			culledMode = occlusionMode;
+		}
+		if (!occlusionCulling) {
+			drawGeometry(false, OcclusionCuller::SECOND_PASS, true);
+		}
+		else {
+			occlusionCuller.beginFrame(occlusionObjects);
+
+			if (occlusionMode == OcclusionCuller::OCCLUSION_TWO_PHASE) {
+				// what was visible last frame, then the pyramid of that, then whatever it uncovers
+				drawGeometry(true, OcclusionCuller::FIRST_PASS, true);
+				occlusionCuller.buildPyramid(gDepthStencil, viewProjection, hiZDownsampleShader);
+				occlusionCuller.cull(true, occlusionTestShader);
+				drawGeometry(true, OcclusionCuller::SECOND_PASS, false);
+			}
+			else {
+				// against last frame's depth, reprojected with last frame's matrices
+				occlusionCuller.cull(false, occlusionTestShader);
+				drawGeometry(true, OcclusionCuller::SECOND_PASS, true);
+			}
+		}
 
-		std::cout << (blinn ? "Blinn-Phong" : "Phong") << std::endl;
-		
-		shaderLightingPass.setFloat("Ks", specularIntensity);
-		shaderLightingPass.setFloat("shininess", shininessValue);
+		if (depthPrepass) {
+			glDepthFunc(GL_LESS);
+			glDepthMask(GL_TRUE);
+		}
+		geometryPassTimer.end();
+		if (occlusionCulling && occlusionMode == OcclusionCuller::OCCLUSION_REPROJECTED)
+			occlusionCuller.buildPyramid(gDepthStencil, viewProjection, hiZDownsampleShader);
 
 
-		std::vector<glm::vec3> pointLightPositions;
-	//	pointLightPositions.push_back(glm::vec3(2.0f, 1.0f, -2.0f)); // Point Light 1
-		pointLightPositions.push_back(glm::vec3(0.0f,0.0f, 0.0f)); // Point Light 2
-		pointLightPositions.push_back(glm::vec3(0.0f, 1.0f, 3.0f)); // Point Light 2
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
-		pointLightPositions.push_back(glm::vec3(2.0f, 4.0f, 0.0f)); // Point Light 2
-		pointLightPositions.push_back(glm::vec3(3.0f, 0.0f, 1.0f)); // Point Light 2
+		// ------------- SHADOW PASS ----------------
+		// static casters only land in the cascades' cached layers, see CascadedShadowMap
+		auto drawStaticCasters = [&](Shader& shader) {
+			for (const ShadowCaster& caster : shadowCasters)
+				if (!caster.dynamic)
+					caster.draw(shader);
+		};
+		auto drawDynamicCasters = [&](Shader& shader) {
+			for (const ShadowCaster& caster : shadowCasters)
+				if (caster.dynamic)
+					caster.draw(shader);
+		};
 
 		lighting.setPointLightPositions(pointLightPositions);
-		lighting.setLightingUniforms(shaderLightingPass, camera, skyboxTime, spotlightPosition, spotlightDirection);
+		lighting.updateLights(camera, state.timeOfDay, spotlightPosition, spotlightDirection);
+		if (shadows) {
+			sunShadows.update(view, glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f,
+				lighting.getDirectionalLightDirection(), shadowDepthShader, drawStaticCasters, drawDynamicCasters);
+
+			// point light cube faces (only out-of-date ones, within the atlas budget) and spot views
+			std::vector<ShadowLightRequest> shadowedPointLights;
+			for (const PointLight& light : lighting.getPointLights()) {
+				ShadowLightRequest request = { light.position, Lighting::pointLightRadius(light) };
+				shadowedPointLights.push_back(request);
+			}
+			std::vector<SpotShadowRequest> shadowedSpotLights;
+			for (const SpotLight& light : lighting.getSpotLights()) {
+				SpotShadowRequest request = { light.position, light.direction, light.outerCutOff, Lighting::spotLightRange(light) };
+				shadowedSpotLights.push_back(request);
+			}
+			lightShadows.update(shadowedPointLights, shadowedSpotLights, camera.Position, glm::radians(camera.Zoom),
+				shadowCasters, viewProjection, visibleCasters, shadowDepthShader);
+			lighting.setPointShadowViews(lightShadows.getPointLightViews());
+			lighting.setSpotShadowViews(lightShadows.getSpotLightViews());
+		}
 
+		// --------------lIGHTING PASS -------------
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+
+		lightingPassTimer.begin();
+		unsigned int lightingKey = (blinn ? LIGHTING_BLINN : 0) | (fog ? LIGHTING_FOG : 0) | (shadows ? LIGHTING_SHADOWS : 0);
+
+		std::cout << (blinn ? "Blinn-Phong" : "Phong") << std::endl;
+
+		// G-buffer samplers and material parameters shared by every lighting shader
+		auto setSurfaceUniforms = [&](Shader& shader) {
+			shader.setInt("gPosition", 0);
+			shader.setInt("gNormal", 1);
+			shader.setInt("gAlbedoSpec", 2);
+			shader.setFloat("Ks", specularIntensity);
+			shader.setFloat("shininess", shininessValue);
+			shader.setVec3("viewPos", camera.Position);
+			if (shadows)
+				lightShadows.setAtlasUniforms(shader, 4);
+		};
 
 		glActiveTexture(GL_TEXTURE0);
 		glBindTexture(GL_TEXTURE_2D, gPosition);
@@ -410,16 +726,91 @@ int main()
 		glActiveTexture(GL_TEXTURE2);
 		glBindTexture(GL_TEXTURE_2D, gAlbedoSpec);
 
-		for (unsigned int i = 0; i < lightPositions.size(); i++) {
-			shaderLightingPass.setVec3("lights[" + std::to_string(i) + "].Position", lightPositions[i]);
-			shaderLightingPass.setVec3("lights[" + std::to_string(i) + "].Color", lightColors[i]);
-			shaderLightingPass.setFloat("lights[" + std::to_string(i) + "].Linear", 0.7f);
-			shaderLightingPass.setFloat("lights[" + std::to_string(i) + "].Quadratic", 1.8f);
+		// light volumes would add onto the sky, so with them it is still drawn after the lights
+		const bool skyFill = skyInLightingPass && lightVolumeMode == LIGHT_VOLUMES_OFF;
+		if (lightVolumeMode == LIGHT_VOLUMES_OFF) {
+			Shader& shaderLightingPass = lightingPassVariants.get(lightingKey | (skyFill ? LIGHTING_SKY : 0));
+			shaderLightingPass.use();
+			setSurfaceUniforms(shaderLightingPass);
+			if (skyFill) {
+				glActiveTexture(GL_TEXTURE7);
+				glBindTexture(GL_TEXTURE_2D, gDepthStencil);
+				shaderLightingPass.setInt("gDepth", 7);
+				skybox.setLightingPassUniforms(shaderLightingPass, view, projection, state.timeOfDay, state.skyRotation, 5);
+			}
+			lighting.setLightingUniforms(shaderLightingPass, camera, state.timeOfDay, spotlightPosition, spotlightDirection);
+			if (shadows)
+				sunShadows.setShadowUniforms(shaderLightingPass, view, 3);
+
+			for (unsigned int i = 0; i < lightPositions.size(); i++) {
+				shaderLightingPass.setVec3("lights[" + std::to_string(i) + "].Position", lightPositions[i]);
+				shaderLightingPass.setVec3("lights[" + std::to_string(i) + "].Color", lightColors[i]);
+				shaderLightingPass.setFloat("lights[" + std::to_string(i) + "].Linear", 0.7f);
+				shaderLightingPass.setFloat("lights[" + std::to_string(i) + "].Quadratic", 1.8f);
+			}
+
+			renderQuad();
+		}
+		else {
+			// the light volumes are depth-tested against the scene, so bring its depth over first
+			glBindFramebuffer(GL_READ_FRAMEBUFFER, gBuffer);
+			glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+			glBlitFramebuffer(0, 0, SCR_WIDTH, SCR_HEIGHT, 0, 0, SCR_WIDTH, SCR_HEIGHT, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+			// ambient + directional light over the whole screen, without touching the depth buffer
+			Shader& ambientPass = ambientPassVariants.get(lightingKey);
+			ambientPass.use();
+			setSurfaceUniforms(ambientPass);
+			lighting.updateDirectionalLight(ambientPass);
+			if (shadows)
+				sunShadows.setShadowUniforms(ambientPass, view, 3);
+			glDisable(GL_DEPTH_TEST);
+			renderQuad();
+			glEnable(GL_DEPTH_TEST);
+
+			// every point/spot light only over the pixels it can reach
+			unsigned int volumeKey = (lightingKey & (LIGHTING_BLINN | LIGHTING_FOG)) | (shadows ? LIGHT_VOLUME_SHADOWS : 0);
+			lighting.renderLightVolumes(lightVolumeVariants, volumeKey, lightCubeShader, setSurfaceUniforms,
+				view, projection, glm::vec2(SCR_WIDTH, SCR_HEIGHT), lightVolumeMode);
+		}
+		lightingPassTimer.end();
+
+		if (glfwGetTime() - lastTimingReport >= 1.0) {
+			double prepassMs = depthPrepass ? depthPrepassTimer.milliseconds() : 0.0;
+			double geometryMs = geometryPassTimer.milliseconds();
+			std::cout << "GPU ms (depth pre-pass " << (depthPrepass ? "on" : "off") << "): pre-pass " << prepassMs
+				<< ", G-buffer " << geometryMs << ", pre-pass + G-buffer " << prepassMs + geometryMs
+				<< ", lighting " << lightingPassTimer.milliseconds() << std::endl;
+			std::cout << "LOD: backpack " << ourModel.lodSelector.getLod() << ", static sphere " << staticSphere.getLod()
+				<< ", moving sphere " << movingSphere.getLod() << std::endl;
+			if (cpuOcclusion) {
+				double rasterizeMs = occlusionRasterizer.getRasterizeMilliseconds();
+				std::cout << "CPU occlusion: " << occlusionRasterizer.getTrianglesRasterized() << " triangles in " << rasterizeMs << " ms ("
+					<< (rasterizeMs > 0.0 ? occlusionRasterizer.getTrianglesRasterized() / rasterizeMs : 0.0) << " triangles/ms), "
+					<< cpuCulled << " of " << occlusionObjects.size() << " objects culled" << std::endl;
+			}
+			if (meshletCulling && !occlusionCulling && meshletTrianglesTotal > 0) {
+				std::cout << "Meshlet culling: " << meshletTriangles << " of " << meshletTrianglesTotal << " full-detail triangles drawn" << std::endl;
+			}
+			TextureStreamer& streamer = TextureStreamer::shared();
+			std::cout << "Texture streaming: " << streamer.getResidentBytes() / (1024 * 1024) << " of " << streamer.getBudgetBytes() / (1024 * 1024)
+				<< " MB resident, " << streamer.getPendingLoads() << " levels loading, staging " << streamer.getStagingBytesInUse() / 1024
+				<< " of " << streamer.getStagingBytes() / 1024 << " KB" << std::endl;
+			const TextureMemory& textureMemory = TextureMemory::shared();
+			std::cout << "Texture memory:";
+			for (int category = 0; category < TEXTURE_CATEGORY_COUNT; category++)
+				std::cout << (category > 0 ? ", " : " ") << TextureMemory::categoryName((TextureCategory)category) << " "
+					<< textureMemory.getBytes((TextureCategory)category) / (1024 * 1024) << " MB";
+			std::cout << " of " << textureMemory.getBudget() / (1024 * 1024) << " MB (mip bias " << streamer.getQualityBias() << ")" << std::endl;
+			std::cout << "Simulation: " << simulation.getTickCount() << " ticks at " << simulation.getTickRate() << " Hz, time of day " << state.timeOfDay << " ms" << std::endl;
+			if (occlusionCulling) {
+				const OcclusionStats& stats = occlusionCuller.getStats();
+				std::cout << "Occlusion culling: " << stats.objects << " objects, " << stats.drawnFirstPass << " drawn in the first pass, "
+					<< stats.drawnSecondPass << " in the second, " << stats.culled << " culled" << std::endl;
+			}
+			lastTimingReport = glfwGetTime();
 		}
-
-		shaderLightingPass.setVec3("viewPos", camera.Position);
-
-		renderQuad();
 		// ------------- POST PROCESSING -----------
 
 		glBindFramebuffer(GL_READ_FRAMEBUFFER, gBuffer);
@@ -438,7 +829,8 @@ int main()
 
 		// ------------- SKYBOX -------------
 
-		skybox.render(camera.GetViewMatrix(), projection, skyboxTime, deltaTime);
+		if (!skyFill)
+			skybox.render(camera.GetViewMatrix(), projection, state.timeOfDay, state.skyRotation);
 
 		glfwSwapBuffers(window);
 		glfwPollEvents();
@@ -450,12 +842,9 @@ int main()
 }
 
 void updateDeltaTime() {
-	float currentFrame = static_cast<float>(glfwGetTime());
-	deltaTime = currentFrame - lastFrame;
+	double currentFrame = glfwGetTime();
+	deltaTime = static_cast<float>(currentFrame - lastFrame);
 	lastFrame = currentFrame;
-
-	skyboxTime += deltaTime * 1000;
-	skyboxTime = fmod(skyboxTime, 24000.0f); // Keep skybox time between 0 and 24000
 }
 
 void prepareFrame() {
@@ -586,6 +975,90 @@ void processInput(GLFWwindow* window)
 	{
 		blinnKeyPressed = false;
 	}
+	if (glfwGetKey(window, GLFW_KEY_O) == GLFW_PRESS && !fogKeyPressed)
+	{
+		fog = !fog;
+		fogKeyPressed = true;
+	}
+	if (glfwGetKey(window, GLFW_KEY_O) == GLFW_RELEASE)
+	{
+		fogKeyPressed = false;
+	}
+	if (glfwGetKey(window, GLFW_KEY_C) == GLFW_PRESS && !shadowsKeyPressed)
+	{
+		shadows = !shadows;
+		shadowsKeyPressed = true;
+	}
+	if (glfwGetKey(window, GLFW_KEY_C) == GLFW_RELEASE)
+	{
+		shadowsKeyPressed = false;
+	}
+	if (glfwGetKey(window, GLFW_KEY_Z) == GLFW_PRESS && !depthPrepassKeyPressed)
+	{
+		depthPrepass = !depthPrepass;
+		std::cout << "Depth pre-pass: " << (depthPrepass ? "on" : "off") << std::endl;
+		depthPrepassKeyPressed = true;
+	}
+	if (glfwGetKey(window, GLFW_KEY_Z) == GLFW_RELEASE)
+	{
+		depthPrepassKeyPressed = false;
+	}
+	if (glfwGetKey(window, GLFW_KEY_N) == GLFW_PRESS && !cpuOcclusionKeyPressed)
+	{
+		cpuOcclusion = !cpuOcclusion;
+		std::cout << "CPU occlusion culling: " << (cpuOcclusion ? "on" : "off") << std::endl;
+		cpuOcclusionKeyPressed = true;
+	}
+	if (glfwGetKey(window, GLFW_KEY_N) == GLFW_RELEASE)
+	{
+		cpuOcclusionKeyPressed = false;
+	}
+	if (glfwGetKey(window, GLFW_KEY_M) == GLFW_PRESS && !meshletCullingKeyPressed)
+	{
+		meshletCulling = !meshletCulling;
+		std::cout << "Meshlet culling: " << (meshletCulling ? "on" : "off") << std::endl;
+		meshletCullingKeyPressed = true;
+	}
+	if (glfwGetKey(window, GLFW_KEY_M) == GLFW_RELEASE)
+	{
+		meshletCullingKeyPressed = false;
+	}
+	if (glfwGetKey(window, GLFW_KEY_X) == GLFW_PRESS && !occlusionKeyPressed)
+	{
+		// off -> reprojected -> two-phase
+		occlusionMode = static_cast<OcclusionCuller::Mode>((occlusionMode + 1) % 3);
+		const char* names[] = { "off", "reprojected", "two-phase" };
+		std::cout << "Occlusion culling: " << names[occlusionMode] << std::endl;
+		if (occlusionMode != OcclusionCuller::OCCLUSION_OFF && !OcclusionCuller::isSupported())
+			std::cout << "Occlusion culling needs OpenGL 4.0 indirect draws, drawing everything" << std::endl;
+		occlusionKeyPressed = true;
+	}
+	if (glfwGetKey(window, GLFW_KEY_X) == GLFW_RELEASE)
+	{
+		occlusionKeyPressed = false;
+	}
+	if (glfwGetKey(window, GLFW_KEY_V) == GLFW_PRESS && !lightVolumeKeyPressed)
+	{
+		// cycle full-screen -> stencil volumes -> scissor rectangles
+		lightVolumeMode = static_cast<LightVolumeMode>((lightVolumeMode + 1) % LIGHT_VOLUME_MODE_COUNT);
+		const char* modeNames[] = { "full-screen", "stencil volumes", "scissor rectangles" };
+		std::cout << "Point/spot lights: " << modeNames[lightVolumeMode] << std::endl;
+		lightVolumeKeyPressed = true;
+	}
+	if (glfwGetKey(window, GLFW_KEY_V) == GLFW_RELEASE)
+	{
+		lightVolumeKeyPressed = false;
+	}
+	if (glfwGetKey(window, GLFW_KEY_Y) == GLFW_PRESS && !skyInLightingPassKeyPressed)
+	{
+		skyInLightingPass = !skyInLightingPass;
+		std::cout << "Sky: " << (skyInLightingPass ? "filled in by the lighting pass" : "separate skybox pass") << std::endl;
+		skyInLightingPassKeyPressed = true;
+	}
+	if (glfwGetKey(window, GLFW_KEY_Y) == GLFW_RELEASE)
+	{
+		skyInLightingPassKeyPressed = false;
+	}
 }
 
 
@@ -635,6 +1108,14 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 
 unsigned int loadTexture(char const* path)
 {
+	// block-compressed copy with its mip chain, when the GPU supports the format
+	unsigned int cookedID = loadCookedTexture(path, TEXTURE_COLOR);
+	if (cookedID != 0)
+	{
+		TextureMemory::shared().track(cookedID, GL_TEXTURE_2D, TEXTURES_MODELS);
+		return cookedID;
+	}
+
 	unsigned int textureID;
 	glGenTextures(1, &textureID);
 
@@ -658,6 +1139,7 @@ unsigned int loadTexture(char const* path)
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		TextureMemory::shared().track(textureID, GL_TEXTURE_2D, TEXTURES_MODELS);
 
 		stbi_image_free(data);
 	}
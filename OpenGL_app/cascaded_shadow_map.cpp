@@ -0,0 +1,180 @@
+#include "cascaded_shadow_map.h"
+#include "texture_memory.h"
+#include <glad/glad.h>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <glm/gtc/matrix_transform.hpp>
+
+CascadedShadowMap::CascadedShadowMap(int cascadeCount, int resolution, float shadowDistance)
+    : cascadeCount(std::max(1, std::min(cascadeCount, (int)MAX_CASCADES))), resolution(resolution), shadowDistance(shadowDistance) {
+    shadowArray = createDepthArray(resolution, this->cascadeCount, true);
+    staticArray = createDepthArray(resolution, this->cascadeCount, false);
+
+    // depth-only framebuffers, the layer is attached per cascade
+    glGenFramebuffers(1, &shadowFBO);
+    glGenFramebuffers(1, &staticFBO);
+    unsigned int fbos[2] = { shadowFBO, staticFBO };
+    unsigned int arrays[2] = { shadowArray, staticArray };
+    for (int i = 0; i < 2; i++) {
+        glBindFramebuffer(GL_FRAMEBUFFER, fbos[i]);
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, arrays[i], 0, 0);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "Shadow framebuffer not complete!" << std::endl;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    for (int i = 0; i < MAX_CASCADES; i++) {
+        splitFar[i] = shadowDistance;
+        texelWorldSize[i] = 0.0f;
+        lightSpace[i] = glm::mat4(1.0f);
+        cachedExtent[i] = 0.0f;
+    }
+    invalidateStaticCache();
+}
+
+CascadedShadowMap::~CascadedShadowMap() {
+    glDeleteFramebuffers(1, &shadowFBO);
+    glDeleteFramebuffers(1, &staticFBO);
+    TextureMemory::shared().untrack(shadowArray);
+    TextureMemory::shared().untrack(staticArray);
+    glDeleteTextures(1, &shadowArray);
+    glDeleteTextures(1, &staticArray);
+}
+
+unsigned int CascadedShadowMap::createDepthArray(int resolution, int layers, bool comparison) {
+    unsigned int texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT32F, resolution, resolution, layers, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+    // the sampled array filters with hardware depth comparison (2x2 PCF per tap)
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, comparison ? GL_LINEAR : GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, comparison ? GL_LINEAR : GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+    float borderColor[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+    glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, borderColor);
+    if (comparison) {
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    }
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    TextureMemory::shared().track(texture, GL_TEXTURE_2D_ARRAY, TEXTURES_RENDER_TARGETS);
+    return texture;
+}
+
+void CascadedShadowMap::computeSplits(float nearPlane) {
+    // "practical" split scheme: blend of logarithmic and uniform splits
+    const float lambda = 0.75f;
+    for (int i = 0; i < cascadeCount; i++) {
+        float p = (float)(i + 1) / (float)cascadeCount;
+        float logSplit = nearPlane * std::pow(shadowDistance / nearPlane, p);
+        float uniformSplit = nearPlane + (shadowDistance - nearPlane) * p;
+        splitFar[i] = lambda * logSplit + (1.0f - lambda) * uniformSplit;
+    }
+}
+
+void CascadedShadowMap::update(const glm::mat4& view, float fovy, float aspect, float nearPlane,
+    const glm::vec3& lightDirection, Shader& depthShader,
+    const std::function<void(Shader&)>& drawStaticCasters,
+    const std::function<void(Shader&)>& drawDynamicCasters) {
+    computeSplits(nearPlane);
+
+    // the light's rotation only depends on its direction, so light-space positions of
+    // static geometry stay the same from frame to frame and can be snapped to texels
+    glm::vec3 lightDir = glm::normalize(lightDirection);
+    glm::vec3 up = std::abs(lightDir.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+    glm::mat4 lightView = glm::lookAt(glm::vec3(0.0f), lightDir, up);
+    glm::mat4 inverseView = glm::inverse(view);
+
+    float tanHalfY = std::tan(fovy * 0.5f);
+    float tanHalfX = tanHalfY * aspect;
+    float k = tanHalfX * tanHalfX + tanHalfY * tanHalfY;
+    // how far behind a cascade (towards the sun) casters are still captured
+    const float casterReach = 50.0f;
+
+    GLint previousViewport[4];
+    glGetIntegerv(GL_VIEWPORT, previousViewport);
+    glViewport(0, 0, resolution, resolution);
+    glEnable(GL_DEPTH_TEST);
+    glDepthMask(GL_TRUE);
+    glEnable(GL_POLYGON_OFFSET_FILL);
+    glPolygonOffset(1.5f, 4.0f);
+
+    staticRedraws = 0;
+    float sliceNear = nearPlane;
+    for (int i = 0; i < cascadeCount; i++) {
+        float sliceFar = splitFar[i];
+
+        // smallest sphere around the slice with its centre on the view axis: its radius does
+        // not change when the camera turns, so neither does the size of the projection
+        float centerDepth = std::min(0.5f * (sliceNear + sliceFar) * (1.0f + k), sliceFar);
+        float radius = std::sqrt(sliceFar * sliceFar * k + (sliceFar - centerDepth) * (sliceFar - centerDepth));
+        radius = std::ceil(radius * 16.0f) / 16.0f;
+
+        // the projection is a quarter larger than the sphere and its origin snaps to a cell of
+        // whole texels, so the static layer stays valid until the camera leaves that cell
+        float extent = radius * 1.25f;
+        float texel = 2.0f * extent / (float)resolution;
+        float cell = std::max(1.0f, std::floor(0.25f * radius / texel)) * texel;
+        glm::vec3 centerWorld = glm::vec3(inverseView * glm::vec4(0.0f, 0.0f, -centerDepth, 1.0f));
+        glm::vec3 centerLight = glm::vec3(lightView * glm::vec4(centerWorld, 1.0f));
+        glm::vec3 origin = glm::floor(centerLight / cell + 0.5f) * cell;
+
+        glm::mat4 lightProjection = glm::ortho(origin.x - extent, origin.x + extent, origin.y - extent, origin.y + extent,
+            -origin.z - extent - casterReach, -origin.z + extent);
+        lightSpace[i] = lightProjection * lightView;
+        texelWorldSize[i] = texel;
+
+        glBindFramebuffer(GL_FRAMEBUFFER, staticFBO);
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, staticArray, 0, i);
+        bool staticDirty = !staticValid[i] || extent != cachedExtent[i] || origin != cachedOrigin[i]
+            || glm::dot(lightDir, cachedLightDirection[i]) < 0.99999f;
+        if (staticDirty) {
+            glClear(GL_DEPTH_BUFFER_BIT);
+            depthShader.use();
+            depthShader.setMat4("lightSpaceMatrix", lightSpace[i]);
+            drawStaticCasters(depthShader);
+
+            staticValid[i] = true;
+            cachedExtent[i] = extent;
+            cachedOrigin[i] = origin;
+            cachedLightDirection[i] = lightDir;
+            staticRedraws++;
+        }
+
+        // start the sampled layer from the cached static depth, then add the moving casters
+        glBindFramebuffer(GL_FRAMEBUFFER, shadowFBO);
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, shadowArray, 0, i);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, staticFBO);
+        glBlitFramebuffer(0, 0, resolution, resolution, 0, 0, resolution, resolution, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, shadowFBO);
+
+        depthShader.use();
+        depthShader.setMat4("lightSpaceMatrix", lightSpace[i]);
+        drawDynamicCasters(depthShader);
+
+        sliceNear = sliceFar;
+    }
+
+    glDisable(GL_POLYGON_OFFSET_FILL);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(previousViewport[0], previousViewport[1], previousViewport[2], previousViewport[3]);
+}
+
+void CascadedShadowMap::setShadowUniforms(Shader& shader, const glm::mat4& view, int textureUnit) const {
+    glActiveTexture(GL_TEXTURE0 + textureUnit);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, shadowArray);
+    shader.setInt("cascadeShadowMap", textureUnit);
+    shader.setInt("cascadeCount", cascadeCount);
+    shader.setMat4("cameraView", view);
+    for (int i = 0; i < cascadeCount; i++) {
+        std::string index = "[" + std::to_string(i) + "]";
+        shader.setMat4("cascadeLightSpace" + index, lightSpace[i]);
+        shader.setFloat("cascadeSplits" + index, splitFar[i]);
+        shader.setFloat("cascadeTexelSize" + index, texelWorldSize[i]);
+    }
+}
@@ -0,0 +1,67 @@
+#ifndef CASCADED_SHADOW_MAP_H
+#define CASCADED_SHADOW_MAP_H
+
+#include <glm/glm.hpp>
+#include <functional>
+#include "Shader.h"
+
+// Cascaded shadow maps for the directional (sun) light.
+//
+// The view frustum up to shadowDistance is split into cascades, each covered by an
+// orthographic light projection fitted to the bounding sphere of its slice. The sphere
+// keeps the projection size constant while the camera turns and the projection origin is
+// snapped to whole texels, so the shadow edges do not shimmer.
+//
+// Every cascade has two depth layers. The static layer holds the static casters and is
+// only redrawn when the sun direction changes or the camera leaves the area the layer was
+// rendered for (the origin snaps to a coarse cell, so this is rare). Each frame the static
+// layer is copied into the sampled layer and only the dynamic casters are drawn on top.
+class CascadedShadowMap {
+public:
+    static const int MAX_CASCADES = 4; // must match MAX_CASCADES in shadows.glsl
+
+    CascadedShadowMap(int cascadeCount = 3, int resolution = 1024, float shadowDistance = 30.0f);
+    ~CascadedShadowMap();
+
+    // Fits the cascades to the camera frustum described by view/fovy/aspect/nearPlane and
+    // renders them. depthShader is shadow_depth.vs/.fs; the casters set their own "model".
+    void update(const glm::mat4& view, float fovy, float aspect, float nearPlane,
+        const glm::vec3& lightDirection, Shader& depthShader,
+        const std::function<void(Shader&)>& drawStaticCasters,
+        const std::function<void(Shader&)>& drawDynamicCasters);
+
+    // binds the cascades to textureUnit and sets the shadows.glsl uniforms
+    void setShadowUniforms(Shader& shader, const glm::mat4& view, int textureUnit) const;
+
+    // forces the static layers to be redrawn, e.g. after a static object moved
+    void invalidateStaticCache() { for (int i = 0; i < MAX_CASCADES; i++) staticValid[i] = false; }
+
+    // number of cascades whose static layer was redrawn by the last update
+    int getStaticRedraws() const { return staticRedraws; }
+    int getCascadeCount() const { return cascadeCount; }
+
+private:
+    int cascadeCount;
+    int resolution;
+    float shadowDistance;
+
+    unsigned int shadowArray = 0;   // sampled layers (static copy + dynamic casters)
+    unsigned int staticArray = 0;   // cached static caster layers
+    unsigned int shadowFBO = 0, staticFBO = 0;
+
+    float splitFar[MAX_CASCADES];          // view depth at which each cascade ends
+    float texelWorldSize[MAX_CASCADES];    // world-space size of one shadow texel
+    glm::mat4 lightSpace[MAX_CASCADES];
+
+    // what each static layer was rendered for
+    bool staticValid[MAX_CASCADES];
+    glm::vec3 cachedLightDirection[MAX_CASCADES];
+    glm::vec3 cachedOrigin[MAX_CASCADES];
+    float cachedExtent[MAX_CASCADES];
+    int staticRedraws = 0;
+
+    void computeSplits(float nearPlane);
+    static unsigned int createDepthArray(int resolution, int layers, bool comparison);
+};
+
+#endif
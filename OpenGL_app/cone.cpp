@@ -0,0 +1,77 @@
+#include "cone.h"
+#include <cmath>
+#include <vector>
+
+// Constructor to initialize the cone
+Cone::Cone() : coneVAO(0), coneVBO(0), coneEBO(0), indexCount(0) {
+    setupCone();
+    modelMatrix = glm::mat4(1.0f);
+}
+
+Cone::~Cone() {
+    glDeleteVertexArrays(1, &coneVAO);
+    glDeleteBuffers(1, &coneVBO);
+    glDeleteBuffers(1, &coneEBO);
+}
+
+// Set up the cone's VAO, VBO, and EBO (positions only, it is only ever used as a volume)
+void Cone::setupCone() {
+    const unsigned int SEGMENTS = 32;
+    const float PI = 3.14159265359f;
+    // push the rim out so the polygon's edges (not only its corners) lie on the unit circle
+    const float rimRadius = 1.0f / std::cos(PI / SEGMENTS);
+
+    std::vector<float> positions;
+    std::vector<unsigned short> indices; // 34 vertices, so 16-bit indices are enough
+
+    // apex, base center, then the rim
+    positions.insert(positions.end(), { 0.0f, 0.0f, 0.0f });
+    positions.insert(positions.end(), { 0.0f, 0.0f, -1.0f });
+    for (unsigned int i = 0; i < SEGMENTS; ++i) {
+        float angle = (float)i / (float)SEGMENTS * 2.0f * PI;
+        positions.insert(positions.end(), { std::cos(angle) * rimRadius, std::sin(angle) * rimRadius, -1.0f });
+    }
+
+    for (unsigned int i = 0; i < SEGMENTS; ++i) {
+        unsigned short current = static_cast<unsigned short>(2 + i);
+        unsigned short next = static_cast<unsigned short>(2 + (i + 1) % SEGMENTS);
+        // side, counter-clockwise seen from outside
+        indices.insert(indices.end(), { 0, current, next });
+        // base cap, facing -Z
+        indices.insert(indices.end(), { 1, next, current });
+    }
+
+    indexCount = static_cast<unsigned int>(indices.size());
+
+    glGenVertexArrays(1, &coneVAO);
+    glGenBuffers(1, &coneVBO);
+    glGenBuffers(1, &coneEBO);
+
+    glBindVertexArray(coneVAO);
+
+    glBindBuffer(GL_ARRAY_BUFFER, coneVBO);
+    glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(float), positions.data(), GL_STATIC_DRAW);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, coneEBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned short), indices.data(), GL_STATIC_DRAW);
+
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(0);
+    glBindVertexArray(0);
+}
+
+// Update the model matrix for the cone (position, orientation, scaling)
+void Cone::updateModelMatrix(const glm::mat4& newModelMatrix) {
+    modelMatrix = newModelMatrix;
+}
+
+// Set shader attributes before rendering the cone
+void Cone::setShaderAttributes(Shader& shader) {
+    shader.setMat4("model", modelMatrix);
+}
+
+// Render the cone
+void Cone::render() {
+    glBindVertexArray(coneVAO);
+    glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_SHORT, 0);
+}
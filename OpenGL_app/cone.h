@@ -0,0 +1,27 @@
+#ifndef CONE_H
+#define CONE_H
+
+#include <glm/glm.hpp>
+#include <glad/glad.h>
+#include "Shader.h"
+
+// Closed cone with its apex at the origin, opening along -Z to a base of
+// radius 1 at z = -1. The side faces circumscribe the circle, so a scaled
+// cone always contains the exact circular cone (used as a spotlight volume).
+class Cone {
+public:
+    Cone();
+    ~Cone();
+    void render();
+    void updateModelMatrix(const glm::mat4& modelMatrix);
+    void setShaderAttributes(Shader& shader);
+
+private:
+    void setupCone();
+
+    unsigned int coneVAO, coneVBO, coneEBO;
+    unsigned int indexCount;
+    glm::mat4 modelMatrix;
+};
+
+#endif
@@ -4,7 +4,7 @@
 #include <iostream>
 
 // Constructor
-Cube::Cube() : cubeVAO(0), cubeVBO(0), cubeEBO(0), indexCount(0) {
+Cube::Cube() : cubeVAO(0), cubeVBO(0), cubeEBO(0), depthVAO(0), depthVBO(0), indexCount(0) {
     setupCube();
     modelMatrix = glm::mat4(1.0f);
 }
@@ -14,6 +14,8 @@ Cube::~Cube() {
     glDeleteVertexArrays(1, &cubeVAO);
     glDeleteBuffers(1, &cubeVBO);
     glDeleteBuffers(1, &cubeEBO);
+    glDeleteVertexArrays(1, &depthVAO);
+    glDeleteBuffers(1, &depthVBO);
 }
 
 // Set up the cube's VAO, VBO, and EBO
@@ -58,7 +60,7 @@ void Cube::setupCube() {
          -0.5f, -0.5f,  0.5f,   0.0f, -1.0f,  0.0f,   0.0f, 1.0f, // Bottom-left
     };
 
-    std::vector<unsigned int> indices = {
+    indices = {
         // Back face
         0, 1, 2, 2, 3, 0,
         // Front face
@@ -87,7 +89,9 @@ void Cube::setupCube() {
     glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
 
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, cubeEBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+    // 24 vertices: 16-bit indices on the GPU
+    std::vector<unsigned short> shortIndices(indices.begin(), indices.end());
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, shortIndices.size() * sizeof(unsigned short), shortIndices.data(), GL_STATIC_DRAW);
 
     // Set vertex attributes
     unsigned int stride = (3 + 3 + 2) * sizeof(float);
@@ -97,6 +101,20 @@ void Cube::setupCube() {
     glEnableVertexAttribArray(1);
     glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void*)(6 * sizeof(float)));
     glEnableVertexAttribArray(2);
+
+    // Tightly packed positions for depth-only passes, sharing the index buffer
+    for (size_t i = 0; i < vertices.size(); i += 8)
+        positions.insert(positions.end(), vertices.begin() + i, vertices.begin() + i + 3);
+
+    glGenVertexArrays(1, &depthVAO);
+    glGenBuffers(1, &depthVBO);
+    glBindVertexArray(depthVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, depthVBO);
+    glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(float), positions.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, cubeEBO);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(0);
+    glBindVertexArray(0);
 }
 
 // Update the model matrix
@@ -112,5 +130,17 @@ void Cube::setShaderAttributes(Shader& shader) {
 // Render the cube
 void Cube::render() {
     glBindVertexArray(cubeVAO);
-    glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, 0);
+    glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_SHORT, 0);
+}
+
+// Render positions only
+void Cube::renderDepthOnly() {
+    glBindVertexArray(depthVAO);
+    glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_SHORT, 0);
+}
+
+// Render with a GPU-written draw command
+void Cube::renderIndirect(const void* command) {
+    glBindVertexArray(cubeVAO);
+    glDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_SHORT, command);
 }
@@ -1,5 +1,6 @@
 #pragma once
 #include <glm/glm.hpp>
+#include <vector>
 #include "shader.h"
 
 class Cube {
@@ -10,11 +11,23 @@ public:
     void updateModelMatrix(const glm::mat4& newModelMatrix);
     void setShaderAttributes(Shader& shader);
     void render();
+    // positions only, for depth-only passes (depth pre-pass, shadow maps)
+    void renderDepthOnly();
+    // draws with the DrawElementsIndirectCommand at offset command of the bound
+    // GL_DRAW_INDIRECT_BUFFER (GL 4.0); an instance count of 0 skips the draw on the GPU
+    void renderIndirect(const void* command);
+    unsigned int getIndexCount() const { return indexCount; }
+    // model-space xyz positions and triangle indices, e.g. for the CPU occlusion rasterizer
+    const std::vector<float>& getPositions() const { return positions; }
+    const std::vector<unsigned int>& getIndices() const { return indices; }
 
 private:
     void setupCube();
 
     unsigned int cubeVAO, cubeVBO, cubeEBO;
+    unsigned int depthVAO, depthVBO;
     unsigned int indexCount;
+    std::vector<float> positions;
+    std::vector<unsigned int> indices;
     glm::mat4 modelMatrix;
 };
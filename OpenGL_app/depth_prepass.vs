@@ -0,0 +1,16 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+// The G-buffer pass tests against this depth with GL_EQUAL, so the position must be
+// computed exactly like g_buffer.vs does it and declared invariant in both.
+invariant gl_Position;
+
+void main()
+{
+    vec3 worldPos = vec3(model * vec4(aPos, 1.0));
+    gl_Position = projection * view * vec4(worldPos, 1.0);
+}
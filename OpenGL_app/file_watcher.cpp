@@ -0,0 +1,113 @@
+#include "file_watcher.h"
+#include <chrono>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    std::string directoryOf(const std::string& path) {
+        size_t slash = path.find_last_of("/\\");
+        return slash == std::string::npos ? std::string(".") : path.substr(0, slash);
+    }
+
+    std::string joinPath(const std::string& directory, const std::string& name) {
+        return directory == "." ? name : directory + "/" + name;
+    }
+
+    long long modifiedTime(const std::string& path) {
+        struct stat info;
+        if (stat(path.c_str(), &info) != 0)
+            return 0;
+        return static_cast<long long>(info.st_mtime);
+    }
+}
+
+FileWatcher::FileWatcher() : running(true) {
+#ifdef __linux__
+    inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+    worker = std::thread(&FileWatcher::run, this);
+}
+
+FileWatcher::~FileWatcher() {
+    running = false;
+    if (worker.joinable())
+        worker.join();
+#ifdef __linux__
+    if (inotifyFd >= 0)
+        close(inotifyFd);
+#endif
+}
+
+FileWatcher& FileWatcher::shared() {
+    static FileWatcher watcher;
+    return watcher;
+}
+
+void FileWatcher::watch(const std::string& path) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!watched.insert(path).second)
+        return;
+    modifiedTimes[path] = modifiedTime(path);
+
+#ifdef __linux__
+    // editors often save by renaming a temp file over the original, so watch the directory instead of the file
+    if (inotifyFd >= 0) {
+        std::string directory = directoryOf(path);
+        int wd = inotify_add_watch(inotifyFd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+        if (wd >= 0)
+            watchedDirectories[wd] = directory;
+    }
+#endif
+}
+
+unsigned long long FileWatcher::generation(const std::string& path) {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::map<std::string, unsigned long long>::const_iterator found = generations.find(path);
+    return found == generations.end() ? 0 : found->second;
+}
+
+void FileWatcher::markChanged(const std::string& path) {
+    // caller holds the mutex
+    if (watched.count(path))
+        generations[path]++;
+}
+
+void FileWatcher::run() {
+    while (running) {
+#ifdef __linux__
+        if (inotifyFd >= 0) {
+            pollfd descriptor = { inotifyFd, POLLIN, 0 };
+            if (poll(&descriptor, 1, 200) <= 0)
+                continue;
+
+            alignas(inotify_event) char buffer[4096];
+            ssize_t length = read(inotifyFd, buffer, sizeof(buffer));
+            std::lock_guard<std::mutex> lock(mutex);
+            for (char* ptr = buffer; length > 0 && ptr < buffer + length;) {
+                const inotify_event* event = reinterpret_cast<const inotify_event*>(ptr);
+                std::map<int, std::string>::const_iterator dir = watchedDirectories.find(event->wd);
+                if (dir != watchedDirectories.end() && event->len > 0)
+                    markChanged(joinPath(dir->second, event->name));
+                ptr += sizeof(inotify_event) + event->len;
+            }
+            continue;
+        }
+#endif
+        // portable fallback: compare modification times a few times per second
+        std::this_thread::sleep_for(std::chrono::milliseconds(250));
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const std::string& path : watched) {
+            long long time = modifiedTime(path);
+            if (time != 0 && time != modifiedTimes[path]) {
+                modifiedTimes[path] = time;
+                markChanged(path);
+            }
+        }
+    }
+}
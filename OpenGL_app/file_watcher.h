@@ -0,0 +1,44 @@
+#ifndef FILE_WATCHER_H
+#define FILE_WATCHER_H
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+
+// Watches a set of files on a background thread and counts how often each one was
+// modified, so the render loop can poll for changes without touching the disk. Any
+// number of readers can follow the same file by remembering the last count they saw.
+// Uses inotify on Linux and falls back to polling modification times elsewhere.
+class FileWatcher {
+public:
+    FileWatcher();
+    ~FileWatcher();
+
+    // process-wide watcher shared by everything that hot-reloads
+    static FileWatcher& shared();
+
+    void watch(const std::string& path);
+    // how many times the file changed since it was first watched, 0 if never
+    unsigned long long generation(const std::string& path);
+
+private:
+    void run();
+    void markChanged(const std::string& path);
+
+    std::thread worker;
+    std::atomic<bool> running;
+    std::mutex mutex;
+    std::set<std::string> watched;
+    std::map<std::string, unsigned long long> generations;
+    std::map<std::string, long long> modifiedTimes; // polling fallback only
+
+#ifdef __linux__
+    int inotifyFd = -1;
+    std::map<int, std::string> watchedDirectories; // inotify watch descriptor -> directory
+#endif
+};
+
+#endif
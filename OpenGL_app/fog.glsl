@@ -0,0 +1,19 @@
+#ifndef FOG_GLSL
+#define FOG_GLSL
+
+// Linear distance fog of the deferred lighting pass.
+// final = mix(fog_colour, lit, factor), which is linear in the lit colour, so
+// additive per-light passes scale their contribution by the factor and the
+// ambient pass adds fog_colour * (1 - factor) once.
+
+const float fog_maxdist = 25.0;
+const float fog_mindist = 15.0;
+const vec4  fog_colour = vec4(0.4, 0.4, 0.4, 1.0);
+
+float CalcFogFactor(vec3 fragPos, vec3 viewPos) {
+    float dist = length(fragPos - viewPos);
+    float fog_factor = (fog_maxdist - dist) / (fog_maxdist - fog_mindist);
+    return clamp(fog_factor, 0.0, 1.0);
+}
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <glm/glm.hpp>
+
+// The six clip planes of a view-projection matrix, for culling bounding spheres.
+// Plane normals point inwards; a point p is inside when dot(plane.xyz, p) + plane.w >= 0.
+class Frustum
+{
+public:
+    glm::vec4 planes[6]; // left, right, bottom, top, near, far
+
+    explicit Frustum(const glm::mat4& viewProjection)
+    {
+        // Gribb/Hartmann: rows of the matrix combined with the w row
+        glm::mat4 m = glm::transpose(viewProjection);
+        planes[0] = m[3] + m[0];
+        planes[1] = m[3] - m[0];
+        planes[2] = m[3] + m[1];
+        planes[3] = m[3] - m[1];
+        planes[4] = m[3] + m[2];
+        planes[5] = m[3] - m[2];
+        for (int i = 0; i < 6; i++)
+            planes[i] /= glm::length(glm::vec3(planes[i]));
+    }
+
+    bool intersectsSphere(const glm::vec3& center, float radius) const
+    {
+        for (int i = 0; i < 6; i++)
+        {
+            if (glm::dot(glm::vec3(planes[i]), center) + planes[i].w < -radius)
+                return false;
+        }
+        return true;
+    }
+
+    bool containsPoint(const glm::vec3& point, float tolerance = 0.0f) const
+    {
+        return intersectsSphere(point, tolerance);
+    }
+
+    // true if the whole frustum of viewProjection lies inside this one (checked on its corners)
+    bool containsFrustum(const glm::mat4& viewProjection, float tolerance = 0.0f) const
+    {
+        glm::mat4 inverse = glm::inverse(viewProjection);
+        for (int corner = 0; corner < 8; corner++)
+        {
+            glm::vec4 ndc((corner & 1) ? 1.0f : -1.0f, (corner & 2) ? 1.0f : -1.0f, (corner & 4) ? 1.0f : -1.0f, 1.0f);
+            glm::vec4 world = inverse * ndc;
+            if (!containsPoint(glm::vec3(world) / world.w, tolerance))
+                return false;
+        }
+        return true;
+    }
+};
+
+#endif
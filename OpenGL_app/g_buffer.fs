@@ -1,4 +1,8 @@
 #version 330 core
+#ifdef BINDLESS_MATERIALS
+#extension GL_ARB_bindless_texture : require
+#extension GL_ARB_shader_storage_buffer_object : require
+#endif
 layout (location = 0) out vec3 gPosition;
 layout (location = 1) out vec3 gNormal;
 layout (location = 2) out vec4 gAlbedoSpec;
@@ -6,24 +10,110 @@ layout (location = 2) out vec4 gAlbedoSpec;
 in vec3 FragPos;
 in vec3 Normal;
 in vec2 TexCoords;
+#ifdef TEXTURED
+in vec3 Tangent;
+in vec3 Bitangent;
+#endif
 
-uniform bool useTexture;            // Flag to toggle between texture and fixed color
+// TEXTURED (injected by ShaderVariants) selects textures over the fixed color. The maps come
+// from the material table (material_table.h): BINDLESS_MATERIALS or ARRAY_MATERIALS is set.
+#ifdef TEXTURED
+uniform int materialIndex;
+
+#ifdef BINDLESS_MATERIALS
+// diffuse, specular and normal map handle of every material, 0 for a missing map, and the
+// scale (xy) and offset (zw) of each map's UVs into its atlas
+struct Material
+{
+    uvec4 diffuseSpecular;
+    uvec4 normalFlags; // normal map handle, whether there is one
+    vec4 uvTransforms[3];
+};
+layout (std430) readonly buffer MaterialBuffer
+{
+    Material materials[];
+};
+
+vec4 sampleMap(uvec2 handle, vec2 uv)
+{
+    return handle != uvec2(0) ? texture(sampler2D(handle), uv) : vec4(1.0);
+}
+
+vec2 atlasUv(int map, vec2 uv)
+{
+    vec4 transform = materials[materialIndex].uvTransforms[map];
+    return uv * transform.xy + transform.zw;
+}
+
+vec4 diffuseMap(vec2 uv) { return sampleMap(materials[materialIndex].diffuseSpecular.xy, atlasUv(0, uv)); }
+vec4 specularMap(vec2 uv) { return sampleMap(materials[materialIndex].diffuseSpecular.zw, atlasUv(1, uv)); }
+vec4 normalMap(vec2 uv) { return sampleMap(materials[materialIndex].normalFlags.xy, atlasUv(2, uv)); }
+bool hasNormalMap() { return materials[materialIndex].normalFlags.z != 0u; }
+#else
+// textures of one format and size share an array; MaterialTable::MAX_ARRAYS of them
+uniform sampler2DArray materialArrays[8];
+// per material: the array of the diffuse, specular and normal map (-1 for none) and whether
+// there is a normal map; then the layers in those arrays
+uniform ivec4 materialArray[MAX_MATERIALS];
+uniform ivec4 materialLayer[MAX_MATERIALS];
+// scale (xy) and offset (zw) of the UVs of each of those maps into its atlas
+uniform vec4 materialUvTransform[MAX_MATERIALS * 3];
+
+vec4 sampleMap(int array, int layer, vec2 uv)
+{
+    // GLSL 3.30 indexes sampler arrays with constants only
+    vec3 coord = vec3(uv, layer);
+    switch (array)
+    {
+    case 0: return texture(materialArrays[0], coord);
+    case 1: return texture(materialArrays[1], coord);
+    case 2: return texture(materialArrays[2], coord);
+    case 3: return texture(materialArrays[3], coord);
+    case 4: return texture(materialArrays[4], coord);
+    case 5: return texture(materialArrays[5], coord);
+    case 6: return texture(materialArrays[6], coord);
+    case 7: return texture(materialArrays[7], coord);
+    }
+    return vec4(1.0);
+}
+
+vec2 atlasUv(int map, vec2 uv)
+{
+    vec4 transform = materialUvTransform[materialIndex * 3 + map];
+    return uv * transform.xy + transform.zw;
+}
+
+vec4 diffuseMap(vec2 uv) { return sampleMap(materialArray[materialIndex].x, materialLayer[materialIndex].x, atlasUv(0, uv)); }
+vec4 specularMap(vec2 uv) { return sampleMap(materialArray[materialIndex].y, materialLayer[materialIndex].y, atlasUv(1, uv)); }
+vec4 normalMap(vec2 uv) { return sampleMap(materialArray[materialIndex].z, materialLayer[materialIndex].z, atlasUv(2, uv)); }
+bool hasNormalMap() { return materialArray[materialIndex].w != 0; }
+#endif
+#else
 uniform vec3 fixedColor;            // Fixed color to use if not using texture
-uniform sampler2D texture_diffuse1; // Texture sampler for diffuse color
-uniform sampler2D texture_specular1;// Texture sampler for specular strength
+#endif
 
 void main()
 {
     gPosition = FragPos;
     gNormal = normalize(Normal);
 
-    if (useTexture) {
-        // Use textures for albedo and specular
-        gAlbedoSpec.rgb = texture(texture_diffuse1, TexCoords).rgb;
-        gAlbedoSpec.a = texture(texture_specular1, TexCoords).r;
-    } else {
-        // Use fixed color for albedo and a default specular strength
-        gAlbedoSpec.rgb = fixedColor;
-        gAlbedoSpec.a = 1.0; // Set default specular strength (adjust as needed)
+#ifdef TEXTURED
+    if (hasNormalMap())
+    {
+        // BC5 keeps two channels; the normal is unit length, so Z follows from X and Y
+        vec3 tangentNormal;
+        tangentNormal.xy = normalMap(TexCoords).rg * 2.0 - 1.0;
+        tangentNormal.z = sqrt(max(1.0 - dot(tangentNormal.xy, tangentNormal.xy), 0.0));
+        mat3 TBN = mat3(normalize(Tangent), normalize(Bitangent), gNormal);
+        gNormal = normalize(TBN * tangentNormal);
     }
+
+    // Use textures for albedo and specular
+    gAlbedoSpec.rgb = diffuseMap(TexCoords).rgb;
+    gAlbedoSpec.a = specularMap(TexCoords).r;
+#else
+    // Use fixed color for albedo and a default specular strength
+    gAlbedoSpec.rgb = fixedColor;
+    gAlbedoSpec.a = 1.0; // Set default specular strength (adjust as needed)
+#endif
 }
@@ -2,19 +2,33 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
+layout (location = 3) in vec3 aTangent;
+layout (location = 4) in vec3 aBitangent;
 
 out vec3 FragPos;
 out vec3 Normal;
 out vec2 TexCoords;
+#ifdef TEXTURED
+out vec3 Tangent;
+out vec3 Bitangent;
+#endif
 
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
 
+// must match depth_prepass.vs bit for bit, the depth pre-pass is tested with GL_EQUAL
+invariant gl_Position;
+
 void main()
 {
     FragPos = vec3(model * vec4(aPos, 1.0));
-    Normal = mat3(transpose(inverse(model))) * aNormal;
+    mat3 normalMatrix = mat3(transpose(inverse(model)));
+    Normal = normalMatrix * aNormal;
     TexCoords = aTexCoords;
+#ifdef TEXTURED
+    Tangent = normalMatrix * aTangent;
+    Bitangent = normalMatrix * aBitangent;
+#endif
     gl_Position = projection * view * vec4(FragPos, 1.0);
 }
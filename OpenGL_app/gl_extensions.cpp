@@ -0,0 +1,51 @@
+#include "gl_extensions.h"
+#include <cstring>
+
+GLExtensions glExtensions;
+
+bool hasGLExtension(const char* name) {
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; i++) {
+        const char* extension = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+        if (extension && std::strcmp(extension, name) == 0)
+            return true;
+    }
+    return false;
+}
+
+void loadGLExtensions(GLADloadproc load) {
+    if (hasGLExtension("GL_KHR_parallel_shader_compile") || hasGLExtension("GL_ARB_parallel_shader_compile")) {
+        glExtensions.MaxShaderCompilerThreadsKHR = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)load("glMaxShaderCompilerThreadsKHR");
+        if (!glExtensions.MaxShaderCompilerThreadsKHR)
+            glExtensions.MaxShaderCompilerThreadsKHR = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)load("glMaxShaderCompilerThreadsARB");
+        glExtensions.parallelShaderCompile = glExtensions.MaxShaderCompilerThreadsKHR != nullptr;
+    }
+    // let the driver pick how many compiler threads to use
+    if (glExtensions.parallelShaderCompile)
+        glExtensions.MaxShaderCompilerThreadsKHR(0xFFFFFFFFu);
+
+    // the extension's entry points carry no suffix, but glad only loads them for a 4.1 context
+    if (!GLAD_GL_VERSION_4_1 && hasGLExtension("GL_ARB_get_program_binary")) {
+        glad_glGetProgramBinary = (PFNGLGETPROGRAMBINARYPROC)load("glGetProgramBinary");
+        glad_glProgramBinary = (PFNGLPROGRAMBINARYPROC)load("glProgramBinary");
+        glad_glProgramParameteri = (PFNGLPROGRAMPARAMETERIPROC)load("glProgramParameteri");
+    }
+    glExtensions.programBinary = glGetProgramBinary != nullptr && glProgramBinary != nullptr && glProgramParameteri != nullptr;
+
+    glExtensions.textureCompressionS3TC = hasGLExtension("GL_EXT_texture_compression_s3tc");
+    GLint major = 0, minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    glExtensions.textureCompressionBPTC = major > 4 || (major == 4 && minor >= 2) || hasGLExtension("GL_ARB_texture_compression_bptc");
+    glExtensions.shaderStorageBufferObject = (major > 4 || (major == 4 && minor >= 3) || hasGLExtension("GL_ARB_shader_storage_buffer_object"))
+        && glShaderStorageBlockBinding != nullptr && glGetProgramResourceIndex != nullptr;
+
+    if (hasGLExtension("GL_ARB_bindless_texture")) {
+        glExtensions.GetTextureHandleARB = (PFNGLGETTEXTUREHANDLEARBPROC)load("glGetTextureHandleARB");
+        glExtensions.MakeTextureHandleResidentARB = (PFNGLMAKETEXTUREHANDLERESIDENTARBPROC)load("glMakeTextureHandleResidentARB");
+        glExtensions.MakeTextureHandleNonResidentARB = (PFNGLMAKETEXTUREHANDLENONRESIDENTARBPROC)load("glMakeTextureHandleNonResidentARB");
+        glExtensions.bindlessTexture = glExtensions.GetTextureHandleARB && glExtensions.MakeTextureHandleResidentARB
+            && glExtensions.MakeTextureHandleNonResidentARB;
+    }
+}
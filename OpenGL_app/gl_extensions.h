@@ -0,0 +1,54 @@
+#ifndef GL_EXTENSIONS_H
+#define GL_EXTENSIONS_H
+
+#include <glad/glad.h>
+
+// Our glad loader is generated for core 4.5 without extensions, so the few
+// extensions we use opportunistically are declared and loaded here.
+
+// GL_KHR_parallel_shader_compile
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+typedef void (APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)(GLuint count);
+
+// GL_EXT_texture_compression_s3tc (BC1, BC3)
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+// GL_ARB_bindless_texture
+typedef GLuint64 (APIENTRYP PFNGLGETTEXTUREHANDLEARBPROC)(GLuint texture);
+typedef void (APIENTRYP PFNGLMAKETEXTUREHANDLERESIDENTARBPROC)(GLuint64 handle);
+typedef void (APIENTRYP PFNGLMAKETEXTUREHANDLENONRESIDENTARBPROC)(GLuint64 handle);
+
+// GL_NVX_gpu_memory_info, in KB
+#ifndef GL_GPU_MEMORY_INFO_DEDICATED_VIDMEM_NVX
+#define GL_GPU_MEMORY_INFO_DEDICATED_VIDMEM_NVX 0x9047
+#endif
+
+struct GLExtensions {
+    bool parallelShaderCompile = false;
+    PFNGLMAXSHADERCOMPILERTHREADSKHRPROC MaxShaderCompilerThreadsKHR = nullptr;
+    bool programBinary = false;           // core in 4.1, or ARB_get_program_binary
+    bool textureCompressionS3TC = false;  // BC1 and BC3
+    bool textureCompressionBPTC = false;  // BC7, core in 4.2
+    bool shaderStorageBufferObject = false; // core in 4.3
+    bool bindlessTexture = false;
+    PFNGLGETTEXTUREHANDLEARBPROC GetTextureHandleARB = nullptr;
+    PFNGLMAKETEXTUREHANDLERESIDENTARBPROC MakeTextureHandleResidentARB = nullptr;
+    PFNGLMAKETEXTUREHANDLENONRESIDENTARBPROC MakeTextureHandleNonResidentARB = nullptr;
+};
+
+extern GLExtensions glExtensions;
+
+// returns true if the current context advertises the named extension
+bool hasGLExtension(const char* name);
+
+// queries the supported extensions and loads their entry points, call once after gladLoadGLLoader
+void loadGLExtensions(GLADloadproc load);
+
+#endif
@@ -0,0 +1,86 @@
+#ifndef GPU_TIMER_H
+#define GPU_TIMER_H
+
+#include <glad/glad.h>
+
+// Measures how long the GPU spends on the commands between begin() and end(), using
+// GL_TIME_ELAPSED queries (core since 3.3). Each measurement gets its own query from a
+// small ring and is read back a few frames later, once the GPU reports it available,
+// so reading the timings never stalls the CPU. Timers must not be nested.
+class GpuTimer
+{
+public:
+    GpuTimer()
+    {
+        glGenQueries(QUERY_COUNT, queries);
+        for (int i = 0; i < QUERY_COUNT; i++)
+            pending[i] = false;
+    }
+
+    ~GpuTimer()
+    {
+        glDeleteQueries(QUERY_COUNT, queries);
+    }
+
+    GpuTimer(const GpuTimer&) = delete;
+    GpuTimer& operator=(const GpuTimer&) = delete;
+
+    void begin()
+    {
+        collect();
+        // all queries still in flight: skip this measurement rather than wait
+        active = !pending[next];
+        if (active)
+            glBeginQuery(GL_TIME_ELAPSED, queries[next]);
+    }
+
+    void end()
+    {
+        if (!active)
+            return;
+        glEndQuery(GL_TIME_ELAPSED);
+        pending[next] = true;
+        next = (next + 1) % QUERY_COUNT;
+        active = false;
+    }
+
+    // exponentially smoothed GPU time in milliseconds, 0 until the first result arrives
+    double milliseconds()
+    {
+        collect();
+        return averageMs;
+    }
+
+private:
+    static const int QUERY_COUNT = 4;
+    unsigned int queries[QUERY_COUNT];
+    bool pending[QUERY_COUNT];
+    int next = 0;
+    bool active = false;
+    bool hasResult = false;
+    double averageMs = 0.0;
+
+    // picks up finished queries in the order they were issued
+    void collect()
+    {
+        for (int i = 0; i < QUERY_COUNT; i++)
+        {
+            int index = (next + i) % QUERY_COUNT;
+            if (!pending[index])
+                continue;
+            GLint available = 0;
+            glGetQueryObjectiv(queries[index], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                break;
+            GLuint64 elapsed = 0;
+            glGetQueryObjectui64v(queries[index], GL_QUERY_RESULT, &elapsed);
+            pending[index] = false;
+
+            double ms = elapsed / 1.0e6;
+            averageMs = hasResult ? averageMs * 0.9 + ms * 0.1 : ms;
+            hasResult = true;
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,47 @@
+#version 330 core
+out float FragDepth;
+
+// Builds one level of the hierarchical-Z pyramid. Level 0 is a copy of the scene depth,
+// every further level stores the farthest depth of the texels it covers in the level
+// above, so a rectangle that is nearer than that value is nearer than everything in it.
+uniform sampler2D source;  // scene depth, or the pyramid with its base level set to the level above
+uniform ivec2 sourceSize;
+uniform bool reduce;       // false for the level 0 copy
+
+// clamped, so a level that is a single texel wide or high still reads inside the source
+float fetch(ivec2 coord)
+{
+    return texelFetch(source, min(coord, sourceSize - 1), 0).r;
+}
+
+void main()
+{
+    ivec2 coord = ivec2(gl_FragCoord.xy);
+    if (!reduce)
+    {
+        FragDepth = fetch(coord);
+        return;
+    }
+
+    ivec2 base = coord * 2;
+    float depth = max(max(fetch(base), fetch(base + ivec2(1, 0))),
+                      max(fetch(base + ivec2(0, 1)), fetch(base + ivec2(1, 1))));
+
+    // odd sizes: the last column/row of this level also covers the leftover texels
+    bool extraColumn = (sourceSize.x & 1) != 0 && base.x + 3 == sourceSize.x;
+    bool extraRow = (sourceSize.y & 1) != 0 && base.y + 3 == sourceSize.y;
+    if (extraColumn)
+    {
+        depth = max(depth, fetch(base + ivec2(2, 0)));
+        depth = max(depth, fetch(base + ivec2(2, 1)));
+    }
+    if (extraRow)
+    {
+        depth = max(depth, fetch(base + ivec2(0, 2)));
+        depth = max(depth, fetch(base + ivec2(1, 2)));
+    }
+    if (extraColumn && extraRow)
+        depth = max(depth, fetch(base + ivec2(2, 2)));
+
+    FragDepth = depth;
+}
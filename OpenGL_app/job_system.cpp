@@ -0,0 +1,147 @@
+#include "job_system.h"
+
+namespace {
+    // the pool the current thread works for, and its queue there
+    thread_local const JobSystem* currentSystem = nullptr;
+    thread_local int currentQueue = -1;
+}
+
+JobSystem::JobSystem(int workerCount) : queued(0) {
+    if (workerCount < 0)
+        workerCount = std::max((int)std::thread::hardware_concurrency() - 1, 0);
+    for (int i = 0; i <= workerCount; i++)
+        queues.emplace_back(new Queue());
+    for (int i = 0; i < workerCount; i++)
+        workers.emplace_back(&JobSystem::workerLoop, this, i);
+}
+
+JobSystem::~JobSystem() {
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        quitting = true;
+    }
+    wake.notify_all();
+    for (std::thread& worker : workers)
+        worker.join();
+}
+
+JobSystem& JobSystem::shared() {
+    static JobSystem system;
+    return system;
+}
+
+int JobSystem::queueIndex() const {
+    return currentSystem == this ? currentQueue : static_cast<int>(queues.size()) - 1;
+}
+
+void JobSystem::run(Job job, JobCounter* counter) {
+    if (counter)
+        counter->pending++;
+    Task task = { std::move(job), counter };
+    push(std::move(task));
+}
+
+void JobSystem::runAfter(JobCounter& dependency, Job job, JobCounter* counter) {
+    if (counter)
+        counter->pending++;
+    {
+        std::lock_guard<std::mutex> lock(dependency.mutex);
+        if (dependency.pending.load() != 0) {
+            JobCounter::Continuation continuation = { std::move(job), counter };
+            dependency.continuations.push_back(std::move(continuation));
+            return;
+        }
+    }
+    Task task = { std::move(job), counter };
+    push(std::move(task));
+}
+
+void JobSystem::wait(JobCounter& counter) {
+    const int index = queueIndex();
+    while (counter.pending.load() != 0) {
+        Task task;
+        if (take(index, task))
+            execute(task);
+        else
+            std::this_thread::yield();
+    }
+    // the job that brought it to zero may still hold the lock
+    std::lock_guard<std::mutex> lock(counter.mutex);
+}
+
+void JobSystem::push(Task task) {
+    Queue& queue = *queues[queueIndex()];
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(std::move(task));
+    }
+    queued++;
+    // taking the lock orders this after a worker's check of queued, so it cannot miss the wake-up
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+    }
+    wake.notify_one();
+}
+
+bool JobSystem::take(int index, Task& task) {
+    if (queued.load() == 0)
+        return false;
+    {
+        Queue& own = *queues[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            queued--;
+            return true;
+        }
+    }
+    const int count = static_cast<int>(queues.size());
+    for (int i = 1; i < count; i++) {
+        Queue& victim = *queues[(index + i) % count];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            queued--;
+            return true;
+        }
+    }
+    return false;
+}
+
+void JobSystem::execute(Task& task) {
+    task.job();
+    finish(task.counter);
+}
+
+void JobSystem::finish(JobCounter* counter) {
+    if (!counter)
+        return;
+    std::vector<JobCounter::Continuation> ready;
+    {
+        std::lock_guard<std::mutex> lock(counter->mutex);
+        if (--counter->pending == 0)
+            ready.swap(counter->continuations);
+    }
+    for (JobCounter::Continuation& continuation : ready) {
+        Task task = { std::move(continuation.job), continuation.counter };
+        push(std::move(task));
+    }
+}
+
+void JobSystem::workerLoop(int index) {
+    currentSystem = this;
+    currentQueue = index;
+    for (;;) {
+        Task task;
+        if (take(index, task)) {
+            execute(task);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        wake.wait(lock, [this] { return quitting || queued.load() > 0; });
+        if (quitting)
+            return;
+    }
+}
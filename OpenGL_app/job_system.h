@@ -0,0 +1,112 @@
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Counts the unfinished jobs of a batch. Jobs can wait on it, or be queued to run once it
+// reaches zero. It must outlive its jobs: wait on it before it goes out of scope.
+class JobCounter {
+public:
+    JobCounter() : pending(0) {}
+    JobCounter(const JobCounter&) = delete;
+    JobCounter& operator=(const JobCounter&) = delete;
+
+    bool isDone() const { return pending.load() == 0; }
+
+private:
+    friend class JobSystem;
+    struct Continuation {
+        std::function<void()> job;
+        JobCounter* counter;
+    };
+
+    std::atomic<int> pending;
+    std::mutex mutex;                        // the last decrement and the continuations
+    std::vector<Continuation> continuations; // queued when pending reaches zero
+};
+
+// A fixed pool of worker threads that run small jobs.
+//
+// Every worker has a deque of its own, and threads outside the pool share one more. A thread
+// pushes the jobs it spawns onto the back of its deque and pops from the back, so nested jobs
+// run while their data is still in its cache; a thread that runs out takes from the front of
+// another's deque, the oldest and usually largest piece of work there. Waiting on a counter
+// runs other jobs in the meantime, so jobs can spawn and wait on jobs of their own without
+// tying up a worker.
+class JobSystem {
+public:
+    typedef std::function<void()> Job;
+
+    // workerCount -1 picks one per hardware thread besides the calling one
+    explicit JobSystem(int workerCount = -1);
+    // stops the workers; jobs still queued are dropped, so wait on them first
+    ~JobSystem();
+
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    // process-wide pool used by loading, compression and culling
+    static JobSystem& shared();
+
+    int getWorkerCount() const { return static_cast<int>(workers.size()); }
+
+    // queues the job; counter, if given, counts it until it has run
+    void run(Job job, JobCounter* counter = nullptr);
+    // queues the job once dependency reaches zero, right away if it is already there
+    void runAfter(JobCounter& dependency, Job job, JobCounter* counter = nullptr);
+    // runs queued jobs until the counter reaches zero; afterwards the counter may be destroyed
+    void wait(JobCounter& counter);
+
+    // calls function(first, last) for consecutive ranges of at most grain items that together
+    // cover [begin, end), on the pool and the calling thread, and returns when all are done
+    template <typename Function>
+    void parallelFor(int begin, int end, int grain, const Function& function) {
+        if (end <= begin)
+            return;
+        grain = std::max(grain, 1);
+        JobCounter counter;
+        for (int first = begin + grain; first < end; first += grain) {
+            const int last = std::min(first + grain, end);
+            run([&function, first, last] { function(first, last); }, &counter);
+        }
+        function(begin, std::min(begin + grain, end));
+        wait(counter);
+    }
+
+private:
+    struct Task {
+        Job job;
+        JobCounter* counter;
+    };
+
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::thread> workers;
+    std::vector<std::unique_ptr<Queue>> queues; // one per worker, then the one for other threads
+    std::atomic<int> queued;                    // tasks in all queues
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    bool quitting = false;
+
+    // the calling thread's queue
+    int queueIndex() const;
+    void push(Task task);
+    // the newest task of queue index, or else the oldest of another queue
+    bool take(int index, Task& task);
+    void execute(Task& task);
+    void finish(JobCounter* counter);
+    void workerLoop(int index);
+};
+
+#endif
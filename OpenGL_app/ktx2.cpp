@@ -0,0 +1,233 @@
+#include "ktx2.h"
+#include <cstring>
+#include <fstream>
+#include <algorithm>
+
+namespace {
+    const unsigned char IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+    // VkFormat values of the block formats
+    const unsigned int VK_FORMAT_BC1_RGB_UNORM_BLOCK = 131;
+    const unsigned int VK_FORMAT_BC3_UNORM_BLOCK = 137;
+    const unsigned int VK_FORMAT_BC5_UNORM_BLOCK = 141;
+    const unsigned int VK_FORMAT_BC7_UNORM_BLOCK = 145;
+
+    // Khronos data format descriptor colour models and channel ids
+    const unsigned int KHR_DF_MODEL_BC1A = 128;
+    const unsigned int KHR_DF_MODEL_BC3 = 130;
+    const unsigned int KHR_DF_MODEL_BC5 = 132;
+    const unsigned int KHR_DF_MODEL_BC7 = 134;
+    const unsigned int KHR_DF_CHANNEL_COLOR = 0;
+    const unsigned int KHR_DF_CHANNEL_GREEN = 1;
+    const unsigned int KHR_DF_CHANNEL_ALPHA = 15;
+
+    const size_t HEADER_SIZE = 80;
+    const size_t LEVEL_INDEX_ENTRY_SIZE = 24;
+
+    unsigned int vkFormat(BlockFormat format) {
+        switch (format) {
+        case BLOCK_BC1: return VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+        case BLOCK_BC3: return VK_FORMAT_BC3_UNORM_BLOCK;
+        case BLOCK_BC5: return VK_FORMAT_BC5_UNORM_BLOCK;
+        default: return VK_FORMAT_BC7_UNORM_BLOCK;
+        }
+    }
+
+    bool blockFormat(unsigned int vkFormat, BlockFormat& format) {
+        switch (vkFormat) {
+        case VK_FORMAT_BC1_RGB_UNORM_BLOCK: format = BLOCK_BC1; return true;
+        case VK_FORMAT_BC3_UNORM_BLOCK: format = BLOCK_BC3; return true;
+        case VK_FORMAT_BC5_UNORM_BLOCK: format = BLOCK_BC5; return true;
+        case VK_FORMAT_BC7_UNORM_BLOCK: format = BLOCK_BC7; return true;
+        default: return false;
+        }
+    }
+
+    void put32(std::vector<unsigned char>& out, unsigned int value) {
+        for (int i = 0; i < 4; i++)
+            out.push_back((value >> (8 * i)) & 0xFF);
+    }
+
+    void put64(std::vector<unsigned char>& out, unsigned long long value) {
+        for (int i = 0; i < 8; i++)
+            out.push_back((value >> (8 * i)) & 0xFF);
+    }
+
+    unsigned int get32(const unsigned char* in) {
+        return in[0] | (in[1] << 8) | (in[2] << 16) | ((unsigned int)in[3] << 24);
+    }
+
+    unsigned long long get64(const unsigned char* in) {
+        return get32(in) | ((unsigned long long)get32(in + 4) << 32);
+    }
+
+    // one basic descriptor block: colour model, linear BT.709, 4x4 texel blocks, and a sample
+    // per 64-bit half of the block
+    std::vector<unsigned char> dataFormatDescriptor(BlockFormat format) {
+        unsigned int model, channels[2];
+        int sampleCount = 1;
+        switch (format) {
+        case BLOCK_BC1: model = KHR_DF_MODEL_BC1A; channels[0] = KHR_DF_CHANNEL_COLOR; break;
+        case BLOCK_BC3: model = KHR_DF_MODEL_BC3; channels[0] = KHR_DF_CHANNEL_ALPHA; channels[1] = KHR_DF_CHANNEL_COLOR; sampleCount = 2; break;
+        case BLOCK_BC5: model = KHR_DF_MODEL_BC5; channels[0] = KHR_DF_CHANNEL_COLOR; channels[1] = KHR_DF_CHANNEL_GREEN; sampleCount = 2; break;
+        default: model = KHR_DF_MODEL_BC7; channels[0] = KHR_DF_CHANNEL_COLOR; break;
+        }
+        const unsigned int blockBytes = TextureCompressor::blockBytes(format);
+        const unsigned int sampleBits = format == BLOCK_BC7 ? 128 : 64;
+        const unsigned int blockSize = 24 + 16 * sampleCount;
+
+        std::vector<unsigned char> out;
+        put32(out, 4 + blockSize);                         // dfdTotalSize
+        put32(out, 0);                                     // vendor Khronos, basic descriptor type
+        put32(out, 2 | (blockSize << 16));                 // version 1.3, block size
+        put32(out, model | (1u << 8) | (1u << 16));        // model, BT.709 primaries, linear, straight alpha
+        put32(out, 3 | (3u << 8));                         // texel block 4x4x1x1, stored minus one
+        put32(out, blockBytes);                            // bytesPlane0
+        put32(out, 0);
+        for (int s = 0; s < sampleCount; s++) {
+            put32(out, (s * sampleBits) | ((sampleBits - 1) << 16) | (channels[s] << 24));
+            put32(out, 0);                                 // sample position
+            put32(out, 0);                                 // lower
+            put32(out, 0xFFFFFFFFu);                       // upper
+        }
+        return out;
+    }
+}
+
+bool writeKtx2(const std::string& path, const CompressedImage& image) {
+    const size_t levelCount = image.levels.size();
+    const size_t alignment = TextureCompressor::blockBytes(image.format);
+    std::vector<unsigned char> dfd = dataFormatDescriptor(image.format);
+    const size_t dfdOffset = HEADER_SIZE + levelCount * LEVEL_INDEX_ENTRY_SIZE;
+
+    // mip data goes smallest level first, each level aligned to the block size
+    std::vector<size_t> offsets(levelCount);
+    size_t end = dfdOffset + dfd.size();
+    for (size_t i = levelCount; i-- > 0;) {
+        end = (end + alignment - 1) / alignment * alignment;
+        offsets[i] = end;
+        end += image.levels[i].size();
+    }
+
+    std::vector<unsigned char> out(IDENTIFIER, IDENTIFIER + sizeof(IDENTIFIER));
+    put32(out, vkFormat(image.format));
+    put32(out, 1);                                         // typeSize of block formats
+    put32(out, image.width);
+    put32(out, image.height);
+    put32(out, 0);                                         // pixelDepth: 2D
+    put32(out, 0);                                         // layerCount: not an array
+    put32(out, image.faces);                               // faceCount
+    put32(out, static_cast<unsigned int>(levelCount));
+    put32(out, 0);                                         // no supercompression
+    put32(out, static_cast<unsigned int>(dfdOffset));
+    put32(out, static_cast<unsigned int>(dfd.size()));
+    put32(out, 0);                                         // no key/value data
+    put32(out, 0);
+    put64(out, 0);                                         // no supercompression global data
+    put64(out, 0);
+    for (size_t i = 0; i < levelCount; i++) {
+        put64(out, offsets[i]);
+        put64(out, image.levels[i].size());
+        put64(out, image.levels[i].size());
+    }
+    out.insert(out.end(), dfd.begin(), dfd.end());
+    for (size_t i = levelCount; i-- > 0;) {
+        out.resize(offsets[i], 0);
+        out.insert(out.end(), image.levels[i].begin(), image.levels[i].end());
+    }
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file)
+        return false;
+    file.write(reinterpret_cast<const char*>(out.data()), out.size());
+    return static_cast<bool>(file);
+}
+
+namespace {
+    // header and level index of an open file; levels are sized but left empty
+    bool readIndex(std::ifstream& file, CompressedImage& image, std::vector<unsigned long long>& offsets) {
+        unsigned char header[HEADER_SIZE];
+        if (!file.read(reinterpret_cast<char*>(header), HEADER_SIZE) || std::memcmp(header, IDENTIFIER, sizeof(IDENTIFIER)) != 0)
+            return false;
+
+        const unsigned char* fields = header + sizeof(IDENTIFIER);
+        unsigned int width = get32(fields + 8), height = get32(fields + 12);
+        unsigned int depth = get32(fields + 16), layers = get32(fields + 20), faces = get32(fields + 24);
+        unsigned int levelCount = get32(fields + 28), supercompression = get32(fields + 32);
+        if (!blockFormat(get32(fields), image.format) || width == 0 || height == 0 || depth != 0 || layers != 0
+            || !(faces == 1 || (faces == 6 && width == height)) || levelCount == 0 || levelCount > 32 || supercompression != 0)
+            return false;
+
+        std::vector<unsigned char> index(levelCount * LEVEL_INDEX_ENTRY_SIZE);
+        if (!file.read(reinterpret_cast<char*>(index.data()), index.size()))
+            return false;
+
+        image.width = static_cast<int>(width);
+        image.height = static_cast<int>(height);
+        image.faces = static_cast<int>(faces);
+        image.levels.assign(levelCount, std::vector<unsigned char>());
+        offsets.resize(levelCount);
+        int levelWidth = image.width, levelHeight = image.height;
+        for (unsigned int i = 0; i < levelCount; i++) {
+            const unsigned char* entry = index.data() + i * LEVEL_INDEX_ENTRY_SIZE;
+            if (get64(entry + 8) != TextureCompressor::levelBytes(image.format, levelWidth, levelHeight) * faces)
+                return false;
+            offsets[i] = get64(entry);
+            levelWidth = levelWidth > 1 ? levelWidth / 2 : 1;
+            levelHeight = levelHeight > 1 ? levelHeight / 2 : 1;
+        }
+        return true;
+    }
+
+    size_t levelSize(const CompressedImage& image, int level) {
+        return TextureCompressor::levelBytes(image.format, std::max(image.width >> level, 1), std::max(image.height >> level, 1)) * image.faces;
+    }
+
+    bool readLevel(std::ifstream& file, const std::vector<unsigned long long>& offsets, int level, unsigned char* data, size_t size) {
+        file.clear();
+        file.seekg(static_cast<std::streamoff>(offsets[level]));
+        return static_cast<bool>(file.read(reinterpret_cast<char*>(data), size));
+    }
+
+    bool readLevel(std::ifstream& file, const CompressedImage& image, const std::vector<unsigned long long>& offsets, int level,
+        std::vector<unsigned char>& data) {
+        data.resize(levelSize(image, level));
+        return readLevel(file, offsets, level, data.data(), data.size());
+    }
+}
+
+bool readKtx2(const std::string& path, CompressedImage& image, int firstLevel) {
+    std::ifstream file(path, std::ios::binary);
+    std::vector<unsigned long long> offsets;
+    if (!file || !readIndex(file, image, offsets))
+        return false;
+    for (int level = std::max(firstLevel, 0); level < static_cast<int>(image.levels.size()); level++) {
+        if (!readLevel(file, image, offsets, level, image.levels[level]))
+            return false;
+    }
+    return true;
+}
+
+bool readKtx2Header(const std::string& path, CompressedImage& image) {
+    std::ifstream file(path, std::ios::binary);
+    std::vector<unsigned long long> offsets;
+    return file && readIndex(file, image, offsets);
+}
+
+bool readKtx2Level(const std::string& path, int level, std::vector<unsigned char>& data) {
+    std::ifstream file(path, std::ios::binary);
+    CompressedImage image;
+    std::vector<unsigned long long> offsets;
+    if (!file || !readIndex(file, image, offsets) || level < 0 || level >= static_cast<int>(offsets.size()))
+        return false;
+    return readLevel(file, image, offsets, level, data);
+}
+
+bool readKtx2Level(const std::string& path, int level, unsigned char* data, size_t size) {
+    std::ifstream file(path, std::ios::binary);
+    CompressedImage image;
+    std::vector<unsigned long long> offsets;
+    if (!file || !readIndex(file, image, offsets) || level < 0 || level >= static_cast<int>(offsets.size()) || levelSize(image, level) != size)
+        return false;
+    return readLevel(file, offsets, level, data, size);
+}
@@ -0,0 +1,26 @@
+#ifndef KTX2_H
+#define KTX2_H
+
+#include <string>
+#include "texture_compressor.h"
+
+// Minimal KTX 2.0 (Khronos texture container) support for cooked block-compressed 2D
+// textures and cube maps: one layer, a full mip chain, no supercompression and no key/value data.
+// The data format descriptor is written so other KTX2 tools can read the files.
+
+// writes image to path; false if the file could not be written
+bool writeKtx2(const std::string& path, const CompressedImage& image);
+
+// reads a file written by writeKtx2 (or any KTX2 file in the same subset), from level firstLevel
+// on; finer levels are left empty. False if the file is missing, malformed, or uses anything else.
+bool readKtx2(const std::string& path, CompressedImage& image, int firstLevel = 0);
+
+// reads the format, size and level count only; every level is left empty
+bool readKtx2Header(const std::string& path, CompressedImage& image);
+
+// reads the data of one level, every face of it
+bool readKtx2Level(const std::string& path, int level, std::vector<unsigned char>& data);
+// the same into memory of its own, e.g. a mapped buffer; false unless the level is exactly size bytes
+bool readKtx2Level(const std::string& path, int level, unsigned char* data, size_t size);
+
+#endif
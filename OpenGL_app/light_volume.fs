@@ -0,0 +1,60 @@
+#version 330 core
+
+// Shades one point or spot light for the pixels covered by its volume; the result is
+// added onto the ambient/directional pass with additive blending.
+// Defines: SPOT_LIGHT (otherwise a point light), BLINN, FOG, SHADOWS
+
+#include "lighting.glsl"
+#include "fog.glsl"
+#ifdef SHADOWS
+#include "shadow_atlas.glsl"
+#endif
+
+uniform sampler2D gPosition;
+uniform sampler2D gNormal;
+uniform sampler2D gAlbedoSpec; // RGB: Albedo, A: Specular intensity
+
+#ifdef SPOT_LIGHT
+uniform SpotLight light;
+#else
+uniform PointLight light;
+#endif
+#ifdef SHADOWS
+uniform int shadowView; // (first) atlas view of the light, -1 = unshadowed
+#endif
+
+uniform vec2 screenSize;
+uniform vec3 viewPos;
+uniform float Ks;
+uniform float shininess;
+
+out vec4 FragColor;
+
+void main() {
+    vec2 texCoords = gl_FragCoord.xy / screenSize;
+    vec3 fragPos = texture(gPosition, texCoords).rgb;
+    vec3 normal = normalize(texture(gNormal, texCoords).rgb);
+    Surface surface = SurfaceFromAlbedoSpec(texture(gAlbedoSpec, texCoords), Ks, shininess);
+    vec3 viewDir = normalize(viewPos - fragPos);
+
+#ifdef SPOT_LIGHT
+#ifdef SHADOWS
+    float shadow = CalcSpotShadow(shadowView, light.position, light.outerCutOff, fragPos, normal);
+    vec3 result = CalcSpotLight(light, normal, fragPos, viewDir, surface, shadow);
+#else
+    vec3 result = CalcSpotLight(light, normal, fragPos, viewDir, surface);
+#endif
+#else
+#ifdef SHADOWS
+    float shadow = CalcPointShadow(shadowView, light.position, fragPos, normal);
+    vec3 result = CalcPointLight(light, normal, fragPos, viewDir, surface, shadow);
+#else
+    vec3 result = CalcPointLight(light, normal, fragPos, viewDir, surface);
+#endif
+#endif
+
+#ifdef FOG
+    result *= CalcFogFactor(fragPos, viewPos);
+#endif
+    FragColor = vec4(result, 1.0);
+}
@@ -0,0 +1,19 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+
+// Defines: FULLSCREEN draws a full-screen triangle (from gl_VertexID, no vertex buffer)
+// instead of the light's sphere/cone volume
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+void main()
+{
+#ifdef FULLSCREEN
+    vec2 position = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2) * 2.0 - 1.0;
+    gl_Position = vec4(position, 0.0, 1.0);
+#else
+    gl_Position = projection * view * model * vec4(aPos, 1.0);
+#endif
+}
@@ -1,60 +1,107 @@
 #include "Lighting.h"
 #include "cube.h"
+#include <algorithm>
+#include <cmath>
+#include <glm/gtc/matrix_transform.hpp>
 
 Lighting::Lighting() {
- 
+    // empty VAO for the full-screen triangle, its vertices are generated from gl_VertexID
+    glGenVertexArrays(1, &fullscreenVAO);
 }
 
-void Lighting::setLightingUniforms(Shader& lightingShader, const Camera& camera, int newTime, glm::vec3 spotlightPosition, glm::vec3 spotlightDirection) {
-    lightingShader.setVec3("viewPos", camera.Position);
-    lightingShader.setFloat("material.shininess", 32.0f);
-    this->skyboxTime = newTime;
-    updateDirectionalLight(lightingShader);
-    // Reflector spotlight
-    lightingShader.setVec3("spotLights[0].position", spotlightPosition);
-    lightingShader.setVec3("spotLights[0].direction", spotlightDirection);
-    lightingShader.setVec3("spotLights[0].ambient", 0.2f, 0.2f, 0.8f);
-    lightingShader.setVec3("spotLights[0].diffuse", 0.3f, 0.3f, 0.8f);
-    lightingShader.setVec3("spotLights[0].specular", 1.0f, 1.0f, 1.0f);
-    lightingShader.setFloat("spotLights[0].constant", 1.0f);
-    lightingShader.setFloat("spotLights[0].linear", 0.09f);
-    lightingShader.setFloat("spotLights[0].quadratic", 0.032f);
-    lightingShader.setFloat("spotLights[0].cutOff", glm::cos(glm::radians(12.5f)));
-    lightingShader.setFloat("spotLights[0].outerCutOff", glm::cos(glm::radians(15.0f)));
+Lighting::~Lighting() {
+    glDeleteVertexArrays(1, &fullscreenVAO);
+}
 
-    // Camera spotlight
-    lightingShader.setVec3("spotLights[1].position", camera.Position);
-    lightingShader.setVec3("spotLights[1].direction", camera.Front);
-    lightingShader.setVec3("spotLights[1].ambient", 0.0f, 0.0f, 0.0f);
-    lightingShader.setVec3("spotLights[1].diffuse", 1.0f, 1.0f, 1.0f);
-    lightingShader.setVec3("spotLights[1].specular", 1.0f, 1.0f, 1.0f);
-    lightingShader.setFloat("spotLights[1].constant", 1.0f);
-    lightingShader.setFloat("spotLights[1].linear", 0.09f);
-    lightingShader.setFloat("spotLights[1].quadratic", 0.032f);
-    lightingShader.setFloat("spotLights[1].cutOff", glm::cos(glm::radians(12.5f)));
-    lightingShader.setFloat("spotLights[1].outerCutOff", glm::cos(glm::radians(15.0f)));
+void Lighting::updateLights(const Camera& camera, float timeOfDay, glm::vec3 spotlightPosition, glm::vec3 spotlightDirection) {
+    this->skyboxTime = timeOfDay;
+    spotLights.resize(2);
 
+    // Reflector spotlight
+    SpotLight& reflector = spotLights[0];
+    reflector.position = spotlightPosition;
+    reflector.direction = spotlightDirection;
+    reflector.ambient = glm::vec3(0.2f, 0.2f, 0.8f);
+    reflector.diffuse = glm::vec3(0.3f, 0.3f, 0.8f);
+    reflector.specular = glm::vec3(1.0f, 1.0f, 1.0f);
+    reflector.constant = 1.0f;
+    reflector.linear = 0.09f;
+    reflector.quadratic = 0.032f;
+    reflector.cutOff = glm::cos(glm::radians(12.5f));
+    reflector.outerCutOff = glm::cos(glm::radians(15.0f));
 
+    // Camera spotlight
+    SpotLight& flashlight = spotLights[1];
+    flashlight.position = camera.Position;
+    flashlight.direction = camera.Front;
+    flashlight.ambient = glm::vec3(0.0f, 0.0f, 0.0f);
+    flashlight.diffuse = glm::vec3(1.0f, 1.0f, 1.0f);
+    flashlight.specular = glm::vec3(1.0f, 1.0f, 1.0f);
+    flashlight.constant = 1.0f;
+    flashlight.linear = 0.09f;
+    flashlight.quadratic = 0.032f;
+    flashlight.cutOff = glm::cos(glm::radians(12.5f));
+    flashlight.outerCutOff = glm::cos(glm::radians(15.0f));
 
     // Point lights (same as before)
+    pointLights.resize(pointLightPositions.size());
     for (size_t i = 0; i < pointLightPositions.size(); ++i) {
-        std::string index = std::to_string(i);
-        lightingShader.setVec3("pointLights[" + index + "].position", pointLightPositions[i]);
-        lightingShader.setVec3("pointLights[" + index + "].ambient", 0.05f, 0.05f, 0.05f);
-        lightingShader.setVec3("pointLights[" + index + "].diffuse", 0.8f, 0.8f, 0.8f);
-        lightingShader.setVec3("pointLights[" + index + "].specular", 1.0f, 1.0f, 1.0f);
-        lightingShader.setFloat("pointLights[" + index + "].constant", 1.0f);
-        lightingShader.setFloat("pointLights[" + index + "].linear", 0.09f);
-        lightingShader.setFloat("pointLights[" + index + "].quadratic", 0.032f);
+        PointLight& light = pointLights[i];
+        light.position = pointLightPositions[i];
+        light.ambient = glm::vec3(0.05f, 0.05f, 0.05f);
+        light.diffuse = glm::vec3(0.8f, 0.8f, 0.8f);
+        light.specular = glm::vec3(1.0f, 1.0f, 1.0f);
+        light.constant = 1.0f;
+        light.linear = 0.09f;
+        light.quadratic = 0.032f;
     }
+}
+
+void Lighting::setLightingUniforms(Shader& lightingShader, const Camera& camera, float timeOfDay, glm::vec3 spotlightPosition, glm::vec3 spotlightDirection) {
+    lightingShader.setVec3("viewPos", camera.Position);
+    lightingShader.setFloat("material.shininess", 32.0f);
+    updateLights(camera, timeOfDay, spotlightPosition, spotlightDirection);
+    updateDirectionalLight(lightingShader);
 
+    for (size_t i = 0; i < spotLights.size(); ++i) {
+        setSpotLightUniforms(lightingShader, "spotLights[" + std::to_string(i) + "]", spotLights[i]);
+        lightingShader.setInt("spotShadowViews[" + std::to_string(i) + "]", i < spotShadowViews.size() ? spotShadowViews[i] : -1);
+    }
+
+    for (size_t i = 0; i < pointLights.size(); ++i) {
+        setPointLightUniforms(lightingShader, "pointLights[" + std::to_string(i) + "]", pointLights[i]);
+        lightingShader.setInt("pointShadowViews[" + std::to_string(i) + "]", i < pointShadowViews.size() ? pointShadowViews[i] : -1);
+    }
+}
+
+void Lighting::setPointLightUniforms(Shader& shader, const std::string& name, const PointLight& light) {
+    shader.setVec3(name + ".position", light.position);
+    shader.setVec3(name + ".ambient", light.ambient);
+    shader.setVec3(name + ".diffuse", light.diffuse);
+    shader.setVec3(name + ".specular", light.specular);
+    shader.setFloat(name + ".constant", light.constant);
+    shader.setFloat(name + ".linear", light.linear);
+    shader.setFloat(name + ".quadratic", light.quadratic);
+}
+
+void Lighting::setSpotLightUniforms(Shader& shader, const std::string& name, const SpotLight& light) {
+    shader.setVec3(name + ".position", light.position);
+    shader.setVec3(name + ".direction", light.direction);
+    shader.setVec3(name + ".ambient", light.ambient);
+    shader.setVec3(name + ".diffuse", light.diffuse);
+    shader.setVec3(name + ".specular", light.specular);
+    shader.setFloat(name + ".constant", light.constant);
+    shader.setFloat(name + ".linear", light.linear);
+    shader.setFloat(name + ".quadratic", light.quadratic);
+    shader.setFloat(name + ".cutOff", light.cutOff);
+    shader.setFloat(name + ".outerCutOff", light.outerCutOff);
 }
 
 
 
 void Lighting::updateDirectionalLight(Shader& lightingShader) {
 
-    glm::vec3 direction = glm::vec3(-0.2f, -1.0f, -0.3f); // Default direction
+    glm::vec3 direction = dirLightDirection;
     glm::vec3 ambient, diffuse, specular;
 
     if (skyboxTime >= 0 && skyboxTime < 5000) {
@@ -120,3 +167,183 @@ void Lighting::drawLightCubes(Shader& lightCubeShader, const glm::mat4& view, co
     }
 }
 
+
+
+float Lighting::lightRadius(float constant, float linear, float quadratic, float maxIntensity) {
+    // solve maxIntensity / (constant + linear * d + quadratic * d^2) = 5/256 for d
+    float threshold = maxIntensity * 256.0f / 5.0f;
+    if (quadratic <= 0.0f)
+        return linear > 0.0f ? (threshold - constant) / linear : 1000.0f;
+    return (-linear + std::sqrt(linear * linear - 4.0f * quadratic * (constant - threshold))) / (2.0f * quadratic);
+}
+
+float Lighting::pointLightRadius(const PointLight& light) {
+    float maxIntensity = std::max(std::max(light.diffuse.r, light.diffuse.g), light.diffuse.b);
+    maxIntensity = std::max(maxIntensity, std::max(std::max(light.specular.r, light.specular.g), light.specular.b));
+    return lightRadius(light.constant, light.linear, light.quadratic, maxIntensity);
+}
+
+float Lighting::spotLightRange(const SpotLight& light) {
+    float maxIntensity = std::max(std::max(light.diffuse.r, light.diffuse.g), light.diffuse.b);
+    maxIntensity = std::max(maxIntensity, std::max(std::max(light.specular.r, light.specular.g), light.specular.b));
+    maxIntensity = std::max(maxIntensity, std::max(std::max(light.ambient.r, light.ambient.g), light.ambient.b));
+    return lightRadius(light.constant, light.linear, light.quadratic, maxIntensity);
+}
+
+glm::mat4 Lighting::spotVolumeMatrix(const SpotLight& light) const {
+    // the cone mesh opens along -Z, so place it like a camera looking down the spot direction
+    glm::vec3 direction = glm::normalize(light.direction);
+    glm::vec3 up = std::abs(direction.y) > 0.99f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+    float range = spotLightRange(light);
+    float sinOuter = std::sqrt(std::max(0.0f, 1.0f - light.outerCutOff * light.outerCutOff));
+    float baseRadius = range * sinOuter / std::max(light.outerCutOff, 0.01f);
+
+    glm::mat4 model = glm::inverse(glm::lookAt(light.position, light.position + direction, up));
+    return glm::scale(model, glm::vec3(baseRadius, baseRadius, range));
+}
+
+bool Lighting::screenRect(const glm::vec3& center, float radius, const glm::mat4& viewProjection,
+    const glm::vec2& screenSize, glm::ivec4& rect) {
+    glm::vec2 minNdc(1.0f), maxNdc(-1.0f);
+    for (int corner = 0; corner < 8; ++corner) {
+        glm::vec3 offset((corner & 1) ? radius : -radius, (corner & 2) ? radius : -radius, (corner & 4) ? radius : -radius);
+        glm::vec4 clip = viewProjection * glm::vec4(center + offset, 1.0f);
+        if (clip.w <= 0.0001f) {
+            // the bounds reach behind the camera, fall back to the whole screen
+            rect = glm::ivec4(0, 0, (int)screenSize.x, (int)screenSize.y);
+            return true;
+        }
+        glm::vec2 ndc = glm::vec2(clip) / clip.w;
+        minNdc = glm::min(minNdc, ndc);
+        maxNdc = glm::max(maxNdc, ndc);
+    }
+    minNdc = glm::clamp(minNdc, glm::vec2(-1.0f), glm::vec2(1.0f));
+    maxNdc = glm::clamp(maxNdc, glm::vec2(-1.0f), glm::vec2(1.0f));
+    if (minNdc.x >= maxNdc.x || minNdc.y >= maxNdc.y)
+        return false;
+
+    glm::vec2 minPixel = glm::floor((minNdc * 0.5f + 0.5f) * screenSize);
+    glm::vec2 maxPixel = glm::ceil((maxNdc * 0.5f + 0.5f) * screenSize);
+    rect = glm::ivec4((int)minPixel.x, (int)minPixel.y, (int)(maxPixel.x - minPixel.x), (int)(maxPixel.y - minPixel.y));
+    return true;
+}
+
+void Lighting::renderLightVolumes(ShaderVariants& volumeShaders, unsigned int featureKey, Shader& stencilShader,
+    const std::function<void(Shader&)>& setSurfaceUniforms,
+    const glm::mat4& view, const glm::mat4& projection, const glm::vec2& screenSize, LightVolumeMode mode) {
+    if (mode == LIGHT_VOLUMES_OFF)
+        return;
+
+    const bool useStencil = mode == LIGHT_VOLUMES_STENCIL;
+    const unsigned int shapeKey = useStencil ? 0u : (unsigned int)LIGHT_VOLUME_FULLSCREEN;
+    Shader& pointShader = volumeShaders.get(featureKey | shapeKey);
+    Shader& spotShader = volumeShaders.get(featureKey | shapeKey | LIGHT_VOLUME_SPOT);
+    const glm::mat4 viewProjection = projection * view;
+
+    Shader* shaders[2] = { &pointShader, &spotShader };
+    for (Shader* shader : shaders) {
+        shader->use();
+        setSurfaceUniforms(*shader);
+        shader->setMat4("view", view);
+        shader->setMat4("projection", projection);
+        shader->setVec2("screenSize", screenSize);
+    }
+    if (useStencil) {
+        stencilShader.use();
+        stencilShader.setMat4("view", view);
+        stencilShader.setMat4("projection", projection);
+    }
+
+    // additive accumulation on top of the ambient/directional pass
+    glEnable(GL_BLEND);
+    glBlendEquation(GL_FUNC_ADD);
+    glBlendFunc(GL_ONE, GL_ONE);
+    glDepthMask(GL_FALSE);
+    glEnable(GL_SCISSOR_TEST);
+    if (useStencil) {
+        glEnable(GL_STENCIL_TEST);
+        // volumes reaching past the far plane must still be rasterized
+        glEnable(GL_DEPTH_CLAMP);
+    }
+
+    // one light: bound it on screen, optionally mark the pixels inside its volume, then shade them
+    auto shadeLight = [&](Shader& shader, const glm::vec3& boundsCenter, float boundsRadius,
+        const glm::mat4& volumeModel, bool isSpot, const std::function<void()>& setLight) {
+        glm::ivec4 rect;
+        if (!screenRect(boundsCenter, boundsRadius, viewProjection, screenSize, rect))
+            return;
+        glScissor(rect.x, rect.y, rect.z, rect.w);
+
+        if (useStencil) {
+            // stencil pass: depth-fail counting leaves a non-zero value only where the
+            // G-buffer surface lies between the volume's front and back faces
+            glClear(GL_STENCIL_BUFFER_BIT);
+            glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+            glEnable(GL_DEPTH_TEST);
+            glDisable(GL_CULL_FACE);
+            glStencilFunc(GL_ALWAYS, 0, 0);
+            glStencilOpSeparate(GL_BACK, GL_KEEP, GL_INCR_WRAP, GL_KEEP);
+            glStencilOpSeparate(GL_FRONT, GL_KEEP, GL_DECR_WRAP, GL_KEEP);
+            stencilShader.use();
+            stencilShader.setMat4("model", volumeModel);
+            if (isSpot) volumeCone.render(); else volumeSphere.render();
+
+            // lighting pass: back faces only, so it works with the camera inside the volume
+            // (both the sphere and the cone are wound counter-clockwise seen from outside)
+            glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+            glDisable(GL_DEPTH_TEST);
+            glEnable(GL_CULL_FACE);
+            glCullFace(GL_FRONT);
+            glStencilFunc(GL_NOTEQUAL, 0, 0xFF);
+            glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+        }
+        else {
+            glDisable(GL_DEPTH_TEST);
+        }
+
+        shader.use();
+        setLight();
+        if (useStencil) {
+            shader.setMat4("model", volumeModel);
+            if (isSpot) volumeCone.render(); else volumeSphere.render();
+        }
+        else {
+            glBindVertexArray(fullscreenVAO);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+        }
+    };
+
+    for (size_t i = 0; i < pointLights.size(); ++i) {
+        const PointLight& light = pointLights[i];
+        float radius = pointLightRadius(light);
+        int shadowView = i < pointShadowViews.size() ? pointShadowViews[i] : -1;
+        // the tessellated sphere lies inside the unit sphere, pad it slightly
+        glm::mat4 model = glm::scale(glm::translate(glm::mat4(1.0f), light.position), glm::vec3(radius * 1.02f));
+        shadeLight(pointShader, light.position, radius, model, false,
+            [&]() {
+                setPointLightUniforms(pointShader, "light", light);
+                pointShader.setInt("shadowView", shadowView);
+            });
+    }
+    for (size_t i = 0; i < spotLights.size(); ++i) {
+        const SpotLight& light = spotLights[i];
+        float range = spotLightRange(light);
+        int shadowView = i < spotShadowViews.size() ? spotShadowViews[i] : -1;
+        shadeLight(spotShader, light.position, range, spotVolumeMatrix(light), true,
+            [&]() {
+                setSpotLightUniforms(spotShader, "light", light);
+                spotShader.setInt("shadowView", shadowView);
+            });
+    }
+
+    // back to the state the rest of the frame expects
+    glBindVertexArray(0);
+    glDisable(GL_CULL_FACE);
+    glCullFace(GL_BACK);
+    glDisable(GL_STENCIL_TEST);
+    glDisable(GL_DEPTH_CLAMP);
+    glDisable(GL_SCISSOR_TEST);
+    glDisable(GL_BLEND);
+    glDepthMask(GL_TRUE);
+    glEnable(GL_DEPTH_TEST);
+}
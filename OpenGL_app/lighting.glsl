@@ -0,0 +1,105 @@
+#ifndef LIGHTING_GLSL
+#define LIGHTING_GLSL
+
+// Shared light library, included by every shader that does lighting.
+// Defines: BLINN switches the specular model from Phong to Blinn-Phong.
+
+#include "material.glsl"
+
+struct DirLight {
+    vec3 direction;
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+struct PointLight {
+    vec3 position;
+    float constant;
+    float linear;
+    float quadratic;
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+struct SpotLight {
+    vec3 position;
+    vec3 direction;
+    float cutOff;
+    float outerCutOff;
+    float constant;
+    float linear;
+    float quadratic;
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+float CalcSpecular(vec3 lightDir, vec3 normal, vec3 viewDir, float shininess) {
+#ifdef BLINN
+    vec3 halfwayDir = normalize(lightDir + viewDir);
+    return pow(max(dot(normal, halfwayDir), 0.0), shininess * 4.0);
+#else
+    vec3 reflectDir = reflect(-lightDir, normal);
+    return pow(max(dot(viewDir, reflectDir), 0.0), shininess);
+#endif
+}
+
+float CalcAttenuation(float constant, float linear, float quadratic, float distance) {
+    return 1.0 / (constant + linear * distance + quadratic * distance * distance);
+}
+
+// shadow: 1.0 = lit, 0.0 = shadowed; it only removes the diffuse and specular terms
+vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir, Surface surface, float shadow) {
+    vec3 lightDir = normalize(-light.direction);
+    float diff = max(dot(normal, lightDir), 0.0);
+    float spec = CalcSpecular(lightDir, normal, viewDir, surface.shininess);
+
+    vec3 ambient = light.ambient * surface.ambient;
+    vec3 diffuse = light.diffuse * diff * surface.diffuse;
+    vec3 specular = light.specular * spec * surface.specular;
+    return (ambient + shadow * (diffuse + specular));
+}
+
+vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir, Surface surface) {
+    return CalcDirLight(light, normal, viewDir, surface, 1.0);
+}
+
+vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir, Surface surface, float shadow) {
+    vec3 lightDir = normalize(light.position - fragPos);
+    float diff = max(dot(normal, lightDir), 0.0);
+    float spec = CalcSpecular(lightDir, normal, viewDir, surface.shininess);
+    float attenuation = CalcAttenuation(light.constant, light.linear, light.quadratic, length(light.position - fragPos));
+
+    vec3 ambient = light.ambient * surface.ambient;
+    vec3 diffuse = light.diffuse * diff * surface.diffuse;
+    vec3 specular = light.specular * spec * surface.specular;
+    return (ambient + shadow * (diffuse + specular)) * attenuation;
+}
+
+vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir, Surface surface) {
+    return CalcPointLight(light, normal, fragPos, viewDir, surface, 1.0);
+}
+
+vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir, Surface surface, float shadow) {
+    vec3 lightDir = normalize(light.position - fragPos);
+    float diff = max(dot(normal, lightDir), 0.0);
+    float spec = CalcSpecular(lightDir, normal, viewDir, surface.shininess);
+    float attenuation = CalcAttenuation(light.constant, light.linear, light.quadratic, length(light.position - fragPos));
+
+    float theta = dot(lightDir, normalize(-light.direction));
+    float epsilon = light.cutOff - light.outerCutOff;
+    float intensity = clamp((theta - light.outerCutOff) / epsilon, 0.0, 1.0);
+
+    vec3 ambient = light.ambient * surface.ambient;
+    vec3 diffuse = light.diffuse * diff * surface.diffuse;
+    vec3 specular = light.specular * spec * surface.specular;
+    return (ambient + shadow * (diffuse + specular)) * attenuation * intensity;
+}
+
+vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir, Surface surface) {
+    return CalcSpotLight(light, normal, fragPos, viewDir, surface, 1.0);
+}
+
+#endif
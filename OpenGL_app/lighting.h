@@ -2,24 +2,106 @@
 #define LIGHTING_H
 
 #include <glm/glm.hpp>
+#include <functional>
 #include <vector>
 #include "Shader.h" 
+#include "shader_variants.h"
 #include "Camera.h"
+#include "sphere.h"
+#include "cone.h"
+
+// CPU-side copies of the light structs in lighting.glsl
+struct PointLight {
+    glm::vec3 position;
+    glm::vec3 ambient, diffuse, specular;
+    float constant, linear, quadratic;
+};
+
+struct SpotLight {
+    glm::vec3 position;
+    glm::vec3 direction;
+    glm::vec3 ambient, diffuse, specular;
+    float constant, linear, quadratic;
+    float cutOff, outerCutOff; // cosines of the inner and outer cone angles
+};
+
+// How the point and spot lights are applied in the deferred lighting pass
+enum LightVolumeMode {
+    LIGHT_VOLUMES_OFF,      // every light runs over every pixel of the full-screen pass
+    LIGHT_VOLUMES_STENCIL,  // sphere/cone volumes, stencil-marked to the pixels inside them
+    LIGHT_VOLUMES_SCISSOR,  // full-screen pass per light, scissored to its screen rectangle
+    LIGHT_VOLUME_MODE_COUNT
+};
+
+// Permutation bits of the light volume shader (light_volume.vs/.fs); BLINN and FOG share
+// their bit positions with the full-screen lighting pass so one key drives both
+enum LightVolumeFeature {
+    LIGHT_VOLUME_BLINN = 1 << 0,
+    LIGHT_VOLUME_FOG = 1 << 1,
+    LIGHT_VOLUME_SPOT = 1 << 2,
+    LIGHT_VOLUME_FULLSCREEN = 1 << 3,
+    LIGHT_VOLUME_SHADOWS = 1 << 4
+};
 
 class Lighting {
 public:
     Lighting();
-    void setLightingUniforms(Shader& lightingShader, const Camera& camera, int newTime, glm::vec3 spotlightPosition, glm::vec3 spotlightDirection);
+    ~Lighting();
+    void setLightingUniforms(Shader& lightingShader, const Camera& camera, float timeOfDay, glm::vec3 spotlightPosition, glm::vec3 spotlightDirection);
         void updateDirectionalLight(Shader& lightingShader);
     void drawLightCubes(Shader& lightCubeShader, const glm::mat4& view, const glm::mat4& projection);
     void setPointLightPositions(const std::vector<glm::vec3>& positions);
 
+    // refreshes the light list for this frame without touching any shader
+    void updateLights(const Camera& camera, float timeOfDay, glm::vec3 spotlightPosition, glm::vec3 spotlightDirection);
+
+    // Adds every point and spot light onto the bound framebuffer, which must hold the scene depth
+    // (and a stencil buffer for LIGHT_VOLUMES_STENCIL). setSurfaceUniforms sets the G-buffer
+    // samplers and material uniforms on each light volume shader variant before it is used.
+    void renderLightVolumes(ShaderVariants& volumeShaders, unsigned int featureKey, Shader& stencilShader,
+        const std::function<void(Shader&)>& setSurfaceUniforms,
+        const glm::mat4& view, const glm::mat4& projection, const glm::vec2& screenSize, LightVolumeMode mode);
+
+    // distance at which the light's contribution drops below 5/256 of its peak
+    static float lightRadius(float constant, float linear, float quadratic, float maxIntensity);
+    static float pointLightRadius(const PointLight& light);
+    static float spotLightRange(const SpotLight& light);
+
+    // first shadow atlas view of each point light (-1 = unshadowed), see ShadowAtlas
+    void setPointShadowViews(const std::vector<int>& views) { pointShadowViews = views; }
+    // shadow atlas view of each spot light (-1 = unshadowed)
+    void setSpotShadowViews(const std::vector<int>& views) { spotShadowViews = views; }
+
+    // direction the sun/moon light travels in, also used to render its shadow cascades
+    const glm::vec3& getDirectionalLightDirection() const { return dirLightDirection; }
+    const std::vector<PointLight>& getPointLights() const { return pointLights; }
+    const std::vector<SpotLight>& getSpotLights() const { return spotLights; }
+
 private:
     std::vector<glm::vec3> pointLightPositions;
+    std::vector<PointLight> pointLights;
+    std::vector<SpotLight> spotLights;
+    std::vector<int> pointShadowViews;
+    std::vector<int> spotShadowViews;
+    glm::vec3 dirLightDirection = glm::vec3(-0.2f, -1.0f, -0.3f);
     glm::vec3 lightCubeColor = glm::vec3(1.0f, 1.0f, 1.0f);  
 
     unsigned int lightCubeVAO = 0, lightCubeVBO = 0;
-    int skyboxTime = 0;
+    float skyboxTime = 0.0f; // time of day in milliseconds
+
+    // light volume geometry
+    Sphere volumeSphere;
+    Cone volumeCone;
+    unsigned int fullscreenVAO = 0;
+
+    static void setPointLightUniforms(Shader& shader, const std::string& name, const PointLight& light);
+    static void setSpotLightUniforms(Shader& shader, const std::string& name, const SpotLight& light);
+
+    glm::mat4 spotVolumeMatrix(const SpotLight& light) const;
+
+    // screen-space bounds of a world-space sphere; false if it is entirely off screen
+    static bool screenRect(const glm::vec3& center, float radius, const glm::mat4& viewProjection,
+        const glm::vec2& screenSize, glm::ivec4& rect);
 };
 
 #endif
@@ -0,0 +1,52 @@
+#ifndef LOD_SELECTOR_H
+#define LOD_SELECTOR_H
+
+#include <glm/glm.hpp>
+#include <cmath>
+
+// Picks a level of detail from how large an object appears on screen. LOD 0 is used while
+// the object covers at least fullDetailSize of the viewport height, and every further level
+// takes over at half the size of the previous one. A level only changes once the size is
+// a hysteresis fraction past the threshold, so an object sitting right at a threshold
+// does not flicker between two levels.
+class LodSelector
+{
+public:
+    explicit LodSelector(float fullDetailSize = 0.5f, float hysteresis = 0.15f)
+        : fullDetailSize(fullDetailSize), hysteresis(hysteresis)
+    {
+    }
+
+    // fraction of the viewport height covered by a bounding sphere
+    static float screenSize(const glm::vec3& center, float radius, const glm::vec3& cameraPosition, float fovy)
+    {
+        float distance = glm::length(center - cameraPosition);
+        if (distance <= radius)
+            return 1.0f;
+        return radius / (distance * std::tan(fovy * 0.5f));
+    }
+
+    // updates and returns the level for this frame, in [0, lodCount)
+    int select(float size, int lodCount)
+    {
+        if (current >= lodCount)
+            current = lodCount - 1;
+        while (current + 1 < lodCount && size < threshold(current + 1) * (1.0f - hysteresis))
+            current++;
+        while (current > 0 && size > threshold(current) * (1.0f + hysteresis))
+            current--;
+        return current;
+    }
+
+    int getLod() const { return current; }
+
+private:
+    float fullDetailSize;
+    float hysteresis;
+    int current = 0;
+
+    // size below which level lod is used
+    float threshold(int lod) const { return fullDetailSize * std::ldexp(1.0f, 1 - lod); }
+};
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef MATERIAL_GLSL
+#define MATERIAL_GLSL
+
+// Surface response fed to the Calc*Light functions in lighting.glsl.
+// The forward shader fills it from a Material, the deferred one from the G-buffer.
+struct Surface {
+    vec3 ambient;     // multiplied with the light's ambient term
+    vec3 diffuse;     // multiplied with the light's diffuse term
+    vec3 specular;    // multiplied with the light's specular term (already scaled by strength)
+    float shininess;  // Phong exponent, Blinn-Phong uses 4x this
+};
+
+struct Material {
+    sampler2D diffuse;
+    sampler2D specular;
+    vec3 ambientColor;
+    vec3 diffuseColor;
+    vec3 specularColor;
+    float shininess;
+    bool useTextures; // New flag to determine whether to use textures or uniform colors
+};
+
+Surface SurfaceFromMaterial(Material material, vec2 texCoords) {
+    Surface surface;
+    if (material.useTextures) {
+        vec3 diffuseColor = vec3(texture(material.diffuse, texCoords));
+        surface.ambient = diffuseColor;
+        surface.diffuse = diffuseColor;
+        surface.specular = vec3(texture(material.specular, texCoords));
+    } else {
+        surface.ambient = material.ambientColor;
+        surface.diffuse = material.diffuseColor;
+        surface.specular = material.specularColor;
+    }
+    surface.shininess = material.shininess;
+    return surface;
+}
+
+// G-buffer layout: RGB albedo, A specular intensity, scaled by the global Ks
+Surface SurfaceFromAlbedoSpec(vec4 albedoSpec, float Ks, float shininess) {
+    Surface surface;
+    surface.ambient = albedoSpec.rgb;
+    surface.diffuse = albedoSpec.rgb;
+    surface.specular = vec3(albedoSpec.a * Ks * Ks); // Scale specular by Ks
+    surface.shininess = shininess;
+    return surface;
+}
+
+#endif
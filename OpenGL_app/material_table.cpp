@@ -0,0 +1,271 @@
+#include "material_table.h"
+#include "texture_memory.h"
+#include "texture_streamer.h"
+#include <algorithm>
+#include <iostream>
+
+namespace {
+    // size of level 0 of a 2D texture, 0x0 if it has no image
+    void textureSize(unsigned int texture, int& width, int& height) {
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+    }
+
+    // first texture of the given type, nullptr if there is none
+    const Texture* findMap(const std::vector<Texture>& textures, const char* type) {
+        for (const Texture& texture : textures) {
+            if (texture.type == type)
+                return &texture;
+        }
+        return nullptr;
+    }
+}
+
+MaterialTable::~MaterialTable() {
+    for (GLuint64 handle : residentHandles)
+        glExtensions.MakeTextureHandleNonResidentARB(handle);
+    if (materialBuffer != 0)
+        glDeleteBuffers(1, &materialBuffer);
+    for (unsigned int array : ownedArrays)
+        TextureMemory::shared().untrack(array);
+    if (!ownedArrays.empty())
+        glDeleteTextures(static_cast<GLsizei>(ownedArrays.size()), ownedArrays.data());
+}
+
+MaterialMode MaterialTable::supportedMode() {
+    return glExtensions.bindlessTexture && glExtensions.shaderStorageBufferObject ? MATERIALS_BINDLESS : MATERIALS_ARRAYS;
+}
+
+std::vector<std::string> MaterialTable::shaderDefines() {
+    if (supportedMode() == MATERIALS_BINDLESS)
+        return { "BINDLESS_MATERIALS" };
+    return { "ARRAY_MATERIALS", "MAX_MATERIALS " + std::to_string(MAX_MATERIALS) };
+}
+
+void MaterialTable::build(std::vector<Mesh>& meshes) {
+    mode = supportedMode();
+    bool tooManyMaterials = false;
+    for (Mesh& mesh : meshes) {
+        Material material;
+        const char* types[MAP_TYPES] = { "texture_diffuse", "texture_specular", "texture_normal" };
+        for (int type = 0; type < MAP_TYPES; type++) {
+            if (const Texture* texture = findMap(mesh.textures, types[type])) {
+                material.maps[type].texture = texture->id;
+                material.maps[type].uvTransform = texture->uvTransform;
+            }
+        }
+
+        auto same = [&material](const Material& other) {
+            for (int type = 0; type < MAP_TYPES; type++) {
+                if (other.maps[type].texture != material.maps[type].texture || other.maps[type].uvTransform != material.maps[type].uvTransform)
+                    return false;
+            }
+            return true;
+        };
+        auto it = std::find_if(materials.begin(), materials.end(), same);
+        if (it != materials.end()) {
+            mesh.material = static_cast<int>(it - materials.begin());
+        }
+        else if (mode == MATERIALS_ARRAYS && static_cast<int>(materials.size()) == MAX_MATERIALS) {
+            tooManyMaterials = true;
+            mesh.material = 0;
+        }
+        else {
+            mesh.material = static_cast<int>(materials.size());
+            materials.push_back(material);
+        }
+    }
+
+    if (tooManyMaterials)
+        std::cout << "WARNING::MATERIALS::TOO_MANY_MATERIALS: only " << MAX_MATERIALS << " fit the uniforms, the other meshes use the first" << std::endl;
+
+    if (mode == MATERIALS_BINDLESS)
+        buildBindless();
+    else
+        buildArrays();
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    std::cout << "Materials: " << materials.size() << " for " << meshes.size() << " meshes, "
+        << (mode == MATERIALS_BINDLESS ? std::to_string(residentHandles.size()) + " bindless textures" : std::to_string(arrays.size()) + " texture arrays")
+        << std::endl;
+}
+
+void MaterialTable::buildBindless() {
+    std::vector<unsigned int> textures;
+    std::vector<GLuint64> handles;
+    auto fillSlot = [&](MapSlot& slot) {
+        int width = 0, height = 0;
+        if (slot.texture != 0)
+            textureSize(slot.texture, width, height);
+        if (width == 0 && !TextureStreamer::shared().isStreamed(slot.texture))
+            return;
+        auto it = std::find(textures.begin(), textures.end(), slot.texture);
+        if (it != textures.end())
+            slot.handle = handles[it - textures.begin()];
+        else {
+            // the handle freezes the texture, so it can no longer stream
+            TextureStreamer::shared().release(slot.texture);
+            slot.handle = glExtensions.GetTextureHandleARB(slot.texture);
+            if (slot.handle != 0)
+                glExtensions.MakeTextureHandleResidentARB(slot.handle);
+            textures.push_back(slot.texture);
+            handles.push_back(slot.handle);
+        }
+    };
+
+    // per material two uvec4, the diffuse and specular handle, the normal map handle and whether
+    // there is one, then the UV transform of every map
+    std::vector<GLuint> data;
+    for (Material& material : materials) {
+        for (MapSlot& slot : material.maps) {
+            fillSlot(slot);
+            data.push_back(static_cast<GLuint>(slot.handle));
+            data.push_back(static_cast<GLuint>(slot.handle >> 32));
+        }
+        data.push_back(material.maps[MAP_NORMAL].handle != 0);
+        data.push_back(0);
+        for (const MapSlot& slot : material.maps) {
+            const GLuint* transform = reinterpret_cast<const GLuint*>(&slot.uvTransform[0]);
+            data.insert(data.end(), transform, transform + 4);
+        }
+    }
+    for (GLuint64 handle : handles) {
+        if (handle != 0)
+            residentHandles.push_back(handle);
+    }
+
+    glGenBuffers(1, &materialBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, materialBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, data.size() * sizeof(GLuint), data.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void MaterialTable::buildArrays() {
+    // textures that can share an array: streamed ones of the same block format and size, and
+    // uncompressed ones of the same size, which are copied into RGBA8 arrays
+    struct Group {
+        bool streamed;
+        BlockFormat format;
+        int width, height;
+        std::vector<unsigned int> textures;
+    };
+    std::vector<Group> groups;
+    bool tooManyArrays = false;
+    auto fillSlot = [&](MapSlot& slot) {
+        const unsigned int texture = slot.texture;
+        if (texture == 0)
+            return;
+        Group key = { TextureStreamer::shared().isStreamed(texture), BLOCK_BC1, 0, 0, {} };
+        if (key.streamed)
+            TextureStreamer::shared().getFormat(texture, key.format, key.width, key.height);
+        else
+            textureSize(texture, key.width, key.height);
+        if (key.width == 0)
+            return;
+
+        auto same = [&key](const Group& group) {
+            return group.streamed == key.streamed && (!key.streamed || group.format == key.format)
+                && group.width == key.width && group.height == key.height;
+        };
+        auto group = std::find_if(groups.begin(), groups.end(), same);
+        if (group == groups.end()) {
+            if (static_cast<int>(groups.size()) == MAX_ARRAYS) {
+                tooManyArrays = true;
+                return;
+            }
+            groups.push_back(key);
+            group = groups.end() - 1;
+        }
+        auto layer = std::find(group->textures.begin(), group->textures.end(), texture);
+        slot.array = static_cast<int>(group - groups.begin());
+        slot.layer = static_cast<int>(layer - group->textures.begin());
+        if (layer == group->textures.end())
+            group->textures.push_back(texture);
+    };
+    for (Material& material : materials) {
+        for (MapSlot& slot : material.maps)
+            fillSlot(slot);
+    }
+    if (tooManyArrays)
+        std::cout << "WARNING::MATERIALS::TOO_MANY_TEXTURE_ARRAYS: textures beyond " << MAX_ARRAYS << " formats and sizes are left out" << std::endl;
+
+    for (const Group& group : groups) {
+        unsigned int array = 0;
+        if (group.streamed) {
+            array = TextureStreamer::shared().mergeIntoArray(group.textures);
+            if (array == 0)
+                std::cout << "WARNING::MATERIALS::ARRAY_NOT_BUILT: " << group.textures.size() << " streamed textures" << std::endl;
+        }
+        else {
+            glGenTextures(1, &array);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, array);
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, group.width, group.height, static_cast<GLsizei>(group.textures.size()), 0,
+                GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+            std::vector<unsigned char> pixels(size_t(group.width) * group.height * 4);
+            for (size_t layer = 0; layer < group.textures.size(); layer++) {
+                glBindTexture(GL_TEXTURE_2D, group.textures[layer]);
+                glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+                glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, static_cast<GLint>(layer), group.width, group.height, 1,
+                    GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+                TextureMemory::shared().untrack(group.textures[layer]);
+                glDeleteTextures(1, &group.textures[layer]);
+            }
+            glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+            TextureMemory::shared().track(array, GL_TEXTURE_2D_ARRAY, TEXTURES_MODELS);
+            ownedArrays.push_back(array);
+        }
+        arrays.push_back(array);
+    }
+
+    // ivec4 per material: the array of the diffuse, specular and normal map and whether there is
+    // a normal map, then the layers; and a UV transform per map
+    for (Material& material : materials) {
+        for (MapSlot& slot : material.maps) {
+            if (slot.array >= 0 && arrays[slot.array] == 0)
+                slot.array = -1;
+            uvTransformData.push_back(slot.uvTransform);
+        }
+        const MapSlot* maps = material.maps;
+        arrayData.insert(arrayData.end(), { maps[MAP_DIFFUSE].array, maps[MAP_SPECULAR].array, maps[MAP_NORMAL].array, maps[MAP_NORMAL].array >= 0 });
+        layerData.insert(layerData.end(), { maps[MAP_DIFFUSE].layer, maps[MAP_SPECULAR].layer, maps[MAP_NORMAL].layer, 0 });
+    }
+}
+
+void MaterialTable::bind(const Shader& shader) const {
+    if (mode == MATERIALS_BINDLESS) {
+        GLuint block = glGetProgramResourceIndex(shader.ID, GL_SHADER_STORAGE_BLOCK, "MaterialBuffer");
+        if (block != GL_INVALID_INDEX)
+            glShaderStorageBlockBinding(shader.ID, block, 0);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, materialBuffer);
+        return;
+    }
+
+    for (size_t i = 0; i < arrays.size(); i++) {
+        glActiveTexture(GL_TEXTURE0 + static_cast<GLenum>(i));
+        glBindTexture(GL_TEXTURE_2D_ARRAY, arrays[i]);
+    }
+    glActiveTexture(GL_TEXTURE0);
+    for (int i = 0; i < MAX_ARRAYS; i++)
+        shader.setInt("materialArrays[" + std::to_string(i) + "]", i);
+    if (!materials.empty()) {
+        glUniform4iv(glGetUniformLocation(shader.ID, "materialArray"), static_cast<GLsizei>(materials.size()), arrayData.data());
+        glUniform4iv(glGetUniformLocation(shader.ID, "materialLayer"), static_cast<GLsizei>(materials.size()), layerData.data());
+        glUniform4fv(glGetUniformLocation(shader.ID, "materialUvTransform"), static_cast<GLsizei>(uvTransformData.size()), &uvTransformData[0][0]);
+    }
+}
+
+void MaterialTable::requestMips(int material, float uvPerPixel) const {
+    if (mode != MATERIALS_ARRAYS || material < 0 || material >= static_cast<int>(materials.size()))
+        return;
+    for (const MapSlot& slot : materials[material].maps) {
+        // an atlas cell covers only part of the texture's UV range
+        if (slot.array >= 0)
+            TextureStreamer::shared().request(arrays[slot.array], uvPerPixel * std::max(slot.uvTransform.x, slot.uvTransform.y));
+    }
+}
@@ -0,0 +1,84 @@
+#ifndef MATERIAL_TABLE_H
+#define MATERIAL_TABLE_H
+
+#include <glad/glad.h>
+#include <string>
+#include <vector>
+#include "gl_extensions.h"
+#include "mesh.h"
+#include "shader.h"
+
+enum MaterialMode {
+    MATERIALS_BINDLESS, // ARB_bindless_texture handles in a shader storage buffer
+    MATERIALS_ARRAYS    // textures of one format and size share a GL_TEXTURE_2D_ARRAY
+};
+
+// The textures of every material of a model, bound once per pass instead of per mesh.
+//
+// build() gives each mesh the index of its material (its diffuse, specular and normal map, each
+// with the UV transform of its atlas cell) and takes over the textures. With bindless textures the material buffer holds one handle per
+// map; otherwise the textures are moved into arrays, one per format and size, and the shader
+// gets the array and layer of every map as uniforms. A draw then only sets materialIndex, so
+// meshes with different materials no longer differ in texture state.
+//
+// Bindless handles freeze their texture, so in that mode streamed textures are loaded in full
+// first. Arrays keep streaming, all layers at once.
+class MaterialTable {
+public:
+    static const int MAX_ARRAYS = 8;     // sampler2DArray uniforms in g_buffer.fs
+    // material uniforms in g_buffer.fs without bindless: five vec4 each, so 48 stay within the
+    // 256 vec4 a GL 3.3 fragment shader is guaranteed
+    static const int MAX_MATERIALS = 48;
+
+    MaterialTable() = default;
+    ~MaterialTable();
+    MaterialTable(const MaterialTable&) = delete;
+    MaterialTable& operator=(const MaterialTable&) = delete;
+
+    // bindless when the extension and shader storage buffers are there
+    static MaterialMode supportedMode();
+    // defines the textured G-buffer shader needs for supportedMode()
+    static std::vector<std::string> shaderDefines();
+
+    // assigns Mesh::material and builds the textures and data of every material
+    void build(std::vector<Mesh>& meshes);
+
+    // binds the material data and textures for shader, which has to be in use; once before the
+    // draws of a pass
+    void bind(const Shader& shader) const;
+
+    // forwards to the texture streamer for every texture of the material
+    void requestMips(int material, float uvPerPixel) const;
+
+    size_t size() const { return materials.size(); }
+
+private:
+    enum MapType { MAP_DIFFUSE, MAP_SPECULAR, MAP_NORMAL, MAP_TYPES };
+
+    // one map of a material, and where the shader finds it: a texture (array), a layer of it,
+    // and a bindless handle
+    struct MapSlot {
+        unsigned int texture = 0; // source texture, 0 if the material has no such map
+        glm::vec4 uvTransform = glm::vec4(1.0f, 1.0f, 0.0f, 0.0f);
+        int array = -1; // index into arrays, -1 if the map is missing (always -1 with bindless)
+        int layer = 0;
+        GLuint64 handle = 0;
+    };
+    struct Material {
+        MapSlot maps[MAP_TYPES];
+    };
+
+    MaterialMode mode = MATERIALS_ARRAYS;
+    std::vector<Material> materials;
+    std::vector<unsigned int> arrays;      // array textures, streamed or not
+    std::vector<unsigned int> ownedArrays; // the ones not owned by the texture streamer
+    std::vector<GLuint64> residentHandles;
+    unsigned int materialBuffer = 0;
+    std::vector<GLint> arrayData, layerData; // ivec4 per material for the uniforms
+    std::vector<glm::vec4> uvTransformData;  // one per map of every material
+
+    void buildBindless();
+    void buildArrays();
+};
+
+#endif
@@ -10,12 +10,18 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 
+#include <algorithm>
+#include <cmath>
 #include <string>
 #include <vector>
 #include "shader.h"
+#include "frustum.h"
+#include "mesh_optimizer.h"
 using namespace std;
 
 #define MAX_BONE_INFLUENCE 4
+// meshes with at most this many vertices get 16-bit indices; 0xFFFF stays free as a primitive restart index
+#define MAX_SHORT_INDEX_VERTICES 65535
 
 struct Vertex {
     // position
@@ -34,10 +40,18 @@ struct Vertex {
     float m_Weights[MAX_BONE_INFLUENCE];
 };
 
+// a level of detail: a range of the mesh's index buffer
+struct MeshLod {
+    unsigned int firstIndex;
+    unsigned int indexCount;
+};
+
 struct Texture {
     unsigned int id;
     string type;
     string path;
+    // scale (xy) and offset (zw) of the UVs, for a texture packed into an atlas
+    glm::vec4 uvTransform = glm::vec4(1.0f, 1.0f, 0.0f, 0.0f);
 };
 
 class Mesh {
@@ -47,62 +61,182 @@ public:
     vector<unsigned int> indices;
     vector<Texture>      textures;
     unsigned int VAO;
+    // bounding sphere in model space, for culling
+    glm::vec3 boundsCenter = glm::vec3(0.0f);
+    float boundsRadius = 0.0f;
+    // UV units per model-space unit, averaged over the triangles, for picking texture mips
+    float uvDensity = 0.0f;
+    // LOD 0 is indices, the coarser levels follow it in the same index buffer
+    vector<MeshLod> lods;
+    // clusters of the full-detail level, consecutive ranges of indices
+    vector<Meshlet> meshlets;
+    // index into the model's MaterialTable, which took over the textures; -1 before it is built
+    int material = -1;
 
-    // constructor
-    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+    // constructor; lodIndices are optional coarser versions of indices over the same vertices
+    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures,
+        const vector<vector<unsigned int>>& lodIndices = vector<vector<unsigned int>>())
     {
         this->vertices = vertices;
         this->indices = indices;
         this->textures = textures;
+        computeBounds();
+        computeUvDensity();
+        vector<glm::vec3> positions(vertices.size());
+        for (size_t i = 0; i < vertices.size(); i++)
+            positions[i] = vertices[i].Position;
+        meshlets = MeshOptimizer::buildMeshlets(indices, positions);
 
         // now that we have all the required data, set the vertex buffers and its attribute pointers.
-        setupMesh();
+        setupMesh(lodIndices);
     }
 
-    // render the mesh
-    void Draw(Shader& shader)
+    // level used by Draw and DrawDepthOnly, clamped to the levels the mesh has
+    void setLod(int level)
+    {
+        lod = std::max(0, std::min(level, static_cast<int>(lods.size()) - 1));
+    }
+    const MeshLod& currentLod() const { return lods[lod]; }
+    int getLod() const { return lod; }
+
+    // keeps the meshlets that are inside frustum and not facing away from cameraPosition, both in
+    // world space, for DrawVisibleMeshlets; returns the number of triangles kept. The cones assume
+    // modelMatrix scales uniformly.
+    unsigned int cullMeshlets(const glm::mat4& modelMatrix, const Frustum& frustum, const glm::vec3& cameraPosition)
     {
-        // bind appropriate textures
-        unsigned int diffuseNr = 1;
-        unsigned int specularNr = 1;
-        unsigned int normalNr = 1;
-        unsigned int heightNr = 1;
-        for (unsigned int i = 0; i < textures.size(); i++)
+        float scale = std::max(glm::length(glm::vec3(modelMatrix[0])),
+            std::max(glm::length(glm::vec3(modelMatrix[1])), glm::length(glm::vec3(modelMatrix[2]))));
+        glm::mat3 rotation = glm::mat3(modelMatrix);
+        unsigned int triangles = 0;
+        unsigned int runEnd = ~0u;
+        visibleCounts.clear();
+        visibleOffsets.clear();
+        for (const Meshlet& meshlet : meshlets)
         {
-            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
-            // retrieve texture number (the N in diffuse_textureN)
-            string number;
-            string name = textures[i].type;
-            if (name == "texture_diffuse")
-                number = std::to_string(diffuseNr++);
-            else if (name == "texture_specular")
-                number = std::to_string(specularNr++); // transfer unsigned int to string
-            else if (name == "texture_normal")
-                number = std::to_string(normalNr++); // transfer unsigned int to string
-            else if (name == "texture_height")
-                number = std::to_string(heightNr++); // transfer unsigned int to string
-
-            // now set the sampler to the correct texture unit
-            glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
-            // and finally bind the texture
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+            if (!frustum.intersectsSphere(glm::vec3(modelMatrix * glm::vec4(meshlet.center, 1.0f)), meshlet.radius * scale))
+                continue;
+            if (meshlet.coneCutoff < 1.0f)
+            {
+                glm::vec3 apex = glm::vec3(modelMatrix * glm::vec4(meshlet.coneApex, 1.0f));
+                glm::vec3 axis = glm::normalize(rotation * meshlet.coneAxis);
+                if (glm::dot(glm::normalize(apex - cameraPosition), axis) >= meshlet.coneCutoff)
+                    continue;
+            }
+            // neighbouring meshlets are neighbouring index ranges: extend the current draw
+            if (meshlet.firstIndex == runEnd)
+                visibleCounts.back() += meshlet.indexCount;
+            else
+            {
+                visibleCounts.push_back(meshlet.indexCount);
+                visibleOffsets.push_back((const void*)(meshlet.firstIndex * indexSize));
+            }
+            runEnd = meshlet.firstIndex + meshlet.indexCount;
+            triangles += meshlet.indexCount / 3;
         }
+        return triangles;
+    }
+
+    // render the meshlets the last cullMeshlets kept, at full detail
+    void DrawVisibleMeshlets(Shader& shader)
+    {
+        if (visibleCounts.empty())
+            return;
+        setMaterial(shader);
+        glBindVertexArray(VAO);
+        glMultiDrawElements(GL_TRIANGLES, visibleCounts.data(), indexType, visibleOffsets.data(), static_cast<GLsizei>(visibleCounts.size()));
+        glBindVertexArray(0);
+    }
+
+    // render the mesh
+    void Draw(Shader& shader)
+    {
+        setMaterial(shader);
 
         // draw mesh
         glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
+        glDrawElements(GL_TRIANGLES, lods[lod].indexCount, indexType, (void*)(lods[lod].firstIndex * indexSize));
+        glBindVertexArray(0);
+    }
+
+    // render the mesh with the DrawElementsIndirectCommand at offset command of the bound
+    // GL_DRAW_INDIRECT_BUFFER (GL 4.0), e.g. one written by the occlusion culler
+    void DrawIndirect(Shader& shader, const void* command)
+    {
+        setMaterial(shader);
+        glBindVertexArray(VAO);
+        glDrawElementsIndirect(GL_TRIANGLES, indexType, command);
         glBindVertexArray(0);
+    }
 
-        // always good practice to set everything back to defaults once configured.
-        glActiveTexture(GL_TEXTURE0);
+    // render positions only, for depth-only passes (depth pre-pass, shadow maps)
+    void DrawDepthOnly()
+    {
+        glBindVertexArray(depthVAO);
+        glDrawElements(GL_TRIANGLES, lods[lod].indexCount, indexType, (void*)(lods[lod].firstIndex * indexSize));
+        glBindVertexArray(0);
     }
 
 private:
     // render data 
     unsigned int VBO, EBO;
+    unsigned int depthVAO, depthVBO; // tightly packed positions sharing EBO
+    int lod = 0;
+    GLenum indexType = GL_UNSIGNED_INT; // GL_UNSIGNED_SHORT when the vertices allow it
+    size_t indexSize = sizeof(unsigned int);
+    // index ranges kept by cullMeshlets
+    vector<GLsizei> visibleCounts;
+    vector<const void*> visibleOffsets;
+
+    // location of materialIndex in the program it was looked up in
+    unsigned int materialProgram = 0;
+    GLint materialLocation = -1;
+
+    // the textures themselves are bound once per pass by the MaterialTable; a draw only says
+    // which material it uses
+    void setMaterial(Shader& shader)
+    {
+        if (shader.ID != materialProgram)
+        {
+            materialProgram = shader.ID;
+            materialLocation = glGetUniformLocation(shader.ID, "materialIndex");
+        }
+        glUniform1i(materialLocation, std::max(material, 0));
+    }
+
+    // centre of the bounding box, radius to the farthest vertex
+    void computeBounds()
+    {
+        if (vertices.empty())
+            return;
+        glm::vec3 minimum = vertices[0].Position, maximum = vertices[0].Position;
+        for (const Vertex& vertex : vertices)
+        {
+            minimum = glm::min(minimum, vertex.Position);
+            maximum = glm::max(maximum, vertex.Position);
+        }
+        boundsCenter = 0.5f * (minimum + maximum);
+        for (const Vertex& vertex : vertices)
+            boundsRadius = std::max(boundsRadius, glm::length(vertex.Position - boundsCenter));
+    }
+
+    // square root of the ratio of total UV area to total surface area
+    void computeUvDensity()
+    {
+        double uvArea = 0.0, area = 0.0;
+        for (size_t i = 0; i + 2 < indices.size(); i += 3)
+        {
+            const Vertex& a = vertices[indices[i]];
+            const Vertex& b = vertices[indices[i + 1]];
+            const Vertex& c = vertices[indices[i + 2]];
+            glm::vec2 uvEdge1 = b.TexCoords - a.TexCoords, uvEdge2 = c.TexCoords - a.TexCoords;
+            uvArea += 0.5 * std::abs(uvEdge1.x * uvEdge2.y - uvEdge1.y * uvEdge2.x);
+            area += 0.5 * glm::length(glm::cross(b.Position - a.Position, c.Position - a.Position));
+        }
+        uvDensity = area > 0.0 ? static_cast<float>(std::sqrt(uvArea / area)) : 0.0f;
+    }
 
     // initializes all the buffer objects/arrays
-    void setupMesh()
+    void setupMesh(const vector<vector<unsigned int>>& lodIndices)
     {
         // create buffers/arrays
         glGenVertexArrays(1, &VAO);
@@ -118,7 +252,25 @@ private:
         glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
 
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+        // every level of detail, one after the other
+        vector<unsigned int> allIndices = indices;
+        MeshLod fullDetail = { 0, static_cast<unsigned int>(indices.size()) };
+        lods.push_back(fullDetail);
+        for (const vector<unsigned int>& level : lodIndices)
+        {
+            MeshLod range = { static_cast<unsigned int>(allIndices.size()), static_cast<unsigned int>(level.size()) };
+            lods.push_back(range);
+            allIndices.insert(allIndices.end(), level.begin(), level.end());
+        }
+        if (vertices.size() <= MAX_SHORT_INDEX_VERTICES)
+        {
+            vector<unsigned short> shortIndices(allIndices.begin(), allIndices.end());
+            indexType = GL_UNSIGNED_SHORT;
+            indexSize = sizeof(unsigned short);
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, shortIndices.size() * sizeof(unsigned short), &shortIndices[0], GL_STATIC_DRAW);
+        }
+        else
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, allIndices.size() * sizeof(unsigned int), &allIndices[0], GL_STATIC_DRAW);
 
         // set the vertex attribute pointers
         // vertex Positions
@@ -144,6 +296,20 @@ private:
         glEnableVertexAttribArray(6);
         glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, m_Weights));
         glBindVertexArray(0);
+
+        // position-only stream: depth-only passes fetch 12 bytes per vertex instead of the whole Vertex
+        vector<glm::vec3> positions(vertices.size());
+        for (size_t i = 0; i < vertices.size(); i++)
+            positions[i] = vertices[i].Position;
+        glGenVertexArrays(1, &depthVAO);
+        glGenBuffers(1, &depthVBO);
+        glBindVertexArray(depthVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, depthVBO);
+        glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(glm::vec3), &positions[0], GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+        glBindVertexArray(0);
     }
 };
 #endif
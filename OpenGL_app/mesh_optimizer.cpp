@@ -0,0 +1,307 @@
+#include "mesh_optimizer.h"
+#include <algorithm>
+#include <cmath>
+
+// FIFO cache simulation: a vertex is resident while fewer than cacheSize misses happened after
+// its own. Timestamps start at 0 and time at cacheSize + 1, so every vertex starts out missing.
+class FifoCache {
+public:
+    FifoCache(size_t vertexCount, int cacheSize) : timestamps(vertexCount, 0), time(cacheSize + 1), cacheSize(cacheSize) {}
+
+    bool contains(unsigned int vertex) const { return time - timestamps[vertex] <= (unsigned int)cacheSize; }
+    // returns 1 on a miss
+    int access(unsigned int vertex) {
+        if (contains(vertex))
+            return 0;
+        timestamps[vertex] = time++;
+        return 1;
+    }
+    void clear() {
+        time += cacheSize + 1;
+    }
+    // how many misses ago the vertex entered the cache
+    unsigned int age(unsigned int vertex) const { return time - timestamps[vertex]; }
+
+private:
+    std::vector<unsigned int> timestamps;
+    unsigned int time;
+    int cacheSize;
+};
+
+float MeshOptimizer::acmr(const std::vector<unsigned int>& indices, size_t vertexCount, int cacheSize) {
+    if (indices.size() < 3)
+        return 0.0f;
+    FifoCache cache(vertexCount, cacheSize);
+    size_t misses = 0;
+    for (unsigned int index : indices)
+        misses += cache.access(index);
+    return float(misses) / float(indices.size() / 3);
+}
+
+std::vector<unsigned int> MeshOptimizer::optimizeVertexCache(const std::vector<unsigned int>& indices, size_t vertexCount,
+    int cacheSize, std::vector<unsigned int>* clusters) {
+    const size_t triangleCount = indices.size() / 3;
+    std::vector<unsigned int> result;
+    result.reserve(triangleCount * 3);
+    if (clusters)
+        clusters->clear();
+    if (triangleCount == 0)
+        return result;
+
+    // vertex -> triangles, as offsets into one array
+    std::vector<unsigned int> liveCount(vertexCount, 0);
+    for (size_t i = 0; i < triangleCount * 3; i++)
+        liveCount[indices[i]]++;
+    std::vector<unsigned int> firstTriangle(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; v++)
+        firstTriangle[v + 1] = firstTriangle[v] + liveCount[v];
+    std::vector<unsigned int> adjacency(triangleCount * 3);
+    std::vector<unsigned int> filled(firstTriangle.begin(), firstTriangle.end() - 1);
+    for (size_t i = 0; i < triangleCount * 3; i++)
+        adjacency[filled[indices[i]]++] = static_cast<unsigned int>(i / 3);
+
+    FifoCache cache(vertexCount, cacheSize);
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<unsigned int> deadEnds;    // recently used vertices, to restart from
+    std::vector<unsigned int> candidates;  // vertices of the triangles just emitted
+    unsigned int cursor = 0;               // next vertex to try once the dead-end stack is empty
+    int fan = 0;
+    bool restarted = true;
+
+    while (fan >= 0) {
+        unsigned int emittedSoFar = static_cast<unsigned int>(result.size() / 3);
+        if (restarted && clusters && (clusters->empty() || clusters->back() != emittedSoFar))
+            clusters->push_back(emittedSoFar);
+
+        // emit every remaining triangle around the fanning vertex
+        candidates.clear();
+        for (unsigned int a = firstTriangle[fan]; a < firstTriangle[fan + 1]; a++) {
+            unsigned int triangle = adjacency[a];
+            if (emitted[triangle])
+                continue;
+            emitted[triangle] = true;
+            for (int corner = 0; corner < 3; corner++) {
+                unsigned int vertex = indices[triangle * 3 + corner];
+                result.push_back(vertex);
+                deadEnds.push_back(vertex);
+                candidates.push_back(vertex);
+                liveCount[vertex]--;
+                cache.access(vertex);
+            }
+        }
+
+        // next fan: the candidate that stays in the cache the longest once its remaining
+        // triangles are emitted, favouring older vertices that are about to be evicted
+        int best = -1;
+        int bestPriority = -1;
+        for (unsigned int vertex : candidates) {
+            if (liveCount[vertex] == 0)
+                continue;
+            int priority = 0;
+            if (cache.age(vertex) + 2 * liveCount[vertex] <= (unsigned int)cacheSize)
+                priority = static_cast<int>(cache.age(vertex));
+            if (priority > bestPriority) {
+                bestPriority = priority;
+                best = static_cast<int>(vertex);
+            }
+        }
+        restarted = false;
+        if (best < 0) {
+            // dead end: back up through recently used vertices, then scan for any live vertex
+            restarted = true;
+            while (!deadEnds.empty() && best < 0) {
+                unsigned int vertex = deadEnds.back();
+                deadEnds.pop_back();
+                if (liveCount[vertex] > 0)
+                    best = static_cast<int>(vertex);
+            }
+            while (best < 0 && cursor < vertexCount) {
+                if (liveCount[cursor] > 0)
+                    best = static_cast<int>(cursor);
+                cursor++;
+            }
+        }
+        fan = best;
+    }
+    return result;
+}
+
+std::vector<unsigned int> MeshOptimizer::optimizeOverdraw(const std::vector<unsigned int>& indices, const std::vector<glm::vec3>& positions,
+    const std::vector<unsigned int>& clusters, float threshold, int cacheSize) {
+    const size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0 || clusters.empty())
+        return indices;
+
+    // split every cluster where the cache has warmed up enough: once a run of triangles reaches
+    // threshold times the ACMR of its whole cluster, cutting there costs little cache efficiency
+    std::vector<unsigned int> boundaries;
+    FifoCache cache(positions.size(), cacheSize);
+    for (size_t c = 0; c < clusters.size(); c++) {
+        size_t begin = clusters[c];
+        size_t end = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+
+        cache.clear();
+        size_t clusterMisses = 0;
+        for (size_t i = begin * 3; i < end * 3; i++)
+            clusterMisses += cache.access(indices[i]);
+        float targetAcmr = threshold * float(clusterMisses) / float(end - begin);
+
+        cache.clear();
+        boundaries.push_back(static_cast<unsigned int>(begin));
+        size_t start = begin, misses = 0;
+        for (size_t t = begin; t < end; t++) {
+            for (int corner = 0; corner < 3; corner++)
+                misses += cache.access(indices[t * 3 + corner]);
+            if (t + 1 < end && float(misses) <= targetAcmr * float(t + 1 - start)) {
+                boundaries.push_back(static_cast<unsigned int>(t + 1));
+                start = t + 1;
+                misses = 0;
+                cache.clear();
+            }
+        }
+    }
+
+    // area-weighted centroid of the mesh and of every cluster, and the average cluster normal
+    struct Cluster {
+        unsigned int begin, end;
+        float sortKey;
+    };
+    std::vector<glm::vec3> clusterCentroids(boundaries.size(), glm::vec3(0.0f));
+    std::vector<glm::vec3> clusterNormals(boundaries.size(), glm::vec3(0.0f));
+    std::vector<float> clusterAreas(boundaries.size(), 0.0f);
+    glm::vec3 meshCentroid(0.0f);
+    float meshArea = 0.0f;
+    for (size_t c = 0; c < boundaries.size(); c++) {
+        size_t end = c + 1 < boundaries.size() ? boundaries[c + 1] : triangleCount;
+        for (size_t t = boundaries[c]; t < end; t++) {
+            const glm::vec3& a = positions[indices[t * 3]];
+            const glm::vec3& b = positions[indices[t * 3 + 1]];
+            const glm::vec3& d = positions[indices[t * 3 + 2]];
+            glm::vec3 normal = glm::cross(b - a, d - a); // length is twice the area
+            float area = glm::length(normal);
+            glm::vec3 centroid = (a + b + d) / 3.0f;
+            clusterCentroids[c] += centroid * area;
+            clusterNormals[c] += normal;
+            clusterAreas[c] += area;
+            meshCentroid += centroid * area;
+            meshArea += area;
+        }
+    }
+    if (meshArea > 0.0f)
+        meshCentroid /= meshArea;
+
+    std::vector<Cluster> sorted(boundaries.size());
+    for (size_t c = 0; c < boundaries.size(); c++) {
+        glm::vec3 centroid = clusterAreas[c] > 0.0f ? clusterCentroids[c] / clusterAreas[c] : meshCentroid;
+        float normalLength = glm::length(clusterNormals[c]);
+        glm::vec3 normal = normalLength > 0.0f ? clusterNormals[c] / normalLength : glm::vec3(0.0f);
+        sorted[c].begin = boundaries[c];
+        sorted[c].end = static_cast<unsigned int>(c + 1 < boundaries.size() ? boundaries[c + 1] : triangleCount);
+        sorted[c].sortKey = glm::dot(centroid - meshCentroid, normal);
+    }
+    // clusters on the outside, facing away from the centre, first
+    std::stable_sort(sorted.begin(), sorted.end(), [](const Cluster& a, const Cluster& b) { return a.sortKey > b.sortKey; });
+
+    std::vector<unsigned int> result;
+    result.reserve(indices.size());
+    for (const Cluster& cluster : sorted)
+        result.insert(result.end(), indices.begin() + cluster.begin * 3, indices.begin() + cluster.end * 3);
+    return result;
+}
+
+std::vector<unsigned int> MeshOptimizer::optimizeVertexFetch(std::vector<unsigned int>& indices, size_t vertexCount) {
+    const unsigned int UNUSED = ~0u;
+    std::vector<unsigned int> remap(vertexCount, UNUSED);
+    unsigned int next = 0;
+    for (unsigned int& index : indices) {
+        if (remap[index] == UNUSED)
+            remap[index] = next++;
+        index = remap[index];
+    }
+    for (unsigned int& target : remap) {
+        if (target == UNUSED)
+            target = next++;
+    }
+    return remap;
+}
+
+// bounding sphere and normal cone of triangles [begin, end)
+static void computeMeshletBounds(Meshlet& meshlet, const std::vector<unsigned int>& indices, const std::vector<glm::vec3>& positions) {
+    const unsigned int begin = meshlet.firstIndex, end = meshlet.firstIndex + meshlet.indexCount;
+
+    glm::vec3 boxMin(1e30f), boxMax(-1e30f);
+    for (unsigned int i = begin; i < end; i++) {
+        boxMin = glm::min(boxMin, positions[indices[i]]);
+        boxMax = glm::max(boxMax, positions[indices[i]]);
+    }
+    meshlet.center = (boxMin + boxMax) * 0.5f;
+    meshlet.radius = 0.0f;
+    for (unsigned int i = begin; i < end; i++)
+        meshlet.radius = std::max(meshlet.radius, glm::length(positions[indices[i]] - meshlet.center));
+
+    // axis: average of the triangle normals; the cone has to hold the one furthest from it
+    std::vector<glm::vec3> normals;
+    glm::vec3 axis(0.0f);
+    for (unsigned int i = begin; i + 2 < end; i += 3) {
+        const glm::vec3& a = positions[indices[i]];
+        glm::vec3 normal = glm::cross(positions[indices[i + 1]] - a, positions[indices[i + 2]] - a);
+        float length = glm::length(normal);
+        normals.push_back(length > 0.0f ? normal / length : glm::vec3(0.0f));
+        axis += normals.back();
+    }
+    meshlet.coneAxis = glm::length(axis) > 0.0f ? glm::normalize(axis) : glm::vec3(0.0f, 0.0f, 1.0f);
+    meshlet.coneApex = meshlet.center;
+    meshlet.coneCutoff = 1.0f;
+
+    float minDot = 1.0f;
+    for (const glm::vec3& normal : normals)
+        minDot = std::min(minDot, glm::dot(normal, meshlet.coneAxis));
+    // wider than about 84 degrees around the axis: the cone would almost never cull
+    if (minDot <= 0.1f)
+        return;
+
+    // move the apex back along the axis until every triangle's plane is in front of it, so a
+    // viewer inside the cone is behind all of them
+    float maxT = 0.0f;
+    for (size_t t = 0; t < normals.size(); t++) {
+        float denominator = glm::dot(meshlet.coneAxis, normals[t]);
+        if (denominator <= 0.0f)
+            continue;
+        float distance = glm::dot(meshlet.center - positions[indices[begin + t * 3]], normals[t]);
+        maxT = std::max(maxT, distance / denominator);
+    }
+    meshlet.coneApex = meshlet.center - meshlet.coneAxis * maxT;
+    meshlet.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+}
+
+std::vector<Meshlet> MeshOptimizer::buildMeshlets(const std::vector<unsigned int>& indices, const std::vector<glm::vec3>& positions) {
+    std::vector<Meshlet> meshlets;
+    // meshlet a vertex was last counted in, plus one
+    std::vector<unsigned int> lastMeshlet(positions.size(), 0);
+    int vertexCount = 0;
+
+    for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+        const unsigned int current = static_cast<unsigned int>(meshlets.size());
+        int added = 0;
+        for (int corner = 0; corner < 3; corner++)
+            added += lastMeshlet[indices[t + corner]] != current ? 1 : 0;
+        if (meshlets.empty() || vertexCount + added > MAX_MESHLET_VERTICES || meshlets.back().indexCount == 3u * MAX_MESHLET_TRIANGLES) {
+            Meshlet meshlet = Meshlet();
+            meshlet.firstIndex = static_cast<unsigned int>(t);
+            meshlets.push_back(meshlet);
+            vertexCount = 0;
+        }
+        const unsigned int stamp = static_cast<unsigned int>(meshlets.size());
+        for (int corner = 0; corner < 3; corner++) {
+            if (lastMeshlet[indices[t + corner]] != stamp) {
+                lastMeshlet[indices[t + corner]] = stamp;
+                vertexCount++;
+            }
+        }
+        meshlets.back().indexCount += 3;
+    }
+
+    for (Meshlet& meshlet : meshlets)
+        computeMeshletBounds(meshlet, indices, positions);
+    return meshlets;
+}
@@ -0,0 +1,60 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <glm/glm.hpp>
+#include <vector>
+
+// a run of at most MAX_MESHLET_TRIANGLES consecutive triangles using at most MAX_MESHLET_VERTICES vertices
+struct Meshlet {
+    unsigned int firstIndex;
+    unsigned int indexCount;
+    glm::vec3 center;   // bounding sphere, model space
+    float radius;
+    // every triangle faces away from a viewer at v when dot(normalize(coneApex - v), coneAxis) >= coneCutoff;
+    // coneCutoff is 1 (never culled) when the normals spread too far
+    glm::vec3 coneApex;
+    glm::vec3 coneAxis;
+    float coneCutoff;
+};
+
+// Import-time reordering of indexed triangle lists for the GPU:
+//
+// - vertex cache: triangles are reordered with Tipsify (Sander, Nehab & Barczak 2007) so that
+//   the vertices they use are still in the post-transform cache;
+// - overdraw: the triangles are then cut into clusters at the points where the cache order
+//   allows it, and clusters facing away from the mesh centre are drawn first, so the outside of
+//   the mesh tends to occlude its inside;
+// - vertex fetch: vertices are renumbered in the order the triangles first use them;
+// - meshlets: the final triangle order is cut into small clusters with a bounding sphere and a
+//   normal cone, so whole clusters can be culled when off screen or facing away.
+//
+// The cache is modelled as a FIFO of cacheSize vertices; ACMR (average cache miss ratio) is the
+// number of vertices transformed per triangle, 0.5 at best for a regular grid and 3 at worst.
+class MeshOptimizer {
+public:
+    static const int DEFAULT_CACHE_SIZE = 16;
+
+    // vertices transformed per triangle when indices are drawn in order
+    static float acmr(const std::vector<unsigned int>& indices, size_t vertexCount, int cacheSize = DEFAULT_CACHE_SIZE);
+
+    // reorders triangles for the vertex cache; clusters, if given, receives the first triangle of
+    // every run that starts at a dead end (where the cache is as good as cold)
+    static std::vector<unsigned int> optimizeVertexCache(const std::vector<unsigned int>& indices, size_t vertexCount,
+        int cacheSize = DEFAULT_CACHE_SIZE, std::vector<unsigned int>* clusters = nullptr);
+
+    // reorders the clusters of a cache-optimized list to reduce overdraw. Clusters are split
+    // further as long as each part stays within threshold times the cluster's ACMR.
+    static std::vector<unsigned int> optimizeOverdraw(const std::vector<unsigned int>& indices, const std::vector<glm::vec3>& positions,
+        const std::vector<unsigned int>& clusters, float threshold = 1.05f, int cacheSize = DEFAULT_CACHE_SIZE);
+
+    // renumbers vertices in first-use order, rewriting indices; returns old vertex -> new vertex.
+    // Vertices no index uses are moved to the end.
+    static std::vector<unsigned int> optimizeVertexFetch(std::vector<unsigned int>& indices, size_t vertexCount);
+
+    static const int MAX_MESHLET_VERTICES = 64;
+    static const int MAX_MESHLET_TRIANGLES = 124;
+    // cuts indices, in their current order, into meshlets of consecutive triangles
+    static std::vector<Meshlet> buildMeshlets(const std::vector<unsigned int>& indices, const std::vector<glm::vec3>& positions);
+};
+
+#endif
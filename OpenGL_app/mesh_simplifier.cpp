@@ -0,0 +1,286 @@
+#include "mesh_simplifier.h"
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <map>
+#include <utility>
+
+// border planes weigh this much more than surface planes, so open edges stay put
+static const double BORDER_WEIGHT = 10.0;
+
+void MeshSimplifier::Quadric::addPlane(const glm::dvec3& n, double d, double weight) {
+    m[0] += weight * n.x * n.x; m[1] += weight * n.x * n.y; m[2] += weight * n.x * n.z; m[3] += weight * n.x * d;
+    m[4] += weight * n.y * n.y; m[5] += weight * n.y * n.z; m[6] += weight * n.y * d;
+    m[7] += weight * n.z * n.z; m[8] += weight * n.z * d;
+    m[9] += weight * d * d;
+}
+
+void MeshSimplifier::Quadric::add(const Quadric& other) {
+    for (int i = 0; i < 10; i++)
+        m[i] += other.m[i];
+}
+
+double MeshSimplifier::Quadric::evaluate(const glm::dvec3& p) const {
+    // sum of squared distances to the planes: p^T Q p with p = (x, y, z, 1)
+    return m[0] * p.x * p.x + 2.0 * m[1] * p.x * p.y + 2.0 * m[2] * p.x * p.z + 2.0 * m[3] * p.x
+        + m[4] * p.y * p.y + 2.0 * m[5] * p.y * p.z + 2.0 * m[6] * p.y
+        + m[7] * p.z * p.z + 2.0 * m[8] * p.z
+        + m[9];
+}
+
+MeshSimplifier::MeshSimplifier(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices) {
+    // weld vertices at identical positions
+    std::map<std::pair<std::pair<float, float>, float>, unsigned int> byPosition;
+    welded.resize(positions.size());
+    for (size_t i = 0; i < positions.size(); i++) {
+        std::pair<std::pair<float, float>, float> key(std::make_pair(positions[i].x, positions[i].y), positions[i].z);
+        std::map<std::pair<std::pair<float, float>, float>, unsigned int>::iterator it = byPosition.find(key);
+        if (it == byPosition.end()) {
+            unsigned int id = static_cast<unsigned int>(weldedPositions.size());
+            byPosition[key] = id;
+            weldedPositions.push_back(glm::dvec3(positions[i]));
+            welded[i] = id;
+        }
+        else {
+            welded[i] = it->second;
+        }
+    }
+    size_t weldedCount = weldedPositions.size();
+    quadrics.resize(weldedCount);
+    versions.assign(weldedCount, 0);
+    weldedAlive.assign(weldedCount, true);
+    vertexTriangles.resize(weldedCount);
+
+    // face planes, and triangle counts per welded edge to find the open borders
+    corners = indices;
+    corners.resize(indices.size() - indices.size() % 3);
+    size_t triangleCount = corners.size() / 3;
+    triangleAlive.assign(triangleCount, true);
+    liveTriangles = triangleCount;
+    std::map<std::pair<unsigned int, unsigned int>, int> edgeUse;
+    for (size_t t = 0; t < triangleCount; t++) {
+        unsigned int w[3] = { welded[corners[t * 3]], welded[corners[t * 3 + 1]], welded[corners[t * 3 + 2]] };
+        glm::dvec3 normal = glm::cross(weldedPositions[w[1]] - weldedPositions[w[0]], weldedPositions[w[2]] - weldedPositions[w[0]]);
+        double length = glm::length(normal);
+        if (length > 0.0) {
+            normal /= length;
+            Quadric plane;
+            plane.addPlane(normal, -glm::dot(normal, weldedPositions[w[0]]), 1.0);
+            for (int c = 0; c < 3; c++)
+                quadrics[w[c]].add(plane);
+        }
+        for (int c = 0; c < 3; c++) {
+            vertexTriangles[w[c]].push_back(static_cast<unsigned int>(t));
+            unsigned int a = w[c], b = w[(c + 1) % 3];
+            if (a != b)
+                edgeUse[std::make_pair(std::min(a, b), std::max(a, b))]++;
+        }
+    }
+    for (size_t t = 0; t < triangleCount; t++) {
+        unsigned int w[3] = { welded[corners[t * 3]], welded[corners[t * 3 + 1]], welded[corners[t * 3 + 2]] };
+        glm::dvec3 faceNormal = glm::cross(weldedPositions[w[1]] - weldedPositions[w[0]], weldedPositions[w[2]] - weldedPositions[w[0]]);
+        if (glm::length(faceNormal) == 0.0)
+            continue;
+        faceNormal = glm::normalize(faceNormal);
+        for (int c = 0; c < 3; c++) {
+            unsigned int a = w[c], b = w[(c + 1) % 3];
+            if (a == b || edgeUse[std::make_pair(std::min(a, b), std::max(a, b))] != 1)
+                continue;
+            // plane through the border edge, perpendicular to the face
+            glm::dvec3 edge = weldedPositions[b] - weldedPositions[a];
+            glm::dvec3 normal = glm::cross(edge, faceNormal);
+            if (glm::length(normal) == 0.0)
+                continue;
+            normal = glm::normalize(normal);
+            Quadric plane;
+            plane.addPlane(normal, -glm::dot(normal, weldedPositions[a]), BORDER_WEIGHT);
+            quadrics[a].add(plane);
+            quadrics[b].add(plane);
+        }
+    }
+
+    for (unsigned int v = 0; v < weldedCount; v++)
+        pushCandidates(v);
+}
+
+double MeshSimplifier::collapseCost(unsigned int from, unsigned int to) const {
+    Quadric sum = quadrics[from];
+    sum.add(quadrics[to]);
+    return std::max(sum.evaluate(weldedPositions[to]), 0.0);
+}
+
+void MeshSimplifier::pushCandidates(unsigned int vertex) {
+    // every live edge around the vertex, in both directions
+    std::vector<unsigned int> neighbours;
+    for (unsigned int t : vertexTriangles[vertex]) {
+        if (!triangleAlive[t])
+            continue;
+        for (int c = 0; c < 3; c++) {
+            unsigned int w = welded[corners[t * 3 + c]];
+            if (w != vertex && std::find(neighbours.begin(), neighbours.end(), w) == neighbours.end())
+                neighbours.push_back(w);
+        }
+    }
+    for (unsigned int neighbour : neighbours) {
+        Candidate out = { collapseCost(vertex, neighbour), vertex, neighbour, versions[vertex], versions[neighbour] };
+        Candidate in = { collapseCost(neighbour, vertex), neighbour, vertex, versions[neighbour], versions[vertex] };
+        candidates.push(out);
+        candidates.push(in);
+    }
+}
+
+glm::dvec3 MeshSimplifier::cornerPosition(unsigned int triangle, int corner, unsigned int moved, const glm::dvec3& target) const {
+    unsigned int w = welded[corners[triangle * 3 + corner]];
+    return w == moved ? target : weldedPositions[w];
+}
+
+bool MeshSimplifier::tryCollapse(unsigned int from, unsigned int to) {
+    std::vector<unsigned int> around;  // live triangles of from
+    std::vector<unsigned int> shared;  // those that also contain to, they disappear
+    for (unsigned int t : vertexTriangles[from]) {
+        if (!triangleAlive[t])
+            continue;
+        around.push_back(t);
+        for (int c = 0; c < 3; c++) {
+            if (welded[corners[t * 3 + c]] == to) {
+                shared.push_back(t);
+                break;
+            }
+        }
+    }
+    if (shared.empty() || shared.size() > 2)
+        return false;
+
+    // link condition: the only common neighbours are the third corners of the shared
+    // triangles, otherwise the collapse would pinch the surface
+    std::vector<unsigned int> fromNeighbours, toNeighbours;
+    for (unsigned int t : around) {
+        for (int c = 0; c < 3; c++)
+            fromNeighbours.push_back(welded[corners[t * 3 + c]]);
+    }
+    for (unsigned int t : vertexTriangles[to]) {
+        if (!triangleAlive[t])
+            continue;
+        for (int c = 0; c < 3; c++)
+            toNeighbours.push_back(welded[corners[t * 3 + c]]);
+    }
+    std::sort(fromNeighbours.begin(), fromNeighbours.end());
+    fromNeighbours.erase(std::unique(fromNeighbours.begin(), fromNeighbours.end()), fromNeighbours.end());
+    std::sort(toNeighbours.begin(), toNeighbours.end());
+    toNeighbours.erase(std::unique(toNeighbours.begin(), toNeighbours.end()), toNeighbours.end());
+    std::vector<unsigned int> common;
+    std::set_intersection(fromNeighbours.begin(), fromNeighbours.end(), toNeighbours.begin(), toNeighbours.end(), std::back_inserter(common));
+    // common includes from and to themselves
+    if (common.size() != shared.size() + 2)
+        return false;
+
+    // every wedge (original vertex) of from needs a wedge of to it shares a triangle with,
+    // which is what it will be replaced by; otherwise the collapse would cross a seam
+    std::vector<std::pair<unsigned int, unsigned int>> wedgeMap;
+    for (unsigned int t : shared) {
+        unsigned int fromWedge = 0, toWedge = 0;
+        for (int c = 0; c < 3; c++) {
+            unsigned int v = corners[t * 3 + c];
+            if (welded[v] == from)
+                fromWedge = v;
+            else if (welded[v] == to)
+                toWedge = v;
+        }
+        bool known = false;
+        for (const std::pair<unsigned int, unsigned int>& entry : wedgeMap) {
+            if (entry.first == fromWedge) {
+                if (entry.second != toWedge)
+                    return false;
+                known = true;
+            }
+        }
+        if (!known)
+            wedgeMap.push_back(std::make_pair(fromWedge, toWedge));
+    }
+    for (unsigned int t : around) {
+        for (int c = 0; c < 3; c++) {
+            unsigned int v = corners[t * 3 + c];
+            if (welded[v] != from)
+                continue;
+            bool mapped = false;
+            for (const std::pair<unsigned int, unsigned int>& entry : wedgeMap)
+                mapped = mapped || entry.first == v;
+            if (!mapped)
+                return false;
+        }
+    }
+
+    // no remaining triangle may flip or collapse to a sliver
+    const glm::dvec3& target = weldedPositions[to];
+    for (unsigned int t : around) {
+        if (std::find(shared.begin(), shared.end(), t) != shared.end())
+            continue;
+        glm::dvec3 p0 = weldedPositions[welded[corners[t * 3]]];
+        glm::dvec3 p1 = weldedPositions[welded[corners[t * 3 + 1]]];
+        glm::dvec3 p2 = weldedPositions[welded[corners[t * 3 + 2]]];
+        glm::dvec3 before = glm::cross(p1 - p0, p2 - p0);
+        glm::dvec3 q0 = cornerPosition(t, 0, from, target);
+        glm::dvec3 q1 = cornerPosition(t, 1, from, target);
+        glm::dvec3 q2 = cornerPosition(t, 2, from, target);
+        glm::dvec3 after = glm::cross(q1 - q0, q2 - q0);
+        double afterLength = glm::length(after);
+        if (afterLength == 0.0 || glm::dot(before, after) < 0.2 * glm::length(before) * afterLength)
+            return false;
+    }
+
+    // apply
+    for (unsigned int t : shared) {
+        triangleAlive[t] = false;
+        liveTriangles--;
+    }
+    for (unsigned int t : around) {
+        if (!triangleAlive[t])
+            continue;
+        for (int c = 0; c < 3; c++) {
+            unsigned int& v = corners[t * 3 + c];
+            if (welded[v] != from)
+                continue;
+            for (const std::pair<unsigned int, unsigned int>& entry : wedgeMap) {
+                if (entry.first == v) {
+                    v = entry.second;
+                    break;
+                }
+            }
+        }
+        vertexTriangles[to].push_back(t);
+    }
+    vertexTriangles[from].clear();
+    weldedAlive[from] = false;
+    // only edges touching to changed cost; the rest are re-validated when they come up
+    quadrics[to].add(quadrics[from]);
+    versions[from]++;
+    versions[to]++;
+    pushCandidates(to);
+    return true;
+}
+
+std::vector<unsigned int> MeshSimplifier::simplify(size_t targetTriangles, float maxError) {
+    const double maxCost = (double)maxError * (double)maxError;
+    while (liveTriangles > targetTriangles && !candidates.empty()) {
+        Candidate candidate = candidates.top();
+        if (!weldedAlive[candidate.from] || !weldedAlive[candidate.to]
+            || versions[candidate.from] != candidate.fromVersion || versions[candidate.to] != candidate.toVersion) {
+            candidates.pop();
+            continue;
+        }
+        // the cheapest valid collapse is already too far off; keep it for a later call
+        if (candidate.cost > maxCost)
+            break;
+        candidates.pop();
+        if (tryCollapse(candidate.from, candidate.to))
+            error = std::max(error, (float)std::sqrt(candidate.cost));
+    }
+
+    std::vector<unsigned int> result;
+    result.reserve(liveTriangles * 3);
+    for (size_t t = 0; t < triangleAlive.size(); t++) {
+        if (triangleAlive[t])
+            result.insert(result.end(), corners.begin() + t * 3, corners.begin() + t * 3 + 3);
+    }
+    return result;
+}
@@ -0,0 +1,66 @@
+#ifndef MESH_SIMPLIFIER_H
+#define MESH_SIMPLIFIER_H
+
+#include <glm/glm.hpp>
+#include <queue>
+#include <vector>
+
+// Quadric error metric simplification (Garland & Heckbert) by half-edge collapses: a vertex
+// is merged into one of its neighbours, so every level of detail indexes the original vertex
+// buffer and all levels can share it, as ranges of one index buffer.
+//
+// Vertices with the same position are welded for the topology, which lets meshes whose
+// triangles do not share vertices (split at UV or normal seams) collapse as well. A vertex
+// on a seam only collapses along the seam, so texture coordinates never get torn. Open
+// borders are held in place by extra planes, and collapses that would flip a triangle or
+// pinch the surface are skipped.
+class MeshSimplifier {
+public:
+    MeshSimplifier(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices);
+
+    // collapses edges until at most targetTriangles remain, or until the next collapse would
+    // move the surface by more than about maxError (model units), and returns the remaining
+    // triangles. Each call continues from the previous result, so shrinking targets give
+    // nested levels of detail.
+    std::vector<unsigned int> simplify(size_t targetTriangles, float maxError);
+
+    size_t getTriangleCount() const { return liveTriangles; }
+    float getError() const { return error; } // largest collapse error so far
+
+private:
+    // symmetric 4x4 matrix, upper triangle
+    struct Quadric {
+        double m[10] = { 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 };
+        void addPlane(const glm::dvec3& normal, double d, double weight);
+        void add(const Quadric& other);
+        double evaluate(const glm::dvec3& p) const;
+    };
+
+    struct Candidate {
+        double cost;
+        unsigned int from, to;          // welded vertices
+        unsigned int fromVersion, toVersion;
+        bool operator<(const Candidate& other) const { return cost > other.cost; } // min-heap
+    };
+
+    std::vector<unsigned int> welded;        // original vertex -> welded vertex
+    std::vector<glm::dvec3> weldedPositions;
+    std::vector<Quadric> quadrics;           // per welded vertex
+    std::vector<unsigned int> versions;      // bumped whenever a welded vertex's quadric or neighbourhood changes
+    std::vector<bool> weldedAlive;
+    std::vector<std::vector<unsigned int>> vertexTriangles; // welded vertex -> triangles (some may be dead)
+
+    std::vector<unsigned int> corners;       // 3 original vertices per triangle
+    std::vector<bool> triangleAlive;
+    size_t liveTriangles = 0;
+    float error = 0.0f;
+
+    std::priority_queue<Candidate> candidates;
+
+    void pushCandidates(unsigned int vertex);
+    double collapseCost(unsigned int from, unsigned int to) const;
+    bool tryCollapse(unsigned int from, unsigned int to);
+    glm::dvec3 cornerPosition(unsigned int triangle, int corner, unsigned int moved, const glm::dvec3& target) const;
+};
+
+#endif
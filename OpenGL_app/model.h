@@ -19,11 +19,21 @@
 #include <iostream>
 #include <map>
 #include <vector>
+#include <algorithm>
 #include "mesh.h"
+#include "mesh_simplifier.h"
+#include "mesh_optimizer.h"
+#include "lod_selector.h"
 #include "stb_image.h"
+#include "texture_cache.h"
+#include "texture_streamer.h"
+#include "material_table.h"
+#include "texture_atlas.h"
+#include "texture_memory.h"
+#include "job_system.h"
 using namespace std;
 
-unsigned int TextureFromFile(const char* path, const string& directory, bool gamma = false);
+unsigned int TextureFromFile(const char* path, const string& directory, bool gamma = false, bool normalMap = false);
 
 class Model
 {
@@ -33,6 +43,12 @@ public:
     vector<Mesh>    meshes;
     string directory;
     bool gammaCorrection;
+    float boundingRadius = 0.0f; // distance of the farthest vertex from the model origin
+    LodSelector lodSelector;
+    MaterialTable materials; // bind before drawing with the textured G-buffer shader
+    // triangle-weighted ACMR sums over all meshes, for the import report
+    double acmrBefore = 0.0, acmrAfter = 0.0;
+    size_t optimizedTriangles = 0;
 
     // constructor, expects a filepath to a 3D model.
     Model(string const& path, bool gamma = false) : gammaCorrection(gamma)
@@ -47,13 +63,66 @@ public:
             meshes[i].Draw(shader);
     }
 
+    // draws the positions of all meshes only, without binding textures
+    void DrawDepthOnly()
+    {
+        for (unsigned int i = 0; i < meshes.size(); i++)
+            meshes[i].DrawDepthOnly();
+    }
+
+    // picks the level of detail of every mesh from the fraction of the viewport height the model covers
+    void selectLod(float screenSize)
+    {
+        int lodCount = 1;
+        for (unsigned int i = 0; i < meshes.size(); i++)
+            lodCount = std::max(lodCount, static_cast<int>(meshes[i].lods.size()));
+        int lod = lodSelector.select(screenSize, lodCount);
+        for (unsigned int i = 0; i < meshes.size(); i++)
+            meshes[i].setLod(lod);
+    }
+
+    // tells the texture streamer how finely the textures of every mesh inside frustum are seen,
+    // from the distance to the mesh bounds and the mesh's UV density; fovy in radians
+    void requestTextureMips(const glm::mat4& modelMatrix, const Frustum& frustum, const glm::vec3& cameraPosition,
+        float fovy, float viewportHeight, float nearPlane)
+    {
+        float scale = std::max(glm::length(glm::vec3(modelMatrix[0])),
+            std::max(glm::length(glm::vec3(modelMatrix[1])), glm::length(glm::vec3(modelMatrix[2]))));
+        float pixelsPerUnitAtOne = viewportHeight / (2.0f * std::tan(0.5f * fovy));
+        for (const Mesh& mesh : meshes)
+        {
+            glm::vec3 center = glm::vec3(modelMatrix * glm::vec4(mesh.boundsCenter, 1.0f));
+            float radius = mesh.boundsRadius * scale;
+            if (mesh.uvDensity <= 0.0f || !frustum.intersectsSphere(center, radius))
+                continue;
+            // the nearest point of the bounds sets the finest level the mesh can need
+            float distance = std::max(glm::length(center - cameraPosition) - radius, nearPlane);
+            float uvPerPixel = mesh.uvDensity * distance / (pixelsPerUnitAtOne * scale);
+            materials.requestMips(mesh.material, uvPerPixel);
+        }
+    }
+
 private:
+    // a mesh as read from the file, and the parts prepareMesh makes of it
+    struct ImportedMesh
+    {
+        vector<Vertex> vertices;
+        vector<unsigned int> indices;
+        vector<Texture> textures;
+        vector<vector<Vertex>> partVertices;
+        vector<vector<unsigned int>> partIndices;
+        vector<vector<vector<unsigned int>>> partLods;
+        double acmrBefore = 0.0, acmrAfter = 0.0;
+        size_t optimizedTriangles = 0;
+    };
+    vector<ImportedMesh> imported;
+
     // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
     void loadModel(string const& path)
     {
         // read file via ASSIMP
         Assimp::Importer importer;
-        const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+        const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_JoinIdenticalVertices | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
         // check for errors
         if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
         {
@@ -65,6 +134,30 @@ private:
 
         // process ASSIMP's root node recursively
         processNode(scene->mRootNode, scene);
+        // optimizing and simplifying take most of the import and every mesh is independent, so a
+        // job each; the GL buffers are made here afterwards, in the file's order
+        JobSystem::shared().parallelFor(0, static_cast<int>(imported.size()), 1, [this](int first, int last) {
+            for (int i = first; i < last; i++)
+                prepareMesh(imported[i]);
+        });
+        for (ImportedMesh& mesh : imported)
+        {
+            acmrBefore += mesh.acmrBefore;
+            acmrAfter += mesh.acmrAfter;
+            optimizedTriangles += mesh.optimizedTriangles;
+            for (size_t i = 0; i < mesh.partVertices.size(); i++)
+                meshes.push_back(Mesh(mesh.partVertices[i], mesh.partIndices[i], mesh.textures, mesh.partLods[i]));
+        }
+        imported.clear();
+        if (optimizedTriangles > 0)
+            cout << "Mesh optimization: " << optimizedTriangles << " triangles, ACMR " << acmrBefore / optimizedTriangles
+                << " -> " << acmrAfter / optimizedTriangles << endl;
+        packAtlases();
+        materials.build(meshes);
+
+        for (const Mesh& mesh : meshes)
+            for (const Vertex& vertex : mesh.vertices)
+                boundingRadius = std::max(boundingRadius, glm::length(vertex.Position));
     }
 
     // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
@@ -76,7 +169,7 @@ private:
             // the node object only contains indices to index the actual objects in the scene. 
             // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
             aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-            meshes.push_back(processMesh(mesh, scene));
+            processMesh(mesh, scene);
         }
         // after we've processed all of the meshes (if any) we then recursively process each of the children nodes
         for (unsigned int i = 0; i < node->mNumChildren; i++)
@@ -86,7 +179,8 @@ private:
 
     }
 
-    Mesh processMesh(aiMesh* mesh, const aiScene* scene)
+    // adds the mesh to imported, to be prepared by a job
+    void processMesh(aiMesh* mesh, const aiScene* scene)
     {
         // data to fill
         vector<Vertex> vertices;
@@ -166,8 +260,183 @@ private:
         std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
         textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
 
-        // return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures);
+        imported.push_back(ImportedMesh());
+        imported.back().vertices.swap(vertices);
+        imported.back().indices.swap(indices);
+        imported.back().textures.swap(textures);
+    }
+
+    // optimizes the mesh and builds its levels of detail, split into parts that fit 16-bit
+    // indices if it has too many vertices; touches nothing but the mesh, so it can run as a job
+    void prepareMesh(ImportedMesh& mesh)
+    {
+        optimizeMesh(mesh);
+
+        if (mesh.vertices.size() <= MAX_SHORT_INDEX_VERTICES)
+        {
+            mesh.partVertices.push_back(std::move(mesh.vertices));
+            mesh.partIndices.push_back(std::move(mesh.indices));
+        }
+        else
+        {
+            // every part still has over 20000 triangles, so the extra draw calls cost little next to
+            // halving the index buffer
+            splitForShortIndices(mesh.vertices, mesh.indices, mesh.partVertices, mesh.partIndices);
+        }
+        for (size_t i = 0; i < mesh.partVertices.size(); i++)
+            mesh.partLods.push_back(buildLods(mesh.partVertices[i], mesh.partIndices[i]));
+    }
+
+    // cuts an index list, in its current triangle order, into parts of at most MAX_SHORT_INDEX_VERTICES
+    // vertices each; a part's vertices are numbered in first-use order
+    void splitForShortIndices(const vector<Vertex>& vertices, const vector<unsigned int>& indices,
+        vector<vector<Vertex>>& partVertices, vector<vector<unsigned int>>& partIndices)
+    {
+        const unsigned int UNUSED = ~0u;
+        vector<unsigned int> local(vertices.size(), UNUSED);
+        vector<unsigned int> used; // vertices of the current part, to reset local
+        for (size_t t = 0; t + 2 < indices.size(); t += 3)
+        {
+            int added = 0;
+            for (int corner = 0; corner < 3; corner++)
+                added += local[indices[t + corner]] == UNUSED ? 1 : 0;
+            if (partVertices.empty() || partVertices.back().size() + added > MAX_SHORT_INDEX_VERTICES)
+            {
+                for (unsigned int vertex : used)
+                    local[vertex] = UNUSED;
+                used.clear();
+                partVertices.push_back(vector<Vertex>());
+                partIndices.push_back(vector<unsigned int>());
+            }
+            for (int corner = 0; corner < 3; corner++)
+            {
+                unsigned int vertex = indices[t + corner];
+                if (local[vertex] == UNUSED)
+                {
+                    local[vertex] = static_cast<unsigned int>(partVertices.back().size());
+                    partVertices.back().push_back(vertices[vertex]);
+                    used.push_back(vertex);
+                }
+                partIndices.back().push_back(local[vertex]);
+            }
+        }
+    }
+
+    // reorders triangles for the post-transform cache and for overdraw, then vertices for fetch locality
+    void optimizeMesh(ImportedMesh& mesh)
+    {
+        vector<Vertex>& vertices = mesh.vertices;
+        vector<unsigned int>& indices = mesh.indices;
+        if (indices.size() < 3)
+            return;
+        size_t triangles = indices.size() / 3;
+        mesh.acmrBefore = MeshOptimizer::acmr(indices, vertices.size()) * triangles;
+
+        vector<glm::vec3> positions(vertices.size());
+        for (size_t i = 0; i < vertices.size(); i++)
+            positions[i] = vertices[i].Position;
+        vector<unsigned int> clusters;
+        indices = MeshOptimizer::optimizeVertexCache(indices, vertices.size(), MeshOptimizer::DEFAULT_CACHE_SIZE, &clusters);
+        indices = MeshOptimizer::optimizeOverdraw(indices, positions, clusters);
+
+        vector<unsigned int> remap = MeshOptimizer::optimizeVertexFetch(indices, vertices.size());
+        vector<Vertex> reordered(vertices.size());
+        for (size_t i = 0; i < vertices.size(); i++)
+            reordered[remap[i]] = vertices[i];
+        vertices.swap(reordered);
+
+        mesh.acmrAfter = MeshOptimizer::acmr(indices, vertices.size()) * triangles;
+        mesh.optimizedTriangles = triangles;
+    }
+
+    // coarser index lists over the same vertices, each with about half the triangles of the previous one
+    vector<vector<unsigned int>> buildLods(const vector<Vertex>& vertices, const vector<unsigned int>& indices)
+    {
+        const int MAX_LODS = 4;
+        vector<vector<unsigned int>> lods;
+        if (indices.size() < 3 * 64)
+            return lods;
+
+        // identical vertices were joined on import, so the simplifier sees the real seams
+        vector<glm::vec3> positions(vertices.size());
+        glm::vec3 boxMin(1e30f), boxMax(-1e30f);
+        for (unsigned int i = 0; i < vertices.size(); i++)
+        {
+            positions[i] = vertices[i].Position;
+            boxMin = glm::min(boxMin, vertices[i].Position);
+            boxMax = glm::max(boxMax, vertices[i].Position);
+        }
+
+        // a level may move the surface by up to 5% of the mesh size
+        float maxError = 0.05f * 0.5f * glm::length(boxMax - boxMin);
+        MeshSimplifier simplifier(positions, indices);
+        size_t previous = indices.size() / 3;
+        for (int level = 1; level <= MAX_LODS; level++)
+        {
+            vector<unsigned int> lod = simplifier.simplify((indices.size() / 3) >> level, maxError);
+            // not worth a level of its own
+            if (lod.empty() || lod.size() / 3 > previous * 4 / 5)
+                break;
+            previous = lod.size() / 3;
+            lods.push_back(MeshOptimizer::optimizeVertexCache(lod, vertices.size()));
+        }
+        return lods;
+    }
+
+    // packs the small textures of meshes with UVs inside [0, 1] into atlases, and loads the rest on their own
+    void packAtlases()
+    {
+        vector<bool> unitUvs(meshes.size(), true);
+        for (size_t i = 0; i < meshes.size(); i++)
+            for (const Vertex& vertex : meshes[i].vertices)
+                if (glm::any(glm::lessThan(vertex.TexCoords, glm::vec2(-0.001f))) || glm::any(glm::greaterThan(vertex.TexCoords, glm::vec2(1.001f))))
+                {
+                    unitUvs[i] = false;
+                    break;
+                }
+
+        // by usage: colour, normal maps
+        vector<string> atlasPaths[2];
+        vector<size_t> atlasTextures[2];
+        for (size_t i = 0; i < textures_loaded.size(); i++)
+        {
+            if (textures_loaded[i].id != 0)
+                continue;
+            bool packable = true;
+            for (size_t m = 0; m < meshes.size() && packable; m++)
+                for (const Texture& texture : meshes[m].textures)
+                    if (texture.path == textures_loaded[i].path && !unitUvs[m])
+                        packable = false;
+            if (!packable)
+                continue;
+            int usage = textures_loaded[i].type == "texture_normal";
+            atlasPaths[usage].push_back(directory + '/' + textures_loaded[i].path);
+            atlasTextures[usage].push_back(i);
+        }
+        for (int usage = 0; usage < 2; usage++)
+        {
+            if (atlasPaths[usage].empty())
+                continue;
+            vector<AtlasPlacement> placements = TextureAtlas::build(atlasPaths[usage], usage ? TEXTURE_NORMAL_MAP : TEXTURE_COLOR, directory);
+            for (size_t j = 0; j < placements.size(); j++)
+            {
+                textures_loaded[atlasTextures[usage][j]].id = placements[j].texture;
+                textures_loaded[atlasTextures[usage][j]].uvTransform = placements[j].uvTransform;
+            }
+        }
+        for (Texture& texture : textures_loaded)
+            if (texture.id == 0)
+                texture.id = TextureFromFile(texture.path.c_str(), directory, false, texture.type == "texture_normal");
+
+        // the meshes hold copies
+        for (Mesh& mesh : meshes)
+            for (Texture& texture : mesh.textures)
+                for (const Texture& loaded : textures_loaded)
+                    if (loaded.path == texture.path)
+                    {
+                        texture.id = loaded.id;
+                        texture.uvTransform = loaded.uvTransform;
+                    }
     }
 
     // checks all material textures of a given type and loads the textures if they're not loaded yet.
@@ -191,9 +460,10 @@ private:
                 }
             }
             if (!skip)
-            {   // if texture hasn't been loaded already, load it
+            {   // if texture hasn't been loaded already, load it; small ones wait for packAtlases
                 Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
+                texture.id = TextureAtlas::isCandidate(this->directory + '/' + str.C_Str()) ? 0
+                    : TextureFromFile(str.C_Str(), this->directory, false, typeName == "texture_normal");
                 texture.type = typeName;
                 texture.path = str.C_Str();
                 textures.push_back(texture);
@@ -205,11 +475,16 @@ private:
 };
 
 
-unsigned int TextureFromFile(const char* path, const string& directory, bool gamma)
+unsigned int TextureFromFile(const char* path, const string& directory, bool gamma, bool normalMap)
 {
     string filename = string(path);
     filename = directory + '/' + filename;
 
+    // block-compressed copy whose finer mips stream in as the camera gets close, when the GPU supports the format
+    unsigned int cookedID = TextureStreamer::shared().load(filename, normalMap ? TEXTURE_NORMAL_MAP : TEXTURE_COLOR);
+    if (cookedID != 0)
+        return cookedID;
+
     unsigned int textureID;
     glGenTextures(1, &textureID);
 
@@ -233,6 +508,7 @@ unsigned int TextureFromFile(const char* path, const string& directory, bool gam
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        TextureMemory::shared().track(textureID, GL_TEXTURE_2D, TEXTURES_MODELS);
 
         stbi_image_free(data);
     }
@@ -0,0 +1,286 @@
+#include "occlusion_culler.h"
+#include "texture_memory.h"
+#include <algorithm>
+#include <cstddef>
+#include <iostream>
+
+// per-object input of occlusion_test.vs
+struct GpuObject {
+    float sphere[4];
+    GLuint drawRange[4]; // index count, first index, base vertex, unused
+};
+
+// uint offsets inside a command record
+static const size_t HISTORY_COMMAND = 5;
+static const size_t FIRST_PASS_FLAG = 10;
+
+std::vector<std::string> OcclusionCuller::feedbackVaryings() {
+    std::vector<std::string> varyings;
+    varyings.push_back("cullCommand");
+    varyings.push_back("cullBaseInstance");
+    varyings.push_back("historyCommand");
+    varyings.push_back("historyBaseInstance");
+    varyings.push_back("drawnInFirstPass");
+    return varyings;
+}
+
+OcclusionCuller::OcclusionCuller(int width, int height) : width(width), height(height) {
+    levels = 1;
+    while ((std::max(width, height) >> levels) > 0)
+        levels++;
+
+    // single-channel float pyramid; every level is only read with texelFetch
+    glGenTextures(1, &pyramid);
+    glBindTexture(GL_TEXTURE_2D, pyramid);
+    for (int level = 0; level < levels; level++) {
+        glTexImage2D(GL_TEXTURE_2D, level, GL_R32F, std::max(width >> level, 1), std::max(height >> level, 1),
+            0, GL_RED, GL_FLOAT, NULL);
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    TextureMemory::shared().track(pyramid, GL_TEXTURE_2D, TEXTURES_RENDER_TARGETS);
+
+    glGenFramebuffers(1, &pyramidFBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, pyramidFBO);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, pyramid, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        std::cout << "Hi-Z framebuffer not complete!" << std::endl;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    // the full-screen triangle is generated from gl_VertexID, but core profile needs a VAO
+    glGenVertexArrays(1, &emptyVAO);
+
+    glGenBuffers(1, &objectBuffer);
+    glGenBuffers(2, results);
+    glGenBuffers(1, &readbackBuffer);
+    glGenVertexArrays(2, testVAO);
+    for (int i = 0; i < 2; i++) {
+        glBindVertexArray(testVAO[i]);
+        glBindBuffer(GL_ARRAY_BUFFER, objectBuffer);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(GpuObject), (void*)0);
+        glEnableVertexAttribArray(1);
+        glVertexAttribIPointer(1, 3, GL_UNSIGNED_INT, sizeof(GpuObject), (void*)offsetof(GpuObject, drawRange));
+        // instance count of the history command in results[i]
+        glBindBuffer(GL_ARRAY_BUFFER, results[i]);
+        glEnableVertexAttribArray(2);
+        glVertexAttribIPointer(2, 1, GL_UNSIGNED_INT, RECORD_SIZE, (void*)((HISTORY_COMMAND + 1) * sizeof(GLuint)));
+    }
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+OcclusionCuller::~OcclusionCuller() {
+    if (readbackFence)
+        glDeleteSync(readbackFence);
+    glDeleteVertexArrays(2, testVAO);
+    glDeleteVertexArrays(1, &emptyVAO);
+    glDeleteBuffers(1, &readbackBuffer);
+    glDeleteBuffers(2, results);
+    glDeleteBuffers(1, &objectBuffer);
+    glDeleteFramebuffers(1, &pyramidFBO);
+    TextureMemory::shared().untrack(pyramid);
+    glDeleteTextures(1, &pyramid);
+}
+
+void OcclusionCuller::beginFrame(const std::vector<OcclusionObject>& objects) {
+    // a different level of detail keeps the object's visibility, only a different set of objects resets it
+    bool changed = objects.size() != tracked.size();
+    tracked = objects;
+
+    std::vector<GpuObject> gpuObjects(objects.size());
+    for (size_t i = 0; i < objects.size(); i++) {
+        GpuObject& gpuObject = gpuObjects[i];
+        gpuObject.sphere[0] = objects[i].center.x;
+        gpuObject.sphere[1] = objects[i].center.y;
+        gpuObject.sphere[2] = objects[i].center.z;
+        gpuObject.sphere[3] = objects[i].radius;
+        gpuObject.drawRange[0] = objects[i].indexCount;
+        gpuObject.drawRange[1] = objects[i].firstIndex;
+        gpuObject.drawRange[2] = 0;
+        gpuObject.drawRange[3] = 0;
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, objectBuffer);
+    glBufferData(GL_ARRAY_BUFFER, gpuObjects.size() * sizeof(GpuObject), gpuObjects.empty() ? NULL : gpuObjects.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    if (changed) {
+        resetResults();
+    }
+    else {
+        // last frame's results become the history
+        current = 1 - current;
+    }
+}
+
+void OcclusionCuller::resetResults() {
+    // no history yet: every object counts as visible last frame
+    std::vector<GLuint> records(tracked.size() * (RECORD_SIZE / sizeof(GLuint)), 0);
+    for (size_t i = 0; i < tracked.size(); i++) {
+        GLuint* record = &records[i * (RECORD_SIZE / sizeof(GLuint))];
+        record[0] = record[HISTORY_COMMAND] = tracked[i].indexCount;
+        record[1] = record[HISTORY_COMMAND + 1] = 1;
+        record[2] = record[HISTORY_COMMAND + 2] = tracked[i].firstIndex;
+    }
+    for (int i = 0; i < 2; i++) {
+        glBindBuffer(GL_ARRAY_BUFFER, results[i]);
+        glBufferData(GL_ARRAY_BUFFER, records.size() * sizeof(GLuint), records.empty() ? NULL : records.data(), GL_DYNAMIC_COPY);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, readbackBuffer);
+    glBufferData(GL_ARRAY_BUFFER, records.size() * sizeof(GLuint), NULL, GL_STREAM_READ);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    if (readbackFence) {
+        glDeleteSync(readbackFence);
+        readbackFence = 0;
+    }
+    current = 0;
+}
+
+void OcclusionCuller::invalidate() {
+    pyramidValid = false;
+    resetResults();
+}
+
+void OcclusionCuller::buildPyramid(unsigned int depthTexture, const glm::mat4& viewProjection, Shader& downsampleShader) {
+    GLint previousViewport[4];
+    glGetIntegerv(GL_VIEWPORT, previousViewport);
+    GLint previousFramebuffer = 0;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer);
+    GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+    GLboolean stencilTest = glIsEnabled(GL_STENCIL_TEST);
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_STENCIL_TEST);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, pyramidFBO);
+    glBindVertexArray(emptyVAO);
+    downsampleShader.use();
+    downsampleShader.setInt("source", 0);
+    glActiveTexture(GL_TEXTURE0);
+
+    for (int level = 0; level < levels; level++) {
+        int levelWidth = std::max(width >> level, 1);
+        int levelHeight = std::max(height >> level, 1);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, pyramid, level);
+        glViewport(0, 0, levelWidth, levelHeight);
+
+        if (level == 0) {
+            glBindTexture(GL_TEXTURE_2D, depthTexture);
+            downsampleShader.setBool("reduce", false);
+        }
+        else {
+            // only the level above may be sampled while this one is being written
+            glBindTexture(GL_TEXTURE_2D, pyramid);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level - 1);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, level - 1);
+            downsampleShader.setBool("reduce", true);
+        }
+        int sourceLevel = std::max(level - 1, 0);
+        glUniform2i(glGetUniformLocation(downsampleShader.ID, "sourceSize"),
+            std::max(width >> sourceLevel, 1), std::max(height >> sourceLevel, 1));
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+    }
+
+    glBindTexture(GL_TEXTURE_2D, pyramid);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindVertexArray(0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+    glViewport(previousViewport[0], previousViewport[1], previousViewport[2], previousViewport[3]);
+    if (depthTest)
+        glEnable(GL_DEPTH_TEST);
+    if (stencilTest)
+        glEnable(GL_STENCIL_TEST);
+
+    pyramidValid = true;
+    pyramidViewProjection = viewProjection;
+}
+
+void OcclusionCuller::cull(bool twoPhase, Shader& testShader) {
+    if (tracked.empty())
+        return;
+
+    testShader.use();
+    testShader.setMat4("viewProjection", pyramidViewProjection);
+    testShader.setBool("hiZValid", pyramidValid);
+    testShader.setBool("twoPhase", twoPhase);
+    testShader.setInt("hiZLevels", levels);
+    glUniform2i(glGetUniformLocation(testShader.ID, "hiZSize"), width, height);
+    testShader.setInt("hiZ", 0);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, pyramid);
+
+    // one point per object, captured into this frame's command records
+    glBindVertexArray(testVAO[1 - current]);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, results[current]);
+    glEnable(GL_RASTERIZER_DISCARD);
+    glBeginTransformFeedback(GL_POINTS);
+    glDrawArrays(GL_POINTS, 0, static_cast<GLsizei>(tracked.size()));
+    glEndTransformFeedback();
+    glDisable(GL_RASTERIZER_DISCARD);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+    glBindVertexArray(0);
+
+    // keep one copy in flight for the statistics, never wait for it
+    if (!readbackFence) {
+        glBindBuffer(GL_COPY_READ_BUFFER, results[current]);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, readbackBuffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, tracked.size() * RECORD_SIZE);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        readbackFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+}
+
+void OcclusionCuller::bindCommands(Pass pass) const {
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, pass == FIRST_PASS ? results[1 - current] : results[current]);
+}
+
+const void* OcclusionCuller::command(Pass pass, size_t object) const {
+    size_t offset = object * RECORD_SIZE;
+    if (pass == FIRST_PASS)
+        offset += HISTORY_COMMAND * sizeof(GLuint);
+    return (const void*)offset;
+}
+
+void OcclusionCuller::collectStats() {
+    if (!readbackFence)
+        return;
+    GLenum status = glClientWaitSync(readbackFence, 0, 0);
+    if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+        return;
+    glDeleteSync(readbackFence);
+    readbackFence = 0;
+
+    const size_t recordUints = RECORD_SIZE / sizeof(GLuint);
+    std::vector<GLuint> records(tracked.size() * recordUints);
+    if (records.empty())
+        return;
+    glBindBuffer(GL_COPY_READ_BUFFER, readbackBuffer);
+    glGetBufferSubData(GL_COPY_READ_BUFFER, 0, records.size() * sizeof(GLuint), records.data());
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+    stats = OcclusionStats();
+    stats.objects = static_cast<int>(tracked.size());
+    for (size_t i = 0; i < tracked.size(); i++) {
+        const GLuint* record = &records[i * recordUints];
+        if (record[FIRST_PASS_FLAG])
+            stats.drawnFirstPass++;
+        else if (record[1])
+            stats.drawnSecondPass++;
+        else
+            stats.culled++;
+    }
+}
+
+const OcclusionStats& OcclusionCuller::getStats() {
+    collectStats();
+    return stats;
+}
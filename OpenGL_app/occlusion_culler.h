@@ -0,0 +1,99 @@
+#ifndef OCCLUSION_CULLER_H
+#define OCCLUSION_CULLER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+#include "Shader.h"
+
+// one indexed draw that can be occlusion culled
+struct OcclusionObject {
+    glm::vec3 center; // world-space bounding sphere
+    float radius;
+    unsigned int indexCount;  // index range drawn, e.g. the current level of detail
+    unsigned int firstIndex;
+};
+
+// what the last read-back culling pass decided, a few frames old
+struct OcclusionStats {
+    int objects = 0;
+    int drawnFirstPass = 0;  // visible last frame, drawn before the pyramid was built (two-phase)
+    int drawnSecondPass = 0; // passed the Hi-Z test and were not drawn yet
+    int culled = 0;
+};
+
+// GPU occlusion culling against a hierarchical-Z pyramid built from the G-buffer depth.
+//
+// Each object is one point in a transform feedback pass (occlusion_test.vs) that projects
+// its bounding sphere with the matrices the pyramid was rendered with and compares its
+// nearest depth with the farthest depth under it. The results are written as
+// DrawElementsIndirectCommands, so the draws stay on the CPU but a culled one has an
+// instance count of 0 and costs the GPU nothing; nothing is read back to decide a draw.
+//
+// Reprojected mode tests against last frame's pyramid and matrices before drawing, which
+// costs nothing extra but can drop an object for a frame when it comes out from behind
+// an occluder. Two-phase mode draws what was visible last frame first, builds the pyramid
+// from that, then tests everything and draws the newly visible objects the same frame.
+//
+// Indirect draws need GL 4.0; without it the scene is drawn unculled.
+class OcclusionCuller {
+public:
+    enum Mode { OCCLUSION_OFF, OCCLUSION_REPROJECTED, OCCLUSION_TWO_PHASE };
+    enum Pass { FIRST_PASS, SECOND_PASS };
+    // bytes per object in the command buffers: cull command, history command, first-pass flag
+    static const size_t RECORD_SIZE = 11 * sizeof(GLuint);
+
+    static bool isSupported() { return GLAD_GL_VERSION_4_0 != 0; }
+    // transform feedback outputs of occlusion_test.vs, in record order
+    static std::vector<std::string> feedbackVaryings();
+
+    OcclusionCuller(int width, int height);
+    ~OcclusionCuller();
+
+    // uploads this frame's objects; object i keeps its index from frame to frame
+    void beginFrame(const std::vector<OcclusionObject>& objects);
+
+    // rebuilds the pyramid from depthTexture, rendered with viewProjection
+    void buildPyramid(unsigned int depthTexture, const glm::mat4& viewProjection, Shader& downsampleShader);
+
+    // tests every object against the current pyramid and writes the second-pass commands;
+    // with twoPhase, objects drawn in the first pass are left out of them
+    void cull(bool twoPhase, Shader& testShader);
+
+    // binds the GL_DRAW_INDIRECT_BUFFER holding the commands of a pass; the first pass
+    // draws what last frame's culling found visible
+    void bindCommands(Pass pass) const;
+    // offset of an object's command in the buffer bound by bindCommands(pass)
+    const void* command(Pass pass, size_t object) const;
+
+    // forgets the pyramid and marks every object visible, e.g. after a camera cut
+    void invalidate();
+
+    const OcclusionStats& getStats();
+
+private:
+    int width, height;
+    int levels;
+    unsigned int pyramid = 0;
+    unsigned int pyramidFBO = 0;
+    unsigned int emptyVAO = 0;
+    bool pyramidValid = false;
+    glm::mat4 pyramidViewProjection = glm::mat4(1.0f);
+
+    std::vector<OcclusionObject> tracked; // this frame's objects, a different count resets the history
+    unsigned int objectBuffer = 0;   // bounding sphere and draw range per object
+    unsigned int results[2] = { 0, 0 }; // command records, this frame's and last frame's
+    unsigned int testVAO[2] = { 0, 0 }; // reads the history of results[i]
+    int current = 0;
+
+    // statistics are copied out and read back once the GPU is done with them
+    unsigned int readbackBuffer = 0;
+    GLsync readbackFence = 0;
+    OcclusionStats stats;
+
+    void resetResults();
+    void collectStats();
+};
+
+#endif
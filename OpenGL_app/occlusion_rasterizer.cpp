@@ -0,0 +1,177 @@
+#include "occlusion_rasterizer.h"
+#include "job_system.h"
+#include <emmintrin.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+OcclusionRasterizer::OcclusionRasterizer(int width, int height)
+    : width((std::max(width, 4) + 3) & ~3), height(std::max(height, 1)) {
+    tilesX = (this->width + TILE_WIDTH - 1) / TILE_WIDTH;
+    tilesY = (this->height + TILE_HEIGHT - 1) / TILE_HEIGHT;
+    depth.assign(this->width * this->height, 1.0f);
+    bins.resize(tilesX * tilesY);
+}
+
+void OcclusionRasterizer::beginFrame(const glm::mat4& viewProjection) {
+    this->viewProjection = viewProjection;
+    std::fill(depth.begin(), depth.end(), 1.0f);
+    triangles.clear();
+    for (std::vector<unsigned int>& bin : bins)
+        bin.clear();
+}
+
+void OcclusionRasterizer::addOccluder(const float* positions, const unsigned int* indices, size_t indexCount, const glm::mat4& modelMatrix) {
+    glm::mat4 mvp = viewProjection * modelMatrix;
+    for (size_t i = 0; i + 2 < indexCount; i += 3) {
+        glm::vec4 clip[3];
+        bool clipped = false;
+        for (int v = 0; v < 3; v++) {
+            const float* p = positions + indices[i + v] * 3;
+            clip[v] = mvp * glm::vec4(p[0], p[1], p[2], 1.0f);
+            // crosses the near plane: skip rather than clip
+            if (clip[v].z < -clip[v].w || clip[v].w <= 0.0f)
+                clipped = true;
+        }
+        if (clipped)
+            continue;
+
+        Triangle triangle;
+        for (int v = 0; v < 3; v++) {
+            float invW = 1.0f / clip[v].w;
+            triangle.x[v] = (clip[v].x * invW * 0.5f + 0.5f) * width;
+            triangle.y[v] = (clip[v].y * invW * 0.5f + 0.5f) * height;
+            triangle.z[v] = clip[v].z * invW * 0.5f + 0.5f;
+        }
+
+        float minX = std::min(triangle.x[0], std::min(triangle.x[1], triangle.x[2]));
+        float maxX = std::max(triangle.x[0], std::max(triangle.x[1], triangle.x[2]));
+        float minY = std::min(triangle.y[0], std::min(triangle.y[1], triangle.y[2]));
+        float maxY = std::max(triangle.y[0], std::max(triangle.y[1], triangle.y[2]));
+        if (maxX < 0.0f || maxY < 0.0f || minX >= width || minY >= height)
+            continue;
+
+        // bin into every tile the bounding box touches
+        int firstTileX = std::max((int)minX, 0) / TILE_WIDTH;
+        int lastTileX = std::min((int)maxX, width - 1) / TILE_WIDTH;
+        int firstTileY = std::max((int)minY, 0) / TILE_HEIGHT;
+        int lastTileY = std::min((int)maxY, height - 1) / TILE_HEIGHT;
+        unsigned int index = static_cast<unsigned int>(triangles.size());
+        triangles.push_back(triangle);
+        for (int ty = firstTileY; ty <= lastTileY; ty++) {
+            for (int tx = firstTileX; tx <= lastTileX; tx++)
+                bins[ty * tilesX + tx].push_back(index);
+        }
+    }
+}
+
+void OcclusionRasterizer::rasterize() {
+    std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+    // a job per tile: tiles own their pixels, and their triangle counts differ too much for larger batches
+    JobSystem::shared().parallelFor(0, tilesX * tilesY, 1, [this](int first, int last) {
+        for (int tile = first; tile < last; tile++)
+            rasterizeTile(tile);
+    });
+
+    trianglesRasterized = static_cast<int>(triangles.size());
+    rasterizeMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+void OcclusionRasterizer::rasterizeTile(int tile) {
+    const int tileX0 = (tile % tilesX) * TILE_WIDTH;
+    const int tileY0 = (tile / tilesX) * TILE_HEIGHT;
+    const int tileX1 = std::min(tileX0 + TILE_WIDTH, width);
+    const int tileY1 = std::min(tileY0 + TILE_HEIGHT, height);
+    const __m128 laneOffsets = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+    const __m128 zero = _mm_setzero_ps();
+
+    for (unsigned int index : bins[tile]) {
+        const Triangle& t = triangles[index];
+
+        // edge functions scaled by 1/area: at a pixel they are its barycentric coordinates,
+        // so either winding works and inside means all three are non-negative
+        float area = (t.x[1] - t.x[0]) * (t.y[2] - t.y[0]) - (t.x[2] - t.x[0]) * (t.y[1] - t.y[0]);
+        if (std::fabs(area) < 1e-8f)
+            continue;
+        float invArea = 1.0f / area;
+        float a[3], b[3], c[3];
+        for (int e = 0; e < 3; e++) {
+            int v1 = (e + 1) % 3, v2 = (e + 2) % 3;
+            a[e] = (t.y[v1] - t.y[v2]) * invArea;
+            b[e] = (t.x[v2] - t.x[v1]) * invArea;
+            c[e] = (t.x[v1] * t.y[v2] - t.x[v2] * t.y[v1]) * invArea;
+        }
+        // depth is affine in screen space
+        float za = a[0] * t.z[0] + a[1] * t.z[1] + a[2] * t.z[2];
+        float zb = b[0] * t.z[0] + b[1] * t.z[1] + b[2] * t.z[2];
+        float zc = c[0] * t.z[0] + c[1] * t.z[1] + c[2] * t.z[2];
+
+        // bounding box inside the tile, rows of four pixels starting on a multiple of 4
+        int startX = std::max(tileX0, (int)std::floor(std::min(t.x[0], std::min(t.x[1], t.x[2])))) & ~3;
+        int endX = std::min(tileX1 - 1, (int)std::ceil(std::max(t.x[0], std::max(t.x[1], t.x[2]))));
+        int startY = std::max(tileY0, (int)std::floor(std::min(t.y[0], std::min(t.y[1], t.y[2]))));
+        int endY = std::min(tileY1 - 1, (int)std::ceil(std::max(t.y[0], std::max(t.y[1], t.y[2]))));
+        if (startX > endX || startY > endY)
+            continue;
+
+        const __m128 stepA0 = _mm_set1_ps(4.0f * a[0]), stepA1 = _mm_set1_ps(4.0f * a[1]), stepA2 = _mm_set1_ps(4.0f * a[2]);
+        const __m128 stepZ = _mm_set1_ps(4.0f * za);
+        const __m128 px = _mm_add_ps(_mm_set1_ps((float)startX), laneOffsets);
+        for (int y = startY; y <= endY; y++) {
+            float py = y + 0.5f;
+            __m128 e0 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a[0]), px), _mm_set1_ps(b[0] * py + c[0]));
+            __m128 e1 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a[1]), px), _mm_set1_ps(b[1] * py + c[1]));
+            __m128 e2 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a[2]), px), _mm_set1_ps(b[2] * py + c[2]));
+            __m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(za), px), _mm_set1_ps(zb * py + zc));
+            float* row = &depth[y * width];
+
+            for (int x = startX; x <= endX; x += 4) {
+                __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_cmpge_ps(e1, zero)), _mm_cmpge_ps(e2, zero));
+                if (_mm_movemask_ps(inside)) {
+                    __m128 current = _mm_loadu_ps(row + x);
+                    __m128 nearer = _mm_min_ps(current, z);
+                    _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, current)));
+                }
+                e0 = _mm_add_ps(e0, stepA0);
+                e1 = _mm_add_ps(e1, stepA1);
+                e2 = _mm_add_ps(e2, stepA2);
+                z = _mm_add_ps(z, stepZ);
+            }
+        }
+    }
+}
+
+bool OcclusionRasterizer::isVisible(const glm::vec3& boxMin, const glm::vec3& boxMax) const {
+    glm::vec3 ndcMin(1e30f), ndcMax(-1e30f);
+    for (int i = 0; i < 8; i++) {
+        glm::vec3 corner((i & 1) ? boxMax.x : boxMin.x, (i & 2) ? boxMax.y : boxMin.y, (i & 4) ? boxMax.z : boxMin.z);
+        glm::vec4 clip = viewProjection * glm::vec4(corner, 1.0f);
+        // reaches behind the camera, there is no rectangle to test
+        if (clip.w <= 0.0f)
+            return true;
+        glm::vec3 ndc = glm::vec3(clip) / clip.w;
+        ndcMin = glm::min(ndcMin, ndc);
+        ndcMax = glm::max(ndcMax, ndc);
+    }
+    if (ndcMax.x < -1.0f || ndcMin.x > 1.0f || ndcMax.y < -1.0f || ndcMin.y > 1.0f || ndcMin.z > 1.0f)
+        return false;
+    if (ndcMin.z < -1.0f)
+        return true;
+
+    int x0 = std::max((int)((ndcMin.x * 0.5f + 0.5f) * width), 0) & ~3;
+    int x1 = std::min((int)((ndcMax.x * 0.5f + 0.5f) * width), width - 1);
+    int y0 = std::max((int)((ndcMin.y * 0.5f + 0.5f) * height), 0);
+    int y1 = std::min((int)((ndcMax.y * 0.5f + 0.5f) * height), height - 1);
+    const __m128 nearest = _mm_set1_ps(ndcMin.z * 0.5f + 0.5f);
+
+    // visible as soon as one pixel under the box is not nearer than it
+    for (int y = y0; y <= y1; y++) {
+        const float* row = &depth[y * width];
+        for (int x = x0; x <= x1; x += 4) {
+            if (_mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(row + x), nearest)))
+                return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,61 @@
+#ifndef OCCLUSION_RASTERIZER_H
+#define OCCLUSION_RASTERIZER_H
+
+#include <glm/glm.hpp>
+#include <vector>
+
+// CPU occlusion culling, for when reading GPU results back is too slow or there is no GPU.
+//
+// A few large occluders are rasterized into a small depth buffer: triangles are transformed
+// and binned into screen tiles on the calling thread, then the tiles are filled in parallel
+// on the JobSystem, four pixels at a time with SSE. Objects are tested with their bounding
+// box before any draw is issued: an object is hidden when every pixel under the box is
+// nearer than the box.
+//
+// Only triangles fully in front of the near plane are rasterized; occluders only ever hide
+// things, so dropping the others keeps the test conservative.
+class OcclusionRasterizer {
+public:
+    // width is rounded up to a multiple of 4
+    OcclusionRasterizer(int width = 256, int height = 192);
+
+    // clears the depth buffer for a frame seen through viewProjection
+    void beginFrame(const glm::mat4& viewProjection);
+    // transforms an indexed triangle list of xyz positions and bins its triangles
+    void addOccluder(const float* positions, const unsigned int* indices, size_t indexCount, const glm::mat4& modelMatrix);
+    // fills the depth buffer with everything added since beginFrame
+    void rasterize();
+    // false only if the whole box is behind the rasterized occluders (or outside the view)
+    bool isVisible(const glm::vec3& boxMin, const glm::vec3& boxMax) const;
+
+    int getTrianglesRasterized() const { return trianglesRasterized; } // by the last rasterize
+    double getRasterizeMilliseconds() const { return rasterizeMs; }
+
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+    // depth in [0, 1] at pixel (x, y), counted from the bottom left; 1 where nothing was drawn
+    float getDepth(int x, int y) const { return depth[y * width + x]; }
+
+private:
+    static const int TILE_WIDTH = 64; // multiple of 4
+    static const int TILE_HEIGHT = 32;
+
+    // screen-space triangle: pixel coordinates and depth in [0, 1]
+    struct Triangle {
+        float x[3], y[3], z[3];
+    };
+
+    int width, height;
+    int tilesX, tilesY;
+    std::vector<float> depth; // row-major, nearest depth per pixel
+    glm::mat4 viewProjection = glm::mat4(1.0f);
+    std::vector<Triangle> triangles;
+    std::vector<std::vector<unsigned int>> bins; // triangle indices per tile
+
+    int trianglesRasterized = 0;
+    double rasterizeMs = 0.0;
+
+    void rasterizeTile(int tile);
+};
+
+#endif
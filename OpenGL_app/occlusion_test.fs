@@ -0,0 +1,6 @@
+#version 330 core
+
+// never runs, the occlusion test is drawn with GL_RASTERIZER_DISCARD
+void main()
+{
+}
@@ -0,0 +1,73 @@
+#version 330 core
+// One vertex per object, run with rasterizer discard; the outputs are captured with
+// transform feedback straight into the GL_DRAW_INDIRECT_BUFFER the scene is drawn from.
+layout (location = 0) in vec4 boundingSphere;  // world-space centre and radius
+layout (location = 1) in uvec3 drawRange;      // index count, first index, base vertex
+layout (location = 2) in uint visibleLastFrame; // instance count of the previous history command
+
+uniform mat4 viewProjection; // the matrices the pyramid was rendered with
+uniform sampler2D hiZ;
+uniform ivec2 hiZSize;       // size of level 0
+uniform int hiZLevels;
+uniform bool hiZValid;
+uniform bool twoPhase;       // objects visible last frame were already drawn this frame
+
+// two DrawElementsIndirectCommands (count, instanceCount, firstIndex, baseVertex, baseInstance)
+flat out uvec4 cullCommand;       // draw now: visible and not drawn yet
+flat out uint cullBaseInstance;
+flat out uvec4 historyCommand;    // visible, drawn first in the next frame's two-phase culling
+flat out uint historyBaseInstance;
+flat out uint drawnInFirstPass;
+
+bool isVisible()
+{
+    if (!hiZValid)
+        return true;
+
+    // screen rectangle and nearest depth of the sphere's bounding box
+    vec3 ndcMin = vec3(1e30);
+    vec3 ndcMax = vec3(-1e30);
+    for (int i = 0; i < 8; i++)
+    {
+        vec3 corner = boundingSphere.xyz + boundingSphere.w * vec3((i & 1) != 0 ? 1.0 : -1.0,
+            (i & 2) != 0 ? 1.0 : -1.0, (i & 4) != 0 ? 1.0 : -1.0);
+        vec4 clip = viewProjection * vec4(corner, 1.0);
+        // reaches behind the camera: no finite rectangle, keep it
+        if (clip.w <= 0.0)
+            return true;
+        vec3 ndc = clip.xyz / clip.w;
+        ndcMin = min(ndcMin, ndc);
+        ndcMax = max(ndcMax, ndc);
+    }
+    // outside the frustum
+    if (ndcMax.x < -1.0 || ndcMin.x > 1.0 || ndcMax.y < -1.0 || ndcMin.y > 1.0 || ndcMin.z > 1.0)
+        return false;
+    if (ndcMin.z < -1.0)
+        return true;
+
+    vec2 texelMin = clamp(ndcMin.xy * 0.5 + 0.5, 0.0, 1.0) * vec2(hiZSize);
+    vec2 texelMax = clamp(ndcMax.xy * 0.5 + 0.5, 0.0, 1.0) * vec2(hiZSize);
+    // the level at which the rectangle spans at most 2x2 texels
+    vec2 extent = texelMax - texelMin;
+    int level = clamp(int(ceil(log2(max(max(extent.x, extent.y), 1.0)))), 0, hiZLevels - 1);
+    ivec2 levelSize = max(hiZSize >> level, ivec2(1));
+    ivec2 low = min(ivec2(texelMin) >> level, levelSize - 1);
+    ivec2 high = min(ivec2(texelMax) >> level, levelSize - 1);
+
+    float farthest = max(max(texelFetch(hiZ, low, level).r, texelFetch(hiZ, ivec2(high.x, low.y), level).r),
+                         max(texelFetch(hiZ, ivec2(low.x, high.y), level).r, texelFetch(hiZ, high, level).r));
+    float nearest = ndcMin.z * 0.5 + 0.5;
+    return nearest <= farthest;
+}
+
+void main()
+{
+    bool visible = isVisible();
+    bool drawn = twoPhase && visibleLastFrame != 0u;
+
+    cullCommand = uvec4(drawRange.x, (visible && !drawn) ? 1u : 0u, drawRange.y, drawRange.z);
+    cullBaseInstance = 0u;
+    historyCommand = uvec4(drawRange.x, visible ? 1u : 0u, drawRange.y, drawRange.z);
+    historyBaseInstance = 0u;
+    drawnInFirstPass = drawn ? 1u : 0u;
+}
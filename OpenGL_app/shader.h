@@ -6,10 +6,20 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+#include <algorithm>
+#include <map>
 #include <string>
+#include <vector>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include "file_watcher.h"
+#include "gl_extensions.h"
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
 
 class Shader
 {
@@ -17,60 +27,119 @@ public:
     unsigned int ID;
     // constructor generates the shader on the fly
     // ------------------------------------------------------------------------
-    Shader(const char* vertexPath, const char* fragmentPath)
+    Shader(const char* vertexPath, const char* fragmentPath) : Shader(vertexPath, fragmentPath, std::vector<std::string>())
+    {
+    }
+    // same as above, but injects a "#define <entry>" line into both stages for every entry
+    // in defines (e.g. "BLINN" or "NR_POINT_LIGHTS 4"), so one source file can produce
+    // several specialized programs. Both stages may #include "file" (resolved relative to
+    // the including file, each file at most once per stage).
+    // ------------------------------------------------------------------------
+    Shader(const char* vertexPath, const char* fragmentPath, const std::vector<std::string>& defines)
+        : Shader(vertexPath, fragmentPath, defines, std::vector<std::string>())
+    {
+    }
+    // same as above, for a program whose vertex outputs are captured with transform feedback:
+    // the named outputs are recorded interleaved into the buffer bound to binding point 0
+    // ------------------------------------------------------------------------
+    Shader(const char* vertexPath, const char* fragmentPath, const std::vector<std::string>& defines,
+        const std::vector<std::string>& feedbackVaryings)
+        : vertexPath(vertexPath), fragmentPath(fragmentPath), defines(defines), feedbackVaryings(feedbackVaryings)
     {
         // 1. retrieve the vertex/fragment source code from filePath
         std::string vertexCode;
         std::string fragmentCode;
-        std::ifstream vShaderFile;
-        std::ifstream fShaderFile;
-        // ensure ifstream objects can throw exceptions:
-        vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-        fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-        try
+        loadSources(vertexCode, fragmentCode);
+        // 2. try the program binary cache before paying for a full compile and link
+        ID = glCreateProgram();
+        std::string cachePath = binaryCachePath(vertexCode, fragmentCode);
+        if (!loadProgramBinary(ID, cachePath))
         {
-            // open files
-            vShaderFile.open(vertexPath);
-            fShaderFile.open(fragmentPath);
-            std::stringstream vShaderStream, fShaderStream;
-            // read file's buffer contents into streams
-            vShaderStream << vShaderFile.rdbuf();
-            fShaderStream << fShaderFile.rdbuf();
-            // close file handlers
-            vShaderFile.close();
-            fShaderFile.close();
-            // convert stream into string
-            vertexCode = vShaderStream.str();
-            fragmentCode = fShaderStream.str();
+            // 3. cache miss (or stale driver binary): compile from source
+            glDeleteProgram(ID);
+            PendingProgram build = startCompile(vertexCode.c_str(), fragmentCode.c_str());
+            finishCompile(build);
+            ID = build.program;
+            saveProgramBinary(ID, cachePath);
         }
-        catch (std::ifstream::failure& e)
+
+        if (hotReloadEnabled())
         {
-            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << e.what() << std::endl;
+            for (const std::string& dependency : dependencies)
+            {
+                FileWatcher::shared().watch(dependency);
+                seenGenerations[dependency] = FileWatcher::shared().generation(dependency);
+            }
         }
-        const char* vShaderCode = vertexCode.c_str();
-        const char* fShaderCode = fragmentCode.c_str();
-        // 2. compile shaders
-        unsigned int vertex, fragment;
-        // vertex shader
-        vertex = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertex, 1, &vShaderCode, NULL);
-        glCompileShader(vertex);
-        checkCompileErrors(vertex, "VERTEX");
-        // fragment Shader
-        fragment = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragment, 1, &fShaderCode, NULL);
-        glCompileShader(fragment);
-        checkCompileErrors(fragment, "FRAGMENT");
-        // shader Program
-        ID = glCreateProgram();
-        glAttachShader(ID, vertex);
-        glAttachShader(ID, fragment);
-        glLinkProgram(ID);
-        checkCompileErrors(ID, "PROGRAM");
-        // delete the shaders as they're linked into our program now and no longer necessary
-        glDeleteShader(vertex);
-        glDeleteShader(fragment);
+    }
+    Shader(const Shader&) = delete;
+    Shader& operator=(const Shader&) = delete;
+
+    // hot reload: when enabled before shaders are created, every shader watches its source files
+    // ------------------------------------------------------------------------
+    static bool& hotReloadEnabled()
+    {
+        static bool enabled = false;
+        return enabled;
+    }
+    // call once per frame on the GL thread. Starts a recompile when a source file changed and
+    // swaps the new program in once it has linked; with KHR_parallel_shader_compile the driver
+    // compiles in the background and this never blocks. A program that fails to compile or
+    // link is discarded and the last good one stays active. Returns true when ID was replaced,
+    // in which case uniforms that are only set once need to be set again.
+    // ------------------------------------------------------------------------
+    bool reloadIfChanged()
+    {
+        if (!hotReloadEnabled())
+            return false;
+
+        // any file the program includes counts, not only the two stage files. The watcher only
+        // counts changes, so every program (and every variant of one) sees each edit itself
+        bool changed = false;
+        for (const std::string& dependency : dependencies)
+        {
+            unsigned long long generation = FileWatcher::shared().generation(dependency);
+            if (generation != seenGenerations[dependency])
+            {
+                seenGenerations[dependency] = generation;
+                changed = true;
+            }
+        }
+        if (changed)
+        {
+            if (pending.program)
+                discardCompile(pending);
+            std::string vertexCode, fragmentCode;
+            if (!loadSources(vertexCode, fragmentCode))
+                return false;
+            // the edit may have added includes; they start from their current generation, so an
+            // earlier edit to a newly included file does not trigger a second reload
+            for (const std::string& dependency : dependencies)
+            {
+                FileWatcher::shared().watch(dependency);
+                if (!seenGenerations.count(dependency))
+                    seenGenerations[dependency] = FileWatcher::shared().generation(dependency);
+            }
+            pending = startCompile(vertexCode.c_str(), fragmentCode.c_str());
+            pending.cachePath = binaryCachePath(vertexCode, fragmentCode);
+        }
+
+        if (!pending.program || !isCompileComplete(pending))
+            return false;
 
+        PendingProgram build = pending;
+        pending = PendingProgram();
+        if (!finishCompile(build))
+        {
+            std::cout << "Shader reload failed, keeping previous program: " << vertexPath << " / " << fragmentPath << std::endl;
+            glDeleteProgram(build.program);
+            return false;
+        }
+        glDeleteProgram(ID);
+        ID = build.program;
+        saveProgramBinary(ID, build.cachePath);
+        std::cout << "Shader reloaded: " << vertexPath << " / " << fragmentPath << std::endl;
+        return true;
     }
     // activate the shader
     // ------------------------------------------------------------------------
@@ -138,9 +207,332 @@ public:
     }
 
 private:
+    // directory the linked program binaries are stored in, relative to the working directory
+    static const char* binaryCacheDir() { return "shader_cache"; }
+    static const unsigned int BINARY_CACHE_MAGIC = 0x53484252; // "SHBR"
+
+    // inserts the defines right after the #version directive, which has to stay the first statement
+    // ------------------------------------------------------------------------
+    static std::string injectDefines(const std::string& code, const std::vector<std::string>& defines)
+    {
+        if (defines.empty())
+            return code;
+        std::string block;
+        for (const std::string& define : defines)
+            block += "#define " + define + "\n";
+
+        size_t versionPos = code.find("#version");
+        if (versionPos == std::string::npos)
+            return block + code;
+        size_t lineEnd = code.find('\n', versionPos);
+        if (lineEnd == std::string::npos)
+            return code + "\n" + block;
+        // keep compiler messages pointing at the right line of the stage file
+        int nextLine = static_cast<int>(std::count(code.begin(), code.begin() + lineEnd, '\n')) + 2;
+        block += "#line " + std::to_string(nextLine) + " 0\n";
+        return code.substr(0, lineEnd + 1) + block + code.substr(lineEnd + 1);
+    }
+
+    // a program whose compile and link have been issued but not yet checked
+    struct PendingProgram
+    {
+        unsigned int program = 0, vertex = 0, fragment = 0;
+        std::string cachePath;
+    };
+
+    std::string vertexPath;
+    std::string fragmentPath;
+    std::vector<std::string> defines;
+    std::vector<std::string> feedbackVaryings;
+    std::vector<std::string> vertexFiles;   // source-string order of the vertex stage
+    std::vector<std::string> fragmentFiles; // source-string order of the fragment stage
+    std::vector<std::string> dependencies;  // union of both, watched for hot reload
+    std::map<std::string, unsigned long long> seenGenerations; // FileWatcher::generation last acted on
+    PendingProgram pending;
+
+    // reads both stages from disk, resolves their includes and applies the defines;
+    // returns false if a file could not be read
+    // ------------------------------------------------------------------------
+    bool loadSources(std::string& vertexCode, std::string& fragmentCode)
+    {
+        try
+        {
+            vertexFiles.clear();
+            fragmentFiles.clear();
+            vertexCode = resolveIncludes(vertexPath, vertexFiles);
+            fragmentCode = resolveIncludes(fragmentPath, fragmentFiles);
+        }
+        catch (std::ifstream::failure& e)
+        {
+            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << e.what() << std::endl;
+            return false;
+        }
+        // every file of either stage; the expanded sources (and so the binary cache key)
+        // contain all of them, so editing any include invalidates exactly the programs using it
+        dependencies = vertexFiles;
+        for (const std::string& file : fragmentFiles)
+        {
+            if (std::find(dependencies.begin(), dependencies.end(), file) == dependencies.end())
+                dependencies.push_back(file);
+        }
+        vertexCode = injectDefines(vertexCode, defines);
+        fragmentCode = injectDefines(fragmentCode, defines);
+        return true;
+    }
+
+    static std::string readFile(const std::string& path)
+    {
+        std::ifstream file;
+        // ensure ifstream objects can throw exceptions:
+        file.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+        file.open(path);
+        std::stringstream stream;
+        stream << file.rdbuf();
+        file.close();
+        return stream.str();
+    }
+
+    // expands #include "file" directives recursively. files collects every file of the stage
+    // in source-string order, so the N in a driver error like "N(42)" is files[N]; #line
+    // directives keep the line numbers of each file intact.
+    // ------------------------------------------------------------------------
+    static std::string resolveIncludes(const std::string& path, std::vector<std::string>& files)
+    {
+        const int fileIndex = static_cast<int>(files.size());
+        files.push_back(path);
+
+        std::string directory;
+        size_t slash = path.find_last_of("/\\");
+        if (slash != std::string::npos)
+            directory = path.substr(0, slash + 1);
+
+        std::istringstream source(readFile(path));
+        std::string expanded;
+        if (fileIndex > 0)
+            expanded += "#line 1 " + std::to_string(fileIndex) + "\n";
+
+        std::string line;
+        int lineNumber = 0;
+        while (std::getline(source, line))
+        {
+            lineNumber++;
+            size_t start = line.find_first_not_of(" \t");
+            if (start == std::string::npos || line.compare(start, 8, "#include") != 0)
+            {
+                expanded += line + "\n";
+                continue;
+            }
+
+            size_t open = line.find_first_of("\"<", start + 8);
+            size_t close = open == std::string::npos ? open : line.find_first_of("\">", open + 1);
+            if (close == std::string::npos)
+            {
+                std::cout << "ERROR::SHADER::MALFORMED_INCLUDE: " << path << "(" << lineNumber << ")" << std::endl;
+                expanded += "\n";
+                continue;
+            }
+            std::string includePath = directory + line.substr(open + 1, close - open - 1);
+            if (std::find(files.begin(), files.end(), includePath) == files.end())
+            {
+                expanded += resolveIncludes(includePath, files);
+                expanded += "#line " + std::to_string(lineNumber + 1) + " " + std::to_string(fileIndex) + "\n";
+            }
+            else
+            {
+                // already part of this stage, keep the line count unchanged
+                expanded += "\n";
+            }
+        }
+        return expanded;
+    }
+
+    // issues the compile of both stages and the link; nothing here waits for the driver
+    // ------------------------------------------------------------------------
+    PendingProgram startCompile(const char* vShaderCode, const char* fShaderCode)
+    {
+        PendingProgram build;
+        // vertex shader
+        build.vertex = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(build.vertex, 1, &vShaderCode, NULL);
+        glCompileShader(build.vertex);
+        // fragment Shader
+        build.fragment = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(build.fragment, 1, &fShaderCode, NULL);
+        glCompileShader(build.fragment);
+        // shader Program
+        build.program = glCreateProgram();
+        if (programBinarySupported())
+            glProgramParameteri(build.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        glAttachShader(build.program, build.vertex);
+        glAttachShader(build.program, build.fragment);
+        if (!feedbackVaryings.empty())
+        {
+            std::vector<const char*> names;
+            for (const std::string& varying : feedbackVaryings)
+                names.push_back(varying.c_str());
+            glTransformFeedbackVaryings(build.program, static_cast<GLsizei>(names.size()), names.data(), GL_INTERLEAVED_ATTRIBS);
+        }
+        glLinkProgram(build.program);
+        return build;
+    }
+
+    // without KHR_parallel_shader_compile the status queries below block, so treat it as done
+    // ------------------------------------------------------------------------
+    static bool isCompileComplete(const PendingProgram& build)
+    {
+        if (!glExtensions.parallelShaderCompile)
+            return true;
+        GLint complete = GL_FALSE;
+        glGetProgramiv(build.program, GL_COMPLETION_STATUS_KHR, &complete);
+        return complete == GL_TRUE;
+    }
+
+    // reports errors and releases the stage objects; returns true if the program linked
+    // ------------------------------------------------------------------------
+    bool finishCompile(PendingProgram& build)
+    {
+        bool success = checkCompileErrors(build.vertex, "VERTEX");
+        if (!success)
+            printSourceFiles(vertexFiles);
+        bool fragmentSuccess = checkCompileErrors(build.fragment, "FRAGMENT");
+        if (!fragmentSuccess)
+            printSourceFiles(fragmentFiles);
+        success = fragmentSuccess && success;
+        success = checkCompileErrors(build.program, "PROGRAM") && success;
+        // delete the shaders as they're linked into our program now and no longer necessary
+        glDeleteShader(build.vertex);
+        glDeleteShader(build.fragment);
+        build.vertex = build.fragment = 0;
+        return success;
+    }
+
+    static void printSourceFiles(const std::vector<std::string>& files)
+    {
+        for (size_t i = 0; i < files.size(); i++)
+            std::cout << "  source string " << i << ": " << files[i] << std::endl;
+    }
+
+    static void discardCompile(PendingProgram& build)
+    {
+        glDeleteShader(build.vertex);
+        glDeleteShader(build.fragment);
+        glDeleteProgram(build.program);
+        build = PendingProgram();
+    }
+
+    // program binaries need GL 4.1 (or ARB_get_program_binary) and at least one binary format
+    // ------------------------------------------------------------------------
+    static bool programBinarySupported()
+    {
+        if (!glExtensions.programBinary)
+            return false;
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        return formats > 0;
+    }
+
+    // 64-bit FNV-1a, good enough to key cache files on shader source and driver identity
+    // ------------------------------------------------------------------------
+    static unsigned long long hashString(const std::string& str, unsigned long long hash = 14695981039346656037ULL)
+    {
+        for (unsigned char c : str)
+        {
+            hash ^= c;
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    // the cache key covers the sources, the captured outputs and the driver, since binaries are
+    // only valid for the driver that produced them
+    // ------------------------------------------------------------------------
+    std::string binaryCachePath(const std::string& vertexCode, const std::string& fragmentCode) const
+    {
+        const char* vendor = reinterpret_cast<const char*>(glGetString(GL_VENDOR));
+        const char* renderer = reinterpret_cast<const char*>(glGetString(GL_RENDERER));
+        const char* version = reinterpret_cast<const char*>(glGetString(GL_VERSION));
+
+        unsigned long long hash = hashString(vertexCode);
+        hash = hashString("\n--fragment--\n", hash);
+        hash = hashString(fragmentCode, hash);
+        for (const std::string& varying : feedbackVaryings)
+            hash = hashString("\n--feedback--\n" + varying, hash);
+        hash = hashString(vendor ? vendor : "", hash);
+        hash = hashString(renderer ? renderer : "", hash);
+        hash = hashString(version ? version : "", hash);
+
+        std::stringstream path;
+        path << binaryCacheDir() << "/" << std::hex << hash << ".bin";
+        return path.str();
+    }
+
+    // loads a previously stored binary into program; returns false if it is missing or the driver rejects it
+    // ------------------------------------------------------------------------
+    static bool loadProgramBinary(unsigned int program, const std::string& path)
+    {
+        if (!programBinarySupported())
+            return false;
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
+            return false;
+
+        unsigned int magic = 0;
+        GLenum format = 0;
+        GLint length = 0;
+        file.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+        file.read(reinterpret_cast<char*>(&format), sizeof(format));
+        file.read(reinterpret_cast<char*>(&length), sizeof(length));
+        if (!file || magic != BINARY_CACHE_MAGIC || length <= 0)
+            return false;
+
+        std::vector<char> binary(length);
+        file.read(binary.data(), length);
+        if (!file)
+            return false;
+
+        glProgramBinary(program, format, binary.data(), length);
+        GLint success = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        return success == GL_TRUE;
+    }
+
+    // writes a linked program to the cache so the next launch can skip compilation
+    // ------------------------------------------------------------------------
+    static void saveProgramBinary(unsigned int program, const std::string& path)
+    {
+        if (!programBinarySupported())
+            return;
+        GLint linked = GL_FALSE, length = 0;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (linked != GL_TRUE || length <= 0)
+            return;
+
+        std::vector<char> binary(length);
+        GLenum format = 0;
+        glGetProgramBinary(program, length, &length, &format, binary.data());
+
+#ifdef _WIN32
+        _mkdir(binaryCacheDir());
+#else
+        mkdir(binaryCacheDir(), 0755);
+#endif
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        if (!file)
+        {
+            std::cout << "WARNING::SHADER::BINARY_CACHE_NOT_WRITABLE: " << path << std::endl;
+            return;
+        }
+        unsigned int magic = BINARY_CACHE_MAGIC;
+        file.write(reinterpret_cast<const char*>(&magic), sizeof(magic));
+        file.write(reinterpret_cast<const char*>(&format), sizeof(format));
+        file.write(reinterpret_cast<const char*>(&length), sizeof(length));
+        file.write(binary.data(), length);
+    }
+
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
-    void checkCompileErrors(GLuint shader, std::string type)
+    bool checkCompileErrors(GLuint shader, std::string type)
     {
         GLint success;
         GLchar infoLog[1024];
@@ -162,6 +554,7 @@ private:
                 std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
             }
         }
+        return success == GL_TRUE;
     }
 };
 #endif
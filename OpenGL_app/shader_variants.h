@@ -0,0 +1,81 @@
+#ifndef SHADER_VARIANTS_H
+#define SHADER_VARIANTS_H
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "shader.h"
+
+// A family of programs built from one vertex/fragment source pair. Each optional
+// feature is a #define switched on by one bit of the variant key, so e.g. with the
+// features { "BLINN", "FOG" } the key 3 compiles the source with both defined.
+// Variants are compiled the first time they are requested (or up front through
+// precompile) and reused afterwards, so the lookup at draw time is a map find.
+class ShaderVariants
+{
+public:
+    // features: one #define name per key bit, starting with bit 0
+    // baseDefines: defines shared by every variant, e.g. "NR_POINT_LIGHTS 4"
+    ShaderVariants(const char* vertexPath, const char* fragmentPath,
+        const std::vector<std::string>& features, const std::vector<std::string>& baseDefines = std::vector<std::string>())
+        : vertexPath(vertexPath), fragmentPath(fragmentPath), features(features), baseDefines(baseDefines)
+    {
+    }
+
+    // returns the program for the given feature bitmask, compiling it on first use
+    Shader& get(unsigned int key)
+    {
+        std::map<unsigned int, std::unique_ptr<Shader>>::iterator it = variants.find(key);
+        if (it != variants.end())
+            return *it->second;
+
+        std::unique_ptr<Shader> shader(new Shader(vertexPath.c_str(), fragmentPath.c_str(), definesFor(key)));
+        Shader& result = *shader;
+        variants[key] = std::move(shader);
+        return result;
+    }
+
+    // builds every listed variant now, so that switching features never stalls a frame
+    void precompile(const std::vector<unsigned int>& keys)
+    {
+        for (unsigned int key : keys)
+            get(key);
+    }
+
+    // hot reload: forwards to every variant built so far, returns true if any program was replaced
+    bool reloadIfChanged()
+    {
+        bool reloaded = false;
+        for (std::map<unsigned int, std::unique_ptr<Shader>>::value_type& variant : variants)
+            reloaded = variant.second->reloadIfChanged() || reloaded;
+        return reloaded;
+    }
+
+    // builds every combination of the features
+    void precompileAll()
+    {
+        for (unsigned int key = 0; key < (1u << features.size()); key++)
+            get(key);
+    }
+
+private:
+    std::string vertexPath;
+    std::string fragmentPath;
+    std::vector<std::string> features;
+    std::vector<std::string> baseDefines;
+    std::map<unsigned int, std::unique_ptr<Shader>> variants;
+
+    std::vector<std::string> definesFor(unsigned int key) const
+    {
+        std::vector<std::string> defines = baseDefines;
+        for (size_t bit = 0; bit < features.size(); bit++)
+        {
+            if (key & (1u << bit))
+                defines.push_back(features[bit]);
+        }
+        return defines;
+    }
+};
+
+#endif
@@ -0,0 +1,334 @@
+#include "shadow_atlas.h"
+#include "frustum.h"
+#include "texture_memory.h"
+#include <glad/glad.h>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <glm/gtc/matrix_transform.hpp>
+
+// cube face order shared with CalcPointShadow in shadow_atlas.glsl: +X, -X, +Y, -Y, +Z, -Z
+static const glm::vec3 faceAxes[6] = {
+    glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(-1.0f, 0.0f, 0.0f),
+    glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f),
+    glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f, -1.0f)
+};
+static const glm::vec3 faceUps[6] = {
+    glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f),
+    glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f, -1.0f),
+    glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f)
+};
+
+ShadowAtlas::ShadowAtlas(int size, int faceBudget) : size(size), faceBudget(faceBudget) {
+    glGenTextures(1, &depthTexture);
+    glBindTexture(GL_TEXTURE_2D, depthTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, size, size, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    TextureMemory::shared().track(depthTexture, GL_TEXTURE_2D, TEXTURES_RENDER_TARGETS);
+
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        std::cout << "Shadow atlas framebuffer not complete!" << std::endl;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    // the whole atlas starts out as one free block
+    freeBlocks[size].push_back(glm::ivec2(0));
+}
+
+ShadowAtlas::~ShadowAtlas() {
+    glDeleteFramebuffers(1, &fbo);
+    TextureMemory::shared().untrack(depthTexture);
+    glDeleteTextures(1, &depthTexture);
+}
+
+bool ShadowAtlas::allocateTile(int tileSize, glm::ivec2& tile) {
+    // smallest free block that fits, split down to the requested size
+    int blockSize = tileSize;
+    while (blockSize <= size && freeBlocks[blockSize].empty())
+        blockSize *= 2;
+    if (blockSize > size)
+        return false;
+
+    tile = freeBlocks[blockSize].back();
+    freeBlocks[blockSize].pop_back();
+    while (blockSize > tileSize) {
+        blockSize /= 2;
+        freeBlocks[blockSize].push_back(tile + glm::ivec2(blockSize, 0));
+        freeBlocks[blockSize].push_back(tile + glm::ivec2(0, blockSize));
+        freeBlocks[blockSize].push_back(tile + glm::ivec2(blockSize, blockSize));
+    }
+    return true;
+}
+
+void ShadowAtlas::freeTile(int tileSize, const glm::ivec2& tile) {
+    glm::ivec2 block = tile;
+    int blockSize = tileSize;
+    // merge with the three buddies for as long as they are all free
+    while (blockSize < size) {
+        glm::ivec2 parent = (block / (2 * blockSize)) * (2 * blockSize);
+        std::vector<glm::ivec2>& blocks = freeBlocks[blockSize];
+        std::vector<std::vector<glm::ivec2>::iterator> buddies;
+        for (int i = 0; i < 4; i++) {
+            glm::ivec2 buddy = parent + glm::ivec2((i & 1) * blockSize, (i >> 1) * blockSize);
+            if (buddy == block)
+                continue;
+            std::vector<glm::ivec2>::iterator it = std::find(blocks.begin(), blocks.end(), buddy);
+            if (it == blocks.end())
+                break;
+            buddies.push_back(it);
+        }
+        if (buddies.size() != 3)
+            break;
+        std::vector<glm::ivec2> remaining;
+        for (const glm::ivec2& free : blocks) {
+            if (free.x < parent.x || free.y < parent.y || free.x >= parent.x + 2 * blockSize || free.y >= parent.y + 2 * blockSize)
+                remaining.push_back(free);
+        }
+        blocks.swap(remaining);
+        block = parent;
+        blockSize *= 2;
+    }
+    freeBlocks[blockSize].push_back(block);
+}
+
+void ShadowAtlas::releaseLight(LightSlot& light) {
+    for (int f = 0; f < light.faceCount; f++) {
+        Face& face = light.faces[f];
+        if (light.tileSize > 0)
+            freeTile(light.tileSize, face.tile);
+        face.rendered = false;
+        face.renderedCasters.clear();
+    }
+    light.tileSize = 0;
+}
+
+void ShadowAtlas::assignTiles(LightSlot& light, float importance) {
+    int desired = tileSizeFor(importance);
+    // shrink only once the light is clearly below the threshold, so it does not flip every frame
+    if (desired < light.tileSize && tileSizeFor(importance * 1.25f) >= light.tileSize)
+        desired = light.tileSize;
+    if (desired == light.tileSize)
+        return;
+
+    releaseLight(light);
+    for (int tileSize = desired; tileSize >= MIN_TILE && light.tileSize == 0; tileSize /= 2) {
+        int allocated = 0;
+        while (allocated < light.faceCount && allocateTile(tileSize, light.faces[allocated].tile))
+            allocated++;
+        if (allocated == light.faceCount) {
+            light.tileSize = tileSize;
+        }
+        else {
+            for (int f = 0; f < allocated; f++)
+                freeTile(tileSize, light.faces[f].tile);
+        }
+    }
+}
+
+void ShadowAtlas::invalidate() {
+    for (LightSlot& light : lights)
+        for (Face& face : light.faces)
+            face.invalidated = true;
+}
+
+int ShadowAtlas::tileSizeFor(float importance) {
+    // importance ~ fraction of the half screen height the light's reach can cover
+    if (importance >= 1.0f) return MAX_TILE;
+    if (importance >= 0.5f) return MAX_TILE / 2;
+    if (importance >= 0.25f) return MAX_TILE / 4;
+    return MIN_TILE;
+}
+
+glm::mat4 ShadowAtlas::faceViewProjection(const glm::vec3& position, float range, int face, int tileSize) {
+    // widen the 90 degree face by 1.5 texels on every side, so filtering near a face edge
+    // never reads a neighbouring tile
+    float halfExtent = 1.0f + 3.0f / (float)tileSize;
+    glm::mat4 projection = glm::perspective(2.0f * std::atan(halfExtent), 1.0f, 0.05f, range);
+    return projection * glm::lookAt(position, position + faceAxes[face], faceUps[face]);
+}
+
+glm::mat4 ShadowAtlas::spotViewProjection(const SpotShadowRequest& spot, int tileSize) {
+    // the outer cone plus the same 1.5 texel margin as the cube faces (CalcSpotShadow matches it)
+    float sinOuter = std::sqrt(std::max(0.0f, 1.0f - spot.outerCutOff * spot.outerCutOff));
+    float halfExtent = sinOuter / std::max(spot.outerCutOff, 0.01f) * (1.0f + 3.0f / (float)tileSize);
+    glm::vec3 direction = glm::normalize(spot.direction);
+    glm::vec3 up = std::abs(direction.y) > 0.99f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+    glm::mat4 projection = glm::perspective(2.0f * std::atan(halfExtent), 1.0f, 0.1f, spot.range);
+    return projection * glm::lookAt(spot.position, spot.position + direction, up);
+}
+
+void ShadowAtlas::update(const std::vector<ShadowLightRequest>& pointLights, const std::vector<SpotShadowRequest>& spotLights,
+    const glm::vec3& cameraPosition, float fovy, const std::vector<ShadowCaster>& casters,
+    const glm::mat4& mainViewProjection, const std::vector<size_t>& mainViewCasters, Shader& depthShader) {
+    const size_t pointCount = pointLights.size();
+    const size_t lightCount = pointCount + spotLights.size();
+    // slots are matched to lights by index, start over if the light lists changed shape
+    if (lights.size() != lightCount || pointLightViews.size() != pointCount) {
+        for (LightSlot& light : lights)
+            releaseLight(light);
+        lights.assign(lightCount, LightSlot());
+        for (size_t i = pointCount; i < lightCount; i++)
+            lights[i].faceCount = 1;
+    }
+
+    // screen importance: how much of the view the light's reach can cover
+    float tanHalfFov = std::tan(fovy * 0.5f);
+    std::vector<float> importance(lightCount);
+    std::vector<size_t> order(lightCount);
+    for (size_t i = 0; i < lightCount; i++) {
+        glm::vec3 position = i < pointCount ? pointLights[i].position : spotLights[i - pointCount].position;
+        float range = i < pointCount ? pointLights[i].range : spotLights[i - pointCount].range;
+        float distance = glm::length(position - cameraPosition);
+        importance[i] = distance <= range ? 1.0f : range / (distance * tanHalfFov);
+        order[i] = i;
+    }
+    // most important lights pick their tiles first, so they get the space when it runs out
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return importance[a] > importance[b]; });
+    for (size_t i : order)
+        assignTiles(lights[i], importance[i]);
+
+    // find the out-of-date views
+    struct DirtyView {
+        size_t light;
+        int face;
+        float priority;
+        glm::mat4 viewProjection;
+        std::vector<ShadowCasterBounds> casters;
+    };
+    std::vector<DirtyView> dirtyViews;
+    pointLightViews.assign(pointCount, -1);
+    spotLightViews.assign(spotLights.size(), -1);
+    int nextView = 0;
+    for (size_t i = 0; i < lightCount; i++) {
+        LightSlot& light = lights[i];
+        if (light.tileSize == 0 || nextView + light.faceCount > MAX_VIEWS)
+            continue;
+        bool isSpot = i >= pointCount;
+        (isSpot ? spotLightViews[i - pointCount] : pointLightViews[i]) = nextView;
+        nextView += light.faceCount;
+
+        for (int f = 0; f < light.faceCount; f++) {
+            Face& face = light.faces[f];
+            glm::mat4 viewProjection = isSpot ? spotViewProjection(spotLights[i - pointCount], light.tileSize)
+                : faceViewProjection(pointLights[i].position, pointLights[i].range, f, light.tileSize);
+            Frustum frustum(viewProjection);
+            std::vector<ShadowCasterBounds> inside;
+            for (const ShadowCaster& caster : casters) {
+                if (caster.dynamic && frustum.intersectsSphere(caster.bounds.center, caster.bounds.radius))
+                    inside.push_back(caster.bounds);
+            }
+            bool castersChanged = inside.size() != face.renderedCasters.size();
+            for (size_t c = 0; c < inside.size() && !castersChanged; c++) {
+                castersChanged = inside[c].center != face.renderedCasters[c].center
+                    || inside[c].radius != face.renderedCasters[c].radius;
+            }
+            if (face.rendered && !face.invalidated && !castersChanged && viewProjection == face.renderedViewProjection)
+                continue;
+
+            // spot views first, then empty tiles, then by importance with waiting faces slowly moving up
+            float priority = isSpot ? 1.0e6f
+                : (face.rendered ? 0.0f : 1000.0f) + importance[i] * (1.0f + face.staleFrames);
+            DirtyView dirtyView = { i, f, priority, viewProjection, inside };
+            dirtyViews.push_back(dirtyView);
+        }
+    }
+    std::sort(dirtyViews.begin(), dirtyViews.end(),
+        [](const DirtyView& a, const DirtyView& b) { return a.priority > b.priority; });
+
+    // spot views are always drawn, point faces up to the budget
+    std::vector<const DirtyView*> toRender;
+    int pointFacesRendered = 0;
+    facesPending = 0;
+    for (const DirtyView& dirtyView : dirtyViews) {
+        if (dirtyView.light >= pointCount || pointFacesRendered < faceBudget) {
+            toRender.push_back(&dirtyView);
+            if (dirtyView.light < pointCount)
+                pointFacesRendered++;
+        }
+        else {
+            lights[dirtyView.light].faces[dirtyView.face].staleFrames++;
+            facesPending++;
+        }
+    }
+    facesRendered = (int)toRender.size();
+    castersDrawn = 0;
+    if (toRender.empty())
+        return;
+
+    GLint previousViewport[4];
+    glGetIntegerv(GL_VIEWPORT, previousViewport);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glEnable(GL_SCISSOR_TEST);
+    glEnable(GL_DEPTH_TEST);
+    glDepthMask(GL_TRUE);
+    glEnable(GL_POLYGON_OFFSET_FILL);
+    glPolygonOffset(1.5f, 4.0f);
+    depthShader.use();
+
+    Frustum mainFrustum(mainViewProjection);
+    for (const DirtyView* dirtyView : toRender) {
+        int tileSize = lights[dirtyView->light].tileSize;
+        Face& face = lights[dirtyView->light].faces[dirtyView->face];
+
+        glViewport(face.tile.x, face.tile.y, tileSize, tileSize);
+        glScissor(face.tile.x, face.tile.y, tileSize, tileSize);
+        glClear(GL_DEPTH_BUFFER_BIT);
+        depthShader.setMat4("lightSpaceMatrix", dirtyView->viewProjection);
+
+        // a view inside the camera frustum can only contain casters the camera already kept
+        Frustum frustum(dirtyView->viewProjection);
+        bool insideMainView = mainFrustum.containsFrustum(dirtyView->viewProjection, 0.05f);
+        size_t candidateCount = insideMainView ? mainViewCasters.size() : casters.size();
+        for (size_t c = 0; c < candidateCount; c++) {
+            const ShadowCaster& caster = casters[insideMainView ? mainViewCasters[c] : c];
+            if (!frustum.intersectsSphere(caster.bounds.center, caster.bounds.radius))
+                continue;
+            caster.draw(depthShader);
+            castersDrawn++;
+        }
+
+        face.rendered = true;
+        face.invalidated = false;
+        face.renderedViewProjection = dirtyView->viewProjection;
+        face.renderedCasters = dirtyView->casters;
+        face.staleFrames = 0;
+    }
+
+    glDisable(GL_POLYGON_OFFSET_FILL);
+    glDisable(GL_SCISSOR_TEST);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(previousViewport[0], previousViewport[1], previousViewport[2], previousViewport[3]);
+}
+
+void ShadowAtlas::setAtlasUniforms(Shader& shader, int textureUnit) const {
+    glActiveTexture(GL_TEXTURE0 + textureUnit);
+    glBindTexture(GL_TEXTURE_2D, depthTexture);
+    shader.setInt("shadowAtlas", textureUnit);
+    for (size_t i = 0; i < lights.size(); i++) {
+        int firstView = i < pointLightViews.size() ? pointLightViews[i] : spotLightViews[i - pointLightViews.size()];
+        if (firstView < 0)
+            continue;
+        const LightSlot& light = lights[i];
+        for (int f = 0; f < light.faceCount; f++) {
+            const Face& face = light.faces[f];
+            std::string index = "[" + std::to_string(firstView + f) + "]";
+            // a view that was never drawn reads as unshadowed until it gets its turn
+            glm::vec4 rect = face.rendered
+                ? glm::vec4(glm::vec2(face.tile) / (float)size, glm::vec2((float)light.tileSize / (float)size))
+                : glm::vec4(0.0f);
+            shader.setMat4("shadowViewProj" + index, face.renderedViewProjection);
+            shader.setVec4("shadowAtlasRect" + index, rect);
+        }
+    }
+}
@@ -0,0 +1,76 @@
+#ifndef SHADOW_ATLAS_GLSL
+#define SHADOW_ATLAS_GLSL
+
+// Shadow views packed into the shared depth atlas (see ShadowAtlas).
+// A point light owns six consecutive views, one per cube face in the order
+// +X, -X, +Y, -Y, +Z, -Z, starting at the index the application passes in;
+// a spot light owns a single perspective view.
+
+#define MAX_SHADOW_VIEWS 28
+
+uniform sampler2DShadow shadowAtlas;
+uniform mat4 shadowViewProj[MAX_SHADOW_VIEWS];
+uniform vec4 shadowAtlasRect[MAX_SHADOW_VIEWS]; // xy: tile offset, zw: tile size, in atlas uv; 0 = not drawn yet
+
+// 3x3 PCF inside one tile; 1.0 = lit, 0.0 = shadowed
+float SampleShadowView(int view, vec3 worldPos) {
+    vec4 rect = shadowAtlasRect[view];
+    if (rect.z <= 0.0)
+        return 1.0;
+    vec4 clip = shadowViewProj[view] * vec4(worldPos, 1.0);
+    vec3 projCoords = clip.xyz / clip.w * 0.5 + 0.5;
+    if (projCoords.z >= 1.0)
+        return 1.0;
+
+    // keep every tap inside the tile, the views are rendered 1.5 texels wider than needed
+    vec2 texelSize = 1.0 / vec2(textureSize(shadowAtlas, 0));
+    vec2 minUV = rect.xy + texelSize * 0.5;
+    vec2 maxUV = rect.xy + rect.zw - texelSize * 0.5;
+    vec2 uv = rect.xy + projCoords.xy * rect.zw;
+    float lit = 0.0;
+    for (int x = -1; x <= 1; x++) {
+        for (int y = -1; y <= 1; y++) {
+            lit += texture(shadowAtlas, vec3(clamp(uv + vec2(x, y) * texelSize, minUV, maxUV), projCoords.z));
+        }
+    }
+    return lit / 9.0;
+}
+
+float CalcPointShadow(int firstView, vec3 lightPos, vec3 fragPos, vec3 normal) {
+    if (firstView < 0)
+        return 1.0;
+    vec3 toFrag = fragPos - lightPos;
+    vec3 absToFrag = abs(toFrag);
+    int face;
+    float major;
+    if (absToFrag.x >= absToFrag.y && absToFrag.x >= absToFrag.z) {
+        face = toFrag.x > 0.0 ? 0 : 1;
+        major = absToFrag.x;
+    }
+    else if (absToFrag.y >= absToFrag.z) {
+        face = toFrag.y > 0.0 ? 2 : 3;
+        major = absToFrag.y;
+    }
+    else {
+        face = toFrag.z > 0.0 ? 4 : 5;
+        major = absToFrag.z;
+    }
+
+    // normal offset of ~1.5 texels; a texel grows linearly with the distance to the light
+    float tileTexels = shadowAtlasRect[firstView + face].z * float(textureSize(shadowAtlas, 0).x);
+    float texelWorld = 2.0 * major / max(tileTexels, 1.0);
+    return SampleShadowView(firstView + face, fragPos + normal * texelWorld * 1.5);
+}
+
+float CalcSpotShadow(int view, vec3 lightPos, float outerCutOff, vec3 fragPos, vec3 normal) {
+    if (view < 0)
+        return 1.0;
+    // the view covers the outer cone (ShadowAtlas::spotViewProjection), so a texel spans
+    // 2 * depth * tan(outer angle) / tile texels
+    float tanOuter = sqrt(max(1.0 - outerCutOff * outerCutOff, 0.0)) / max(outerCutOff, 0.01);
+    float tileTexels = shadowAtlasRect[view].z * float(textureSize(shadowAtlas, 0).x);
+    float texelWorld = 2.0 * length(fragPos - lightPos) * tanOuter / max(tileTexels, 1.0);
+    return SampleShadowView(view, fragPos + normal * texelWorld * 1.5);
+}
+
+#endif
@@ -0,0 +1,123 @@
+#ifndef SHADOW_ATLAS_H
+#define SHADOW_ATLAS_H
+
+#include <glm/glm.hpp>
+#include <functional>
+#include <map>
+#include <vector>
+#include "Shader.h"
+
+// bounding sphere of a shadow caster
+struct ShadowCasterBounds {
+    glm::vec3 center;
+    float radius;
+};
+
+// one object that can be drawn into shadow maps; draw sets its own "model" on the shader
+struct ShadowCaster {
+    ShadowCasterBounds bounds;
+    bool dynamic; // may move between frames
+    std::function<void(Shader&)> draw;
+};
+
+// a point light that casts shadows this frame
+struct ShadowLightRequest {
+    glm::vec3 position;
+    float range; // far plane of its shadow views, i.e. the light's reach
+};
+
+// a spot light that casts shadows this frame
+struct SpotShadowRequest {
+    glm::vec3 position;
+    glm::vec3 direction;
+    float outerCutOff; // cosine of the outer cone angle
+    float range;
+};
+
+// Point and spot light shadows, packed into one shared depth atlas.
+//
+// Every shadowed point light gets six square tiles (one per cube face), every spot light
+// one. Their size is picked from how much of the screen the light can cover, and the tiles
+// are handed out by a buddy allocator, so lights can grow and shrink without repacking
+// the others.
+//
+// A view only needs redrawing when its light moved, its tile changed or the set of dynamic
+// casters inside it changed; everything else keeps the depth it was rendered with (and the
+// matrix that goes with it). Point light faces share a budget of faceBudget redraws per
+// frame; spot views are always brought up to date, they are a single depth pass each.
+//
+// Casters are culled to each view's frustum. A view that lies entirely inside the main
+// camera's frustum (the flashlight) only considers the casters that survived main-view
+// culling, everything else tests the full caster list.
+class ShadowAtlas {
+public:
+    static const int MAX_VIEWS = 28;  // must match MAX_SHADOW_VIEWS in shadow_atlas.glsl
+    static const int MIN_TILE = 64;
+    static const int MAX_TILE = 512;
+
+    ShadowAtlas(int size = 4096, int faceBudget = 8);
+    ~ShadowAtlas();
+
+    // Assigns tiles to the lights and redraws the out-of-date views. mainViewCasters are the
+    // indices into casters that are visible from mainViewProjection.
+    void update(const std::vector<ShadowLightRequest>& pointLights, const std::vector<SpotShadowRequest>& spotLights,
+        const glm::vec3& cameraPosition, float fovy, const std::vector<ShadowCaster>& casters,
+        const glm::mat4& mainViewProjection, const std::vector<size_t>& mainViewCasters, Shader& depthShader);
+
+    // index of the first of each point light's six views, -1 if the light has no shadow
+    const std::vector<int>& getPointLightViews() const { return pointLightViews; }
+    // view of each spot light, -1 if the light has no shadow
+    const std::vector<int>& getSpotLightViews() const { return spotLightViews; }
+
+    // binds the atlas to textureUnit and sets the shadow_atlas.glsl uniforms
+    void setAtlasUniforms(Shader& shader, int textureUnit) const;
+
+    // forces every view to be redrawn, e.g. after static geometry moved
+    void invalidate();
+
+    void setFaceBudget(int faces) { faceBudget = faces; }
+    int getFacesRendered() const { return facesRendered; }  // views redrawn by the last update
+    int getFacesPending() const { return facesPending; }    // out-of-date point faces left for later frames
+    int getCastersDrawn() const { return castersDrawn; }    // caster draws issued by the last update
+
+private:
+    struct Face {
+        glm::ivec2 tile = glm::ivec2(0);
+        bool rendered = false;                     // holds depth for the current tile
+        bool invalidated = false;                  // redraw requested, the old depth is still usable
+        glm::mat4 renderedViewProjection = glm::mat4(1.0f);
+        std::vector<ShadowCasterBounds> renderedCasters; // dynamic casters it was drawn with
+        int staleFrames = 0;
+    };
+    // a light's tiles: six faces for a point light, the first face only for a spot light
+    struct LightSlot {
+        int tileSize = 0; // 0: no tiles, the light is unshadowed
+        int faceCount = 6;
+        Face faces[6];
+    };
+
+    int size;
+    int faceBudget;
+    unsigned int depthTexture = 0;
+    unsigned int fbo = 0;
+
+    std::vector<LightSlot> lights;  // point lights, then spot lights
+    std::vector<int> pointLightViews;
+    std::vector<int> spotLightViews;
+    int facesRendered = 0;
+    int facesPending = 0;
+    int castersDrawn = 0;
+
+    // buddy allocator: free square blocks by edge length
+    std::map<int, std::vector<glm::ivec2>> freeBlocks;
+    bool allocateTile(int tileSize, glm::ivec2& tile);
+    void freeTile(int tileSize, const glm::ivec2& tile);
+    void releaseLight(LightSlot& light);
+    void assignTiles(LightSlot& light, float importance);
+
+    static int tileSizeFor(float importance);
+    static glm::mat4 faceViewProjection(const glm::vec3& position, float range, int face, int tileSize);
+    static glm::mat4 spotViewProjection(const SpotShadowRequest& spot, int tileSize);
+};
+
+#endif
@@ -0,0 +1,6 @@
+#version 330 core
+
+// depth-only pass, the depth buffer is all that is written
+void main()
+{
+}
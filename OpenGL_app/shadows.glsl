@@ -0,0 +1,47 @@
+#ifndef SHADOWS_GLSL
+#define SHADOWS_GLSL
+
+// Cascaded shadow maps of the directional light (see CascadedShadowMap).
+// Cascades are picked by view depth; each one is sampled with a 3x3 grid of
+// hardware-compared taps and the lookup position is pushed out along the
+// normal by about a texel to avoid acne without a large depth bias.
+
+#define MAX_CASCADES 4
+
+uniform sampler2DArrayShadow cascadeShadowMap;
+uniform mat4 cascadeLightSpace[MAX_CASCADES];
+uniform float cascadeSplits[MAX_CASCADES];    // view depth where each cascade ends
+uniform float cascadeTexelSize[MAX_CASCADES]; // world size of one texel
+uniform int cascadeCount;
+uniform mat4 cameraView;
+
+// 1.0 = fully lit, 0.0 = fully shadowed
+float CalcCascadeShadow(vec3 fragPos, vec3 normal) {
+    float viewDepth = -(cameraView * vec4(fragPos, 1.0)).z;
+    int cascade = cascadeCount;
+    for (int i = 0; i < cascadeCount; i++) {
+        if (viewDepth < cascadeSplits[i]) {
+            cascade = i;
+            break;
+        }
+    }
+    if (cascade >= cascadeCount)
+        return 1.0;
+
+    vec3 samplePos = fragPos + normal * cascadeTexelSize[cascade] * 1.5;
+    vec4 lightSpacePos = cascadeLightSpace[cascade] * vec4(samplePos, 1.0);
+    vec3 projCoords = lightSpacePos.xyz / lightSpacePos.w * 0.5 + 0.5;
+    if (projCoords.z > 1.0)
+        return 1.0;
+
+    vec2 texelSize = 1.0 / vec2(textureSize(cascadeShadowMap, 0).xy);
+    float lit = 0.0;
+    for (int x = -1; x <= 1; x++) {
+        for (int y = -1; y <= 1; y++) {
+            lit += texture(cascadeShadowMap, vec4(projCoords.xy + vec2(x, y) * texelSize, float(cascade), projCoords.z));
+        }
+    }
+    return lit / 9.0;
+}
+
+#endif
@@ -0,0 +1,110 @@
+#include "simulation.h"
+#include <algorithm>
+#include <cmath>
+#include <glm/gtc/constants.hpp>
+
+constexpr double Simulation::DEFAULT_TICK_RATE;
+constexpr float Simulation::DAY_LENGTH;
+const int Simulation::MAX_TICKS_BEHIND;
+
+namespace {
+    // interpolates on a circle of the given period, the short way round
+    float mixWrapped(float from, float to, float alpha, float period) {
+        float difference = to - from;
+        if (difference > period * 0.5f)
+            difference -= period;
+        else if (difference < -period * 0.5f)
+            difference += period;
+        float value = std::fmod(from + difference * alpha, period);
+        return value < 0.0f ? value + period : value;
+    }
+}
+
+Simulation::Simulation(double tickRate)
+    : tickRate(tickRate),
+      tickLength(std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / tickRate))) {
+    current = step(SimulationState(), 0.0);
+    previous = current;
+    currentTick = Clock::now();
+    thread = std::thread(&Simulation::run, this);
+}
+
+Simulation::~Simulation() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quitting = true;
+    }
+    wake.notify_all();
+    thread.join();
+}
+
+long long Simulation::getTickCount() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return tickCount;
+}
+
+SimulationState Simulation::sample() const {
+    SimulationState from, to;
+    Clock::time_point tick;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        from = previous;
+        to = current;
+        tick = currentTick;
+    }
+    double alpha = std::chrono::duration<double>(Clock::now() - tick).count() * tickRate;
+    return interpolate(from, to, static_cast<float>(std::min(std::max(alpha, 0.0), 1.0)));
+}
+
+SimulationState Simulation::step(const SimulationState& state, double seconds) const {
+    SimulationState next;
+    next.time = state.time + seconds;
+    next.timeOfDay = std::fmod(state.timeOfDay + static_cast<float>(seconds * 1000.0), DAY_LENGTH);
+    next.skyRotation = std::fmod(state.skyRotation + SKY_ROTATE_SPEED * static_cast<float>(seconds), 360.0f);
+
+    const double t = next.time;
+    next.backpackPosition = glm::vec3(15.0f + std::abs(std::sin(t)) * 5.0f, 1.0f, 15.0f + std::abs(std::cos(t)) * 5.0f);
+    next.backpackAngle = static_cast<float>(std::fmod(t, 2.0 * glm::pi<double>()));
+    next.sphereOffset = glm::vec3(static_cast<float>(std::sin(t * SPHERE_SPEED)) * SPHERE_MOVEMENT_RANGE, 0.0f, 0.0f);
+    return next;
+}
+
+SimulationState Simulation::interpolate(const SimulationState& from, const SimulationState& to, float alpha) {
+    SimulationState state;
+    state.time = from.time + (to.time - from.time) * alpha;
+    state.timeOfDay = mixWrapped(from.timeOfDay, to.timeOfDay, alpha, DAY_LENGTH);
+    state.skyRotation = mixWrapped(from.skyRotation, to.skyRotation, alpha, 360.0f);
+    state.backpackPosition = glm::mix(from.backpackPosition, to.backpackPosition, alpha);
+    state.backpackAngle = mixWrapped(from.backpackAngle, to.backpackAngle, alpha, 2.0f * glm::pi<float>());
+    state.sphereOffset = glm::mix(from.sphereOffset, to.sphereOffset, alpha);
+    return state;
+}
+
+void Simulation::run() {
+    const double seconds = 1.0 / tickRate;
+    Clock::time_point due = currentTick + tickLength;
+    // only this thread writes current, so it reads it without the lock
+    SimulationState state = current;
+
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        if (wake.wait_until(lock, due, [this] { return quitting; }))
+            return;
+
+        lock.unlock();
+        SimulationState next = step(state, seconds);
+        lock.lock();
+
+        previous = current;
+        current = next;
+        currentTick = due;
+        tickCount++;
+        state = next;
+
+        due += tickLength;
+        // too far behind: drop the missed ticks instead of running them back to back
+        const Clock::time_point now = Clock::now();
+        if (now - due > tickLength * MAX_TICKS_BEHIND)
+            due = now;
+    }
+}
@@ -0,0 +1,72 @@
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <glm/glm.hpp>
+
+// Everything that moves on its own, as of one simulation tick.
+struct SimulationState {
+    double time = 0.0;              // simulated seconds since start
+    float timeOfDay = 0.0f;         // milliseconds in [0, Simulation::DAY_LENGTH)
+    float skyRotation = 0.0f;       // degrees about +Y, in [0, 360)
+    glm::vec3 backpackPosition = glm::vec3(0.0f);
+    float backpackAngle = 0.0f;     // radians about +Z, in [0, 2 pi)
+    glm::vec3 sphereOffset = glm::vec3(0.0f); // of the moving sphere from its centre
+};
+
+// Advances the scene at a fixed rate on a thread of its own, independent of the frame rate.
+//
+// The thread keeps the last two states; the renderer samples between them by how far the
+// clock is past the newer one, so motion stays smooth at any frame rate at the cost of one
+// tick of latency. Every tick adds the same step in double precision, so the time of day no
+// longer drifts or stalls with the frame time.
+class Simulation {
+public:
+    static constexpr double DEFAULT_TICK_RATE = 60.0;
+    static constexpr float DAY_LENGTH = 24000.0f;     // milliseconds of time of day per cycle
+
+    // starts ticking right away
+    explicit Simulation(double tickRate = DEFAULT_TICK_RATE);
+    ~Simulation();
+
+    Simulation(const Simulation&) = delete;
+    Simulation& operator=(const Simulation&) = delete;
+
+    // the state interpolated for now; call once per frame and use it for the whole frame
+    SimulationState sample() const;
+
+    double getTickRate() const { return tickRate; }
+    long long getTickCount() const;
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    const double tickRate;
+    const Clock::duration tickLength;
+
+    mutable std::mutex mutex;
+    SimulationState previous;
+    SimulationState current;
+    Clock::time_point currentTick; // when current was due
+    long long tickCount = 0;
+
+    std::condition_variable wake;
+    bool quitting = false;
+    std::thread thread;
+
+    // a tick this far behind the clock (a debugger stop, a suspended laptop) is not caught up
+    static const int MAX_TICKS_BEHIND = 5;
+    const float SKY_ROTATE_SPEED = 10.0f;    // degrees per second
+    const float SPHERE_MOVEMENT_RANGE = 2.0f; // how far the sphere moves along X
+    const float SPHERE_SPEED = 1.0f;
+
+    // state advanced by seconds
+    SimulationState step(const SimulationState& state, double seconds) const;
+    static SimulationState interpolate(const SimulationState& from, const SimulationState& to, float alpha);
+    void run();
+};
+
+#endif
@@ -1,12 +1,19 @@
 #include "Skybox.h"
+#include <chrono>
 #include <iostream>
+#include "job_system.h"
 #include "stb_image.h"
+#include "texture_cache.h"
+#include "texture_memory.h"
 
 Skybox::Skybox( Shader& shader)
     : skyboxShader(shader) {
   
-    dayCubemapTexture = loadCubemap(dayFaces);
-    nightCubemapTexture = loadCubemap(nightFaces);
+    auto start = std::chrono::steady_clock::now();
+    dayCubemapTexture = loadCubemap(dayFaces, dayCooked);
+    nightCubemapTexture = loadCubemap(nightFaces, nightCooked);
+    std::cout << "Skybox loaded in " << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count()
+        << " ms" << std::endl;
 
     // Skybox vertices
     float skyboxVertices[] = {
@@ -74,25 +81,41 @@ Skybox::~Skybox() {
     glDeleteBuffers(1, &skyboxVBO);
 }
 
-unsigned int Skybox::loadCubemap(const std::vector<std::string>& faces)
+unsigned int Skybox::loadCubemap(const std::vector<std::string>& faces, const std::string& cookedPath)
 {
-    unsigned int textureID;
+    unsigned int textureID = loadCookedCubemap(faces, cookedPath);
+    if (textureID != 0)
+    {
+        TextureMemory::shared().track(textureID, GL_TEXTURE_CUBE_MAP, TEXTURES_SKYBOX);
+        return textureID;
+    }
+
+    // decode the faces in parallel; only the uploads have to be on this thread
+    struct Face {
+        unsigned char* data = nullptr;
+        int width = 0, height = 0;
+    };
+    std::vector<Face> decoded(faces.size());
+    JobSystem::shared().parallelFor(0, static_cast<int>(faces.size()), 1, [&faces, &decoded](int first, int last) {
+        for (int i = first; i < last; i++)
+        {
+            int nrChannels;
+            decoded[i].data = stbi_load(faces[i].c_str(), &decoded[i].width, &decoded[i].height, &nrChannels, 3);
+        }
+    });
+
     glGenTextures(1, &textureID);
     glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
-
-    int width, height, nrChannels;
     for (unsigned int i = 0; i < faces.size(); i++)
     {
-        unsigned char* data = stbi_load(faces[i].c_str(), &width, &height, &nrChannels, 0);
-        if (data)
+        if (decoded[i].data)
         {
-            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-            stbi_image_free(data);
+            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, decoded[i].width, decoded[i].height, 0, GL_RGB, GL_UNSIGNED_BYTE, decoded[i].data);
+            stbi_image_free(decoded[i].data);
         }
         else
         {
             std::cout << "Cubemap texture failed to load at path: " << faces[i] << std::endl;
-            stbi_image_free(data);
         }
     }
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
@@ -100,11 +123,12 @@ unsigned int Skybox::loadCubemap(const std::vector<std::string>& faces)
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    TextureMemory::shared().track(textureID, GL_TEXTURE_CUBE_MAP, TEXTURES_SKYBOX);
 
     return textureID;
 }
 
-float Skybox::bindTextures( ) {
+float Skybox::bindTextures(int firstUnit) {
 
     int texture1;
     int texture2;
@@ -143,26 +167,26 @@ float Skybox::bindTextures( ) {
 
 
     // Texture binding logic (comment out if unnecessary in this function)
-    glActiveTexture(GL_TEXTURE0);
+    glActiveTexture(GL_TEXTURE0 + firstUnit);
     glBindTexture(GL_TEXTURE_CUBE_MAP, texture1);
-    glActiveTexture(GL_TEXTURE1);
+    glActiveTexture(GL_TEXTURE0 + firstUnit + 1);
     glBindTexture(GL_TEXTURE_CUBE_MAP, texture2);
 
     return blendFactor;
 }
 
-void Skybox::render(const glm::mat4& view, const glm::mat4& projection, int newTime, float deltaTime) {
+void Skybox::render(const glm::mat4& view, const glm::mat4& projection, float timeOfDay, float rotation) {
     glDepthFunc(GL_LEQUAL);
     glEnable(GL_DEPTH_CLAMP);
 
     skyboxShader.use();
-    glm::mat4 skyboxView = glm::mat4(glm::mat3(view)); // Remove translation
-    rotation += ROTATE_SPEED * deltaTime;
-    this->skyboxTime = newTime;
-    skyboxView = glm::rotate(skyboxView, glm::radians(rotation), glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::mat4 skyboxView = orient(view, timeOfDay, rotation);
     skyboxShader.setMat4("view", skyboxView);
     skyboxShader.setMat4("projection", projection);
 
+    // sampler units are set every frame so they survive a shader hot reload
+    skyboxShader.setInt("skybox", 0);
+    skyboxShader.setInt("skybox_night", 1);
     float blendFactor = bindTextures();
     skyboxShader.setFloat("blendFactor", blendFactor);
 
@@ -173,3 +197,20 @@ void Skybox::render(const glm::mat4& view, const glm::mat4& projection, int newT
     glDepthFunc(GL_LESS);
     glDisable(GL_DEPTH_CLAMP);
 }
+
+glm::mat4 Skybox::orient(const glm::mat4& view, float timeOfDay, float rotation) {
+    glm::mat4 skyboxView = glm::mat4(glm::mat3(view)); // Remove translation
+    this->skyboxTime = timeOfDay;
+    return glm::rotate(skyboxView, glm::radians(rotation), glm::vec3(0.0f, 1.0f, 0.0f));
+}
+
+void Skybox::setLightingPassUniforms(Shader& shader, const glm::mat4& view, const glm::mat4& projection, float timeOfDay, float rotation,
+    int firstUnit) {
+    glm::mat4 skyboxView = orient(view, timeOfDay, rotation);
+    // takes a far-plane point in clip space back to a direction in the cube map
+    shader.setMat4("skyInverseViewProjection", glm::inverse(projection * skyboxView));
+    shader.setInt("skyFrom", firstUnit);
+    shader.setInt("skyTo", firstUnit + 1);
+    // 0 outside the day/night transitions, and the shader then samples one cube map only
+    shader.setFloat("skyBlend", bindTextures(firstUnit));
+}
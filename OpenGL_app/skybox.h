@@ -13,7 +13,14 @@ public:
     Skybox(Shader& shader);
     ~Skybox();
 
-    void render(const glm::mat4& view, const glm::mat4& projection, int newTime, float deltaTime);
+    // timeOfDay and rotation come from the simulation (see SimulationState)
+    void render(const glm::mat4& view, const glm::mat4& projection, float timeOfDay, float rotation);
+
+    // instead of render: the lighting pass (deferred.fs with SKY) fills the pixels at the far
+    // plane from a view ray; binds the cube maps to firstUnit and firstUnit + 1. The shader
+    // must be in use.
+    void setLightingPassUniforms(Shader& shader, const glm::mat4& view, const glm::mat4& projection, float timeOfDay, float rotation,
+        int firstUnit);
 
 private:
     unsigned int dayCubemapTexture;
@@ -21,13 +28,14 @@ private:
     unsigned int skyboxVAO, skyboxVBO;
     Shader& skyboxShader;
 
-    float rotation = 0.0f;
-    int skyboxTime = 0;
+    float skyboxTime = 0.0f;
 
-    unsigned int loadCubemap(const std::vector<std::string>& faces);
-    float bindTextures() ;
+    // the cooked single-file copy at cookedPath, or the faces themselves when it cannot be made
+    unsigned int loadCubemap(const std::vector<std::string>& faces, const std::string& cookedPath);
+    float bindTextures(int firstUnit = 0);
+    // the view of the sky turned by rotation degrees; keeps timeOfDay for bindTextures
+    glm::mat4 orient(const glm::mat4& view, float timeOfDay, float rotation);
 
-    const float ROTATE_SPEED = 10.0f;
     const std::vector<std::string> dayFaces = {
         "skybox/right.jpg", "skybox/left.jpg", "skybox/top.jpg",
         "skybox/bottom.jpg", "skybox/front.jpg", "skybox/back.jpg"
@@ -37,6 +45,8 @@ private:
         "skybox/nightRight.jpg", "skybox/nightLeft.jpg", "skybox/nightTop.jpg",
         "skybox/nightBottom.jpg", "skybox/nightFront.jpg", "skybox/nightBack.jpg"
     };
+    const std::string dayCooked = "skybox/day.ktx2";
+    const std::string nightCooked = "skybox/night.ktx2";
 };
 
 #endif
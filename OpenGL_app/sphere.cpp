@@ -5,8 +5,10 @@
 #include "stb_image.h"
 #include "shader.h"
 
+const unsigned short Sphere::RESTART_INDEX;
+
 // Constructor to initialize the sphere
-Sphere::Sphere() : sphereVAO(0), sphereVBO(0), sphereEBO(0), indexCount(0) {
+Sphere::Sphere() : sphereVAO(0), sphereVBO(0), sphereEBO(0), depthVAO(0), depthVBO(0), lod(0) {
     setupSphere();
     modelMatrix = glm::mat4(1.0f); 
 }
@@ -17,7 +19,7 @@ void Sphere::setupSphere() {
     std::vector<glm::vec3> positions;
     std::vector<glm::vec2> uv;
     std::vector<glm::vec3> normals;
-    std::vector<unsigned int> indices;
+    std::vector<unsigned short> indices;
 
     const unsigned int X_SEGMENTS = 64;
     const unsigned int Y_SEGMENTS = 64;
@@ -38,25 +40,23 @@ void Sphere::setupSphere() {
         }
     }
 
-    bool oddRow = false;
-    for (unsigned int y = 0; y < Y_SEGMENTS; ++y) {
-        if (!oddRow) {
-            for (unsigned int x = 0; x <= X_SEGMENTS; ++x) {
-                indices.push_back(y * (X_SEGMENTS + 1) + x);
-                indices.push_back((y + 1) * (X_SEGMENTS + 1) + x);
-            }
-        }
-        else {
-            for (int x = X_SEGMENTS; x >= 0; --x) {
-                indices.push_back((y + 1) * (X_SEGMENTS + 1) + x);
-                indices.push_back(y * (X_SEGMENTS + 1) + x);
+    // One strip per row, separated by the primitive restart index, and one set of rows per
+    // level of detail, one after the other in the index buffer. The coarser levels skip grid
+    // lines of the full sphere, so they all share its vertices (4225, so 16-bit indices).
+    for (int level = 0; level < LOD_COUNT; ++level) {
+        const int step = 1 << level;
+        lodFirst[level] = static_cast<unsigned int>(indices.size());
+        for (int y = 0; y < (int)Y_SEGMENTS; y += step) {
+            if (y > 0)
+                indices.push_back(RESTART_INDEX);
+            for (int x = 0; x <= (int)X_SEGMENTS; x += step) {
+                indices.push_back(static_cast<unsigned short>(y * (X_SEGMENTS + 1) + x));
+                indices.push_back(static_cast<unsigned short>((y + step) * (X_SEGMENTS + 1) + x));
             }
         }
-        oddRow = !oddRow;
+        lodCount[level] = static_cast<unsigned int>(indices.size()) - lodFirst[level];
     }
 
-    indexCount = static_cast<unsigned int>(indices.size());
-
     // Create buffers and link data to OpenGL
     std::vector<float> data;
     for (unsigned int i = 0; i < positions.size(); ++i) {
@@ -80,7 +80,7 @@ void Sphere::setupSphere() {
     glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(float), &data[0], GL_STATIC_DRAW);
 
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphereEBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned short), &indices[0], GL_STATIC_DRAW);
 
     unsigned int stride = (3 + 3 + 2) * sizeof(float);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
@@ -89,6 +89,17 @@ void Sphere::setupSphere() {
     glEnableVertexAttribArray(1);
     glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void*)(6 * sizeof(float)));
     glEnableVertexAttribArray(2);
+
+    // Tightly packed positions for depth-only passes, sharing the index buffer
+    glGenVertexArrays(1, &depthVAO);
+    glGenBuffers(1, &depthVBO);
+    glBindVertexArray(depthVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, depthVBO);
+    glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(glm::vec3), &positions[0], GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphereEBO);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+    glEnableVertexAttribArray(0);
+    glBindVertexArray(0);
 }
 
 // Update the model matrix for the sphere (position, scaling, etc.)
@@ -96,13 +107,48 @@ void Sphere::updateModelMatrix(const glm::mat4& newModelMatrix) {
     modelMatrix = newModelMatrix;
 }
 
+// Pick the level of detail from the fraction of the viewport height the sphere covers
+int Sphere::selectLod(float screenSize) {
+    lod = lodSelector.select(screenSize, LOD_COUNT);
+    return lod;
+}
+
 // Set shader attributes before rendering the sphere
 void Sphere::setShaderAttributes(Shader& shader) {
     shader.setMat4("model", modelMatrix);
 }
 
+// Primitive restart is only enabled around the sphere's draws: the restart index is compared
+// before the index type is considered, so it would also cut 32-bit index lists
+static void beginRestartStrips() {
+    glEnable(GL_PRIMITIVE_RESTART);
+    glPrimitiveRestartIndex(Sphere::RESTART_INDEX);
+}
+
+static void endRestartStrips() {
+    glDisable(GL_PRIMITIVE_RESTART);
+}
+
 // Render the sphere
 void Sphere::render() {
     glBindVertexArray(sphereVAO);
-    glDrawElements(GL_TRIANGLE_STRIP, indexCount, GL_UNSIGNED_INT, 0);
+    beginRestartStrips();
+    glDrawElements(GL_TRIANGLE_STRIP, lodCount[lod], GL_UNSIGNED_SHORT, (void*)(lodFirst[lod] * sizeof(unsigned short)));
+    endRestartStrips();
+}
+
+// Render positions only
+void Sphere::renderDepthOnly() {
+    glBindVertexArray(depthVAO);
+    beginRestartStrips();
+    glDrawElements(GL_TRIANGLE_STRIP, lodCount[lod], GL_UNSIGNED_SHORT, (void*)(lodFirst[lod] * sizeof(unsigned short)));
+    endRestartStrips();
+}
+
+// Render with a GPU-written draw command
+void Sphere::renderIndirect(const void* command) {
+    glBindVertexArray(sphereVAO);
+    beginRestartStrips();
+    glDrawElementsIndirect(GL_TRIANGLE_STRIP, GL_UNSIGNED_SHORT, command);
+    endRestartStrips();
 }
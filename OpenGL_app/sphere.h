@@ -5,11 +5,26 @@
 #include <vector>
 #include <glad/glad.h>
 #include "Shader.h"
+#include "lod_selector.h"
 
 class Sphere {
 public:
+    // ends a row strip in the index buffer
+    static const unsigned short RESTART_INDEX = 0xFFFF;
+
     Sphere();
     void render();
+    // positions only, for depth-only passes (depth pre-pass, shadow maps)
+    void renderDepthOnly();
+    // draws with the DrawElementsIndirectCommand at offset command of the bound
+    // GL_DRAW_INDIRECT_BUFFER (GL 4.0); an instance count of 0 skips the draw on the GPU
+    void renderIndirect(const void* command);
+    // index range of the current level of detail
+    unsigned int getIndexCount() const { return lodCount[lod]; }
+    unsigned int getFirstIndex() const { return lodFirst[lod]; }
+    // picks the level of detail from the fraction of the viewport height the sphere covers
+    int selectLod(float screenSize);
+    int getLod() const { return lod; }
     void updateModelMatrix(const glm::mat4& modelMatrix);
     void setShaderAttributes(Shader& shader);
 
@@ -17,7 +32,13 @@ private:
     void setupSphere();
 
     unsigned int sphereVAO, sphereVBO, sphereEBO;
-    unsigned int indexCount;
+    unsigned int depthVAO, depthVBO;
+    // 64, 32, 16 and 8 segments around
+    static const int LOD_COUNT = 4;
+    unsigned int lodFirst[LOD_COUNT];
+    unsigned int lodCount[LOD_COUNT];
+    int lod;
+    LodSelector lodSelector;
     glm::mat4 modelMatrix;
 };
 
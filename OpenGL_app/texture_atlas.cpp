@@ -0,0 +1,179 @@
+#include "texture_atlas.h"
+#include "ktx2.h"
+#include "stb_image.h"
+#include "texture_streamer.h"
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+
+namespace {
+    const int PAGE_CELLS = TextureAtlas::PAGE_SIZE / TextureAtlas::ALIGNMENT;
+
+    struct Item {
+        size_t index;       // into the paths
+        int width, height;  // of the image
+        int cellsX, cellsY; // cell size, in ALIGNMENT units
+        int page = -1, x = 0, y = 0;
+    };
+
+    // bottom-left skyline: the height of every cell column of a page
+    struct Skyline {
+        std::vector<int> heights = std::vector<int>(PAGE_CELLS, 0);
+
+        bool place(Item& item) {
+            int bestX = -1, bestY = PAGE_CELLS;
+            for (int x = 0; x + item.cellsX <= PAGE_CELLS; x++) {
+                int y = *std::max_element(heights.begin() + x, heights.begin() + x + item.cellsX);
+                if (y < bestY) {
+                    bestY = y;
+                    bestX = x;
+                }
+            }
+            if (bestX < 0 || bestY + item.cellsY > PAGE_CELLS)
+                return false;
+            std::fill(heights.begin() + bestX, heights.begin() + bestX + item.cellsX, bestY + item.cellsY);
+            item.x = bestX;
+            item.y = bestY;
+            return true;
+        }
+    };
+
+    unsigned long long fnv1a(unsigned long long hash, const void* data, size_t size) {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; i++)
+            hash = (hash ^ bytes[i]) * 1099511628211ull;
+        return hash;
+    }
+
+    int nextPowerOfTwo(int value) {
+        int power = 1;
+        while (power < value)
+            power *= 2;
+        return power;
+    }
+
+    // copies every image of the page into its cell, repeating the edge texels into the gutter
+    bool composePage(const std::vector<std::string>& paths, const std::vector<const Item*>& items, int width, int height,
+        std::vector<unsigned char>& rgba) {
+        rgba.assign(size_t(width) * height * 4, 0);
+        for (size_t i = 3; i < rgba.size(); i += 4)
+            rgba[i] = 255;
+        for (const Item* item : items) {
+            int imageWidth, imageHeight, nrComponents;
+            unsigned char* data = stbi_load(paths[item->index].c_str(), &imageWidth, &imageHeight, &nrComponents, 4);
+            if (!data || imageWidth != item->width || imageHeight != item->height) {
+                stbi_image_free(data);
+                return false;
+            }
+            const int cellX = item->x * TextureAtlas::ALIGNMENT, cellY = item->y * TextureAtlas::ALIGNMENT;
+            for (int y = 0; y < item->cellsY * TextureAtlas::ALIGNMENT; y++) {
+                int sourceY = std::min(std::max(y - TextureAtlas::GUTTER, 0), imageHeight - 1);
+                for (int x = 0; x < item->cellsX * TextureAtlas::ALIGNMENT; x++) {
+                    int sourceX = std::min(std::max(x - TextureAtlas::GUTTER, 0), imageWidth - 1);
+                    const unsigned char* source = data + (size_t(sourceY) * imageWidth + sourceX) * 4;
+                    std::copy(source, source + 4, &rgba[(size_t(cellY + y) * width + cellX + x) * 4]);
+                }
+            }
+            stbi_image_free(data);
+        }
+        return true;
+    }
+}
+
+bool TextureAtlas::isCandidate(const std::string& path) {
+    int width, height, nrComponents;
+    return stbi_info(path.c_str(), &width, &height, &nrComponents) && width <= MAX_IMAGE_SIZE && height <= MAX_IMAGE_SIZE;
+}
+
+std::vector<AtlasPlacement> TextureAtlas::build(const std::vector<std::string>& paths, TextureUsage usage, const std::string& directory) {
+    std::vector<AtlasPlacement> placements(paths.size());
+    std::vector<Item> items;
+    for (size_t i = 0; i < paths.size(); i++) {
+        Item item;
+        int nrComponents;
+        if (!stbi_info(paths[i].c_str(), &item.width, &item.height, &nrComponents) || item.width > MAX_IMAGE_SIZE || item.height > MAX_IMAGE_SIZE)
+            continue;
+        item.index = i;
+        item.cellsX = (item.width + 2 * GUTTER + ALIGNMENT - 1) / ALIGNMENT;
+        item.cellsY = (item.height + 2 * GUTTER + ALIGNMENT - 1) / ALIGNMENT;
+        items.push_back(item);
+    }
+
+    // tallest first, and in a fixed order so the same images always give the same pages
+    std::sort(items.begin(), items.end(), [&paths](const Item& a, const Item& b) {
+        if (a.cellsY != b.cellsY)
+            return a.cellsY > b.cellsY;
+        if (a.cellsX != b.cellsX)
+            return a.cellsX > b.cellsX;
+        return paths[a.index] < paths[b.index];
+    });
+    std::vector<Skyline> skylines;
+    for (Item& item : items) {
+        for (size_t page = 0; page < skylines.size() && item.page < 0; page++) {
+            if (skylines[page].place(item))
+                item.page = static_cast<int>(page);
+        }
+        if (item.page < 0) {
+            skylines.push_back(Skyline());
+            skylines.back().place(item);
+            item.page = static_cast<int>(skylines.size()) - 1;
+        }
+    }
+
+    for (int page = 0; page < static_cast<int>(skylines.size()); page++) {
+        std::vector<const Item*> pageItems;
+        int cellsX = 0, cellsY = 0;
+        unsigned long long hash = 14695981039346656037ull;
+        const int layout[] = { usage, PAGE_SIZE, LEVELS, GUTTER };
+        hash = fnv1a(hash, layout, sizeof(layout));
+        long long newestImage = 0;
+        for (const Item& item : items) {
+            if (item.page != page)
+                continue;
+            pageItems.push_back(&item);
+            cellsX = std::max(cellsX, item.x + item.cellsX);
+            cellsY = std::max(cellsY, item.y + item.cellsY);
+            const std::string& path = paths[item.index];
+            const int size[] = { item.width, item.height };
+            hash = fnv1a(fnv1a(hash, path.data(), path.size() + 1), size, sizeof(size));
+            newestImage = std::max(newestImage, fileModifiedTime(path));
+        }
+        // only as big as the cells that are used
+        const int width = nextPowerOfTwo(cellsX * ALIGNMENT), height = nextPowerOfTwo(cellsY * ALIGNMENT);
+
+        char name[32];
+        std::snprintf(name, sizeof(name), "/atlas_%016llx.ktx2", hash);
+        const std::string cookedPath = directory + name;
+        CompressedImage image;
+        bool cooked = false;
+        if (!(fileModifiedTime(cookedPath) >= newestImage && readKtx2Header(cookedPath, image) && isBlockFormatSupported(image.format))) {
+            std::vector<unsigned char> rgba;
+            if (!composePage(paths, pageItems, width, height, rgba))
+                continue;
+            BlockFormat format = chooseBlockFormat(rgba.data(), size_t(width) * height, usage);
+            if (!isBlockFormatSupported(format))
+                continue;
+            image = TextureCompressor::compress(rgba.data(), width, height, format, usage == TEXTURE_NORMAL_MAP);
+            if (image.levels.size() > static_cast<size_t>(LEVELS))
+                image.levels.resize(LEVELS);
+            if (!writeKtx2(cookedPath, image)) {
+                std::cout << "WARNING::TEXTURE_ATLAS::NOT_WRITABLE: " << cookedPath << std::endl;
+                continue;
+            }
+            cooked = true;
+        }
+
+        unsigned int texture = TextureStreamer::shared().loadKtx2(cookedPath);
+        if (texture == 0)
+            continue;
+        for (const Item* item : pageItems) {
+            AtlasPlacement& placement = placements[item->index];
+            placement.texture = texture;
+            placement.uvTransform = glm::vec4(float(item->width) / width, float(item->height) / height,
+                float(item->x * ALIGNMENT + GUTTER) / width, float(item->y * ALIGNMENT + GUTTER) / height);
+        }
+        std::cout << (cooked ? "Cooked atlas " : "Loaded atlas ") << cookedPath << ": " << pageItems.size() << " images in "
+            << width << "x" << height << std::endl;
+    }
+    return placements;
+}
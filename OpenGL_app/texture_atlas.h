@@ -0,0 +1,41 @@
+#ifndef TEXTURE_ATLAS_H
+#define TEXTURE_ATLAS_H
+
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+#include "texture_cache.h"
+
+// where an image ended up: the atlas texture and the scale (xy) and offset (zw) that take the
+// image's UVs into it; texture 0 if it could not be placed
+struct AtlasPlacement {
+    unsigned int texture = 0;
+    glm::vec4 uvTransform = glm::vec4(1.0f, 1.0f, 0.0f, 0.0f);
+};
+
+// Packs small images into shared block-compressed atlas pages at cook time.
+//
+// Every image gets a cell of ALIGNMENT-texel units with a GUTTER of its own edge texels around
+// it. Cells are aligned to ALIGNMENT, so down to mip LEVELS - 1 each cell still covers whole
+// 4x4 blocks and the box filter never averages two images; the gutter is at least a texel
+// there, so bilinear filtering does not reach the neighbour either. The page stops at that
+// level. Images must not repeat: only use UVs inside [0, 1].
+//
+// A page is cooked into a KTX2 file in the directory, named after a hash of its contents'
+// paths and sizes, and cooked again when an image is newer. Pages stream like any cooked texture.
+class TextureAtlas {
+public:
+    static const int MAX_IMAGE_SIZE = 512; // larger images keep their own texture
+    static const int PAGE_SIZE = 2048;
+    static const int LEVELS = 5;
+    static const int ALIGNMENT = 4 << (LEVELS - 1);
+    static const int GUTTER = 1 << (LEVELS - 1);
+
+    // whether the image at path is small enough to go into an atlas
+    static bool isCandidate(const std::string& path);
+
+    // packs the images, all of one usage, into as few pages as possible; one placement per path
+    static std::vector<AtlasPlacement> build(const std::vector<std::string>& paths, TextureUsage usage, const std::string& directory);
+};
+
+#endif
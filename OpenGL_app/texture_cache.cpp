@@ -0,0 +1,194 @@
+#include "texture_cache.h"
+#include "gl_extensions.h"
+#include "job_system.h"
+#include "ktx2.h"
+#include "stb_image.h"
+#include <sys/stat.h>
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+namespace {
+    // a cooked copy that is newer than the image and can be sampled here
+    bool isCookedCopyUsable(const std::string& path, const std::string& cookedPath, TextureUsage usage, const CompressedImage& header) {
+        long long sourceTime = fileModifiedTime(path), cookedTime = fileModifiedTime(cookedPath);
+        return cookedTime >= 0 && cookedTime >= sourceTime && header.faces == 1 && isBlockFormatSupported(header.format)
+            && (header.format == BLOCK_BC5) == (usage == TEXTURE_NORMAL_MAP);
+    }
+
+    // compresses the image at path into a KTX2 file at cookedPath
+    bool cook(const std::string& path, const std::string& cookedPath, TextureUsage usage, CompressedImage& image) {
+        int width, height, nrComponents;
+        unsigned char* data = stbi_load(path.c_str(), &width, &height, &nrComponents, 4);
+        if (!data)
+            return false;
+
+        BlockFormat format = chooseBlockFormat(data, size_t(width) * height, usage);
+        if (!isBlockFormatSupported(format)) {
+            stbi_image_free(data);
+            return false;
+        }
+
+        image = TextureCompressor::compress(data, width, height, format, usage == TEXTURE_NORMAL_MAP);
+        stbi_image_free(data);
+        if (!writeKtx2(cookedPath, image))
+            std::cout << "WARNING::TEXTURE::COOKED_COPY_NOT_WRITABLE: " << cookedPath << std::endl;
+        return true;
+    }
+
+    // compresses the six square faces into one BC1 cube map file at cookedPath, a job per face
+    bool cookCubemap(const std::vector<std::string>& faces, const std::string& cookedPath, CompressedImage& image) {
+        std::vector<CompressedImage> faceImages(faces.size());
+        JobSystem::shared().parallelFor(0, static_cast<int>(faces.size()), 1, [&faces, &faceImages](int first, int last) {
+            for (int i = first; i < last; i++) {
+                int width, height, nrComponents;
+                unsigned char* data = stbi_load(faces[i].c_str(), &width, &height, &nrComponents, 4);
+                if (!data)
+                    continue;
+                // sky images are opaque and 8 bits per channel, so BC1 loses no more than BC7 would
+                if (width == height)
+                    faceImages[i] = TextureCompressor::compress(data, width, height, BLOCK_BC1, false);
+                stbi_image_free(data);
+            }
+        });
+
+        for (const CompressedImage& face : faceImages) {
+            if (face.levels.empty() || face.width != faceImages[0].width) {
+                std::cout << "WARNING::TEXTURE::CUBEMAP_NOT_COOKED: faces must be readable squares of one size" << std::endl;
+                return false;
+            }
+        }
+        image.format = BLOCK_BC1;
+        image.width = image.height = faceImages[0].width;
+        image.faces = 6;
+        image.levels.assign(faceImages[0].levels.size(), std::vector<unsigned char>());
+        for (size_t level = 0; level < image.levels.size(); level++) {
+            for (const CompressedImage& face : faceImages)
+                image.levels[level].insert(image.levels[level].end(), face.levels[level].begin(), face.levels[level].end());
+        }
+        if (!writeKtx2(cookedPath, image))
+            std::cout << "WARNING::TEXTURE::COOKED_COPY_NOT_WRITABLE: " << cookedPath << std::endl;
+        return true;
+    }
+}
+
+long long fileModifiedTime(const std::string& path) {
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0)
+        return -1;
+    return static_cast<long long>(info.st_mtime);
+}
+
+BlockFormat chooseBlockFormat(const unsigned char* rgba, size_t pixelCount, TextureUsage usage) {
+    if (usage == TEXTURE_NORMAL_MAP)
+        return BLOCK_BC5;
+    bool hasAlpha = false;
+    for (size_t i = 0; i < pixelCount && !hasAlpha; i++)
+        hasAlpha = rgba[i * 4 + 3] != 255;
+    return !hasAlpha ? BLOCK_BC1 : isBlockFormatSupported(BLOCK_BC7) ? BLOCK_BC7 : BLOCK_BC3;
+}
+
+bool isBlockFormatSupported(BlockFormat format) {
+    switch (format) {
+    case BLOCK_BC1:
+    case BLOCK_BC3: return glExtensions.textureCompressionS3TC;
+    case BLOCK_BC5: return true; // RGTC is core since 3.0
+    default: return glExtensions.textureCompressionBPTC;
+    }
+}
+
+GLenum compressedInternalFormat(BlockFormat format) {
+    switch (format) {
+    case BLOCK_BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    case BLOCK_BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    case BLOCK_BC5: return GL_COMPRESSED_RG_RGTC2;
+    default: return GL_COMPRESSED_RGBA_BPTC_UNORM;
+    }
+}
+
+const char* blockFormatName(BlockFormat format) {
+    const char* names[] = { "BC1", "BC3", "BC5", "BC7" };
+    return names[format];
+}
+
+bool prepareCookedTexture(const std::string& path, TextureUsage usage) {
+    const std::string cookedPath = path + ".ktx2";
+    CompressedImage image;
+    if (readKtx2Header(cookedPath, image) && isCookedCopyUsable(path, cookedPath, usage, image))
+        return true;
+    return fileModifiedTime(path) >= 0 && cook(path, cookedPath, usage, image);
+}
+
+unsigned int loadCookedTexture(const std::string& path, TextureUsage usage) {
+    const std::string cookedPath = path + ".ktx2";
+    CompressedImage image;
+    bool loaded = readKtx2Header(cookedPath, image) && isCookedCopyUsable(path, cookedPath, usage, image) && readKtx2(cookedPath, image);
+    if (!loaded && (fileModifiedTime(path) < 0 || !cook(path, cookedPath, usage, image)))
+        return 0;
+
+    unsigned int textureID;
+    glGenTextures(1, &textureID);
+    glBindTexture(GL_TEXTURE_2D, textureID);
+    GLenum format = compressedInternalFormat(image.format);
+    int width = image.width, height = image.height;
+    size_t bytes = 0;
+    for (size_t level = 0; level < image.levels.size(); level++) {
+        glCompressedTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(level), format, width, height, 0,
+            static_cast<GLsizei>(image.levels[level].size()), image.levels[level].data());
+        bytes += image.levels[level].size();
+        width = width > 1 ? width / 2 : 1;
+        height = height > 1 ? height / 2 : 1;
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(image.levels.size()) - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    // against RGBA8 with mipmaps, which is what drivers store uncompressed RGB as
+    size_t uncompressed = size_t(image.width) * image.height * 4 * 4 / 3;
+    std::cout << (loaded ? "Loaded " : "Cooked ") << cookedPath << ": " << image.width << "x" << image.height << " "
+        << blockFormatName(image.format) << ", " << bytes / 1024 << " KB instead of " << uncompressed / 1024 << " KB" << std::endl;
+    return textureID;
+}
+
+unsigned int loadCookedCubemap(const std::vector<std::string>& faces, const std::string& cookedPath) {
+    if (faces.size() != 6 || !isBlockFormatSupported(BLOCK_BC1))
+        return 0;
+    long long newestFace = 0;
+    for (const std::string& face : faces)
+        newestFace = std::max(newestFace, fileModifiedTime(face));
+
+    CompressedImage image;
+    bool loaded = fileModifiedTime(cookedPath) >= newestFace && readKtx2Header(cookedPath, image) && image.faces == 6
+        && isBlockFormatSupported(image.format) && readKtx2(cookedPath, image);
+    if (!loaded && !cookCubemap(faces, cookedPath, image))
+        return 0;
+
+    unsigned int textureID;
+    glGenTextures(1, &textureID);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
+    GLenum format = compressedInternalFormat(image.format);
+    size_t bytes = 0;
+    for (size_t level = 0; level < image.levels.size(); level++) {
+        const int size = std::max(image.width >> level, 1);
+        const size_t faceBytes = image.levels[level].size() / 6;
+        for (int face = 0; face < 6; face++) {
+            glCompressedTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, static_cast<GLint>(level), format, size, size, 0,
+                static_cast<GLsizei>(faceBytes), image.levels[level].data() + face * faceBytes);
+        }
+        bytes += image.levels[level].size();
+    }
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(image.levels.size()) - 1);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+
+    // against six RGBA8 faces without mipmaps, which is what the faces used to be uploaded as
+    size_t uncompressed = size_t(image.width) * image.height * 4 * 6;
+    std::cout << (loaded ? "Loaded " : "Cooked ") << cookedPath << ": " << image.width << "x" << image.height << " "
+        << blockFormatName(image.format) << " cube map, " << bytes / 1024 << " KB instead of " << uncompressed / 1024 << " KB" << std::endl;
+    return textureID;
+}
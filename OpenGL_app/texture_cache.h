@@ -0,0 +1,44 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include <glad/glad.h>
+#include <string>
+#include <vector>
+#include "texture_compressor.h"
+
+enum TextureUsage {
+    TEXTURE_COLOR,      // BC1, or BC7 (BC3 without BPTC) when the image has alpha
+    TEXTURE_NORMAL_MAP  // BC5 with X and Y only, Z is rebuilt in g_buffer.fs
+};
+
+// Loads an image through a block-compressed KTX2 copy next to it (path + ".ktx2"). The copy is
+// cooked on first use, and again when it is older than the image or in a format this GPU cannot
+// sample. Cooking keeps the orientation stb_image loads with, so the flip setting has to be
+// the same on every run.
+//
+// Returns the texture with its full mip chain, or 0 if the GPU has no suitable block format or
+// the image cannot be read; the caller then uploads the image uncompressed.
+unsigned int loadCookedTexture(const std::string& path, TextureUsage usage);
+
+// The same for a cube map: the six face images (+X, -X, +Y, -Y, +Z, -Z) are cooked into one BC1
+// KTX2 file at cookedPath with a mip chain, decoding and compressing the faces in parallel, and
+// cooked again when any face is newer. Returns 0 if BC1 is not supported or the faces are not
+// readable squares of one size.
+unsigned int loadCookedCubemap(const std::vector<std::string>& faces, const std::string& cookedPath);
+
+// cooks path + ".ktx2" if it is missing or out of date, without loading it; false if the GPU has
+// no suitable block format or the image cannot be read
+bool prepareCookedTexture(const std::string& path, TextureUsage usage);
+
+// the format cooking picks for RGBA8 pixels: BC5 for normal maps, BC1 for opaque colour,
+// BC7 (BC3 without BPTC) with alpha
+BlockFormat chooseBlockFormat(const unsigned char* rgba, size_t pixelCount, TextureUsage usage);
+
+// seconds since the epoch, -1 if the file does not exist
+long long fileModifiedTime(const std::string& path);
+
+bool isBlockFormatSupported(BlockFormat format);
+GLenum compressedInternalFormat(BlockFormat format);
+const char* blockFormatName(BlockFormat format);
+
+#endif
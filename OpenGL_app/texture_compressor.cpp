@@ -0,0 +1,402 @@
+#include "texture_compressor.h"
+#include "job_system.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    // BC7 4-bit index interpolation weights, out of 64
+    const int BC7_WEIGHTS[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+    struct Color {
+        float c[4];
+    };
+
+    // principal axis of the first `channels` channels of the texels, by power iteration on
+    // their covariance; returns the endpoints of the texels' extent along it
+    void fitEndpoints(const unsigned char* block, int channels, Color& low, Color& high) {
+        float mean[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        for (int i = 0; i < 16; i++)
+            for (int c = 0; c < channels; c++)
+                mean[c] += block[i * 4 + c] / 16.0f;
+
+        float covariance[4][4] = {};
+        for (int i = 0; i < 16; i++) {
+            float d[4];
+            for (int c = 0; c < channels; c++)
+                d[c] = block[i * 4 + c] - mean[c];
+            for (int a = 0; a < channels; a++)
+                for (int b = 0; b < channels; b++)
+                    covariance[a][b] += d[a] * d[b];
+        }
+
+        // start from the covariance row of the channel that varies most: unlike a fixed start such
+        // as (1, 1, 1), it cannot be at right angles to the principal axis (a red-green edge
+        // has none of its variance along (1, 1, 1)). Only a block with no variance is flat.
+        int widest = 0;
+        float trace = 0.0f;
+        for (int c = 0; c < channels; c++) {
+            trace += covariance[c][c];
+            if (covariance[c][c] > covariance[widest][widest])
+                widest = c;
+        }
+        float axis[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        for (int c = 0; c < channels; c++)
+            axis[c] = trace > 0.0f ? covariance[widest][c] : 0.0f;
+        for (int iteration = 0; iteration < 8 && trace > 0.0f; iteration++) {
+            float next[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+            float length = 0.0f;
+            for (int a = 0; a < channels; a++) {
+                for (int b = 0; b < channels; b++)
+                    next[a] += covariance[a][b] * axis[b];
+                length = std::max(length, std::fabs(next[a]));
+            }
+            if (length <= 0.0f)
+                break;
+            for (int a = 0; a < channels; a++)
+                axis[a] = next[a] / length;
+        }
+
+        float minT = 1e30f, maxT = -1e30f;
+        for (int i = 0; i < 16; i++) {
+            float t = 0.0f;
+            for (int c = 0; c < channels; c++)
+                t += (block[i * 4 + c] - mean[c]) * axis[c];
+            minT = std::min(minT, t);
+            maxT = std::max(maxT, t);
+        }
+        float axisLengthSq = 0.0f;
+        for (int c = 0; c < channels; c++)
+            axisLengthSq += axis[c] * axis[c];
+        if (axisLengthSq > 0.0f) {
+            minT /= axisLengthSq;
+            maxT /= axisLengthSq;
+        }
+        for (int c = 0; c < 4; c++) {
+            low.c[c] = c < channels ? std::min(std::max(mean[c] + axis[c] * minT, 0.0f), 255.0f) : 255.0f;
+            high.c[c] = c < channels ? std::min(std::max(mean[c] + axis[c] * maxT, 0.0f), 255.0f) : 255.0f;
+        }
+    }
+
+    // least-squares endpoints for the given texel weights (0 at e0, 1 at e1); false if the
+    // weights do not determine them
+    bool refitEndpoints(const unsigned char* block, int channels, const float* weights, Color& e0, Color& e1) {
+        float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+        float ax[4] = {}, bx[4] = {};
+        for (int i = 0; i < 16; i++) {
+            float b = weights[i], a = 1.0f - b;
+            aa += a * a;
+            ab += a * b;
+            bb += b * b;
+            for (int c = 0; c < channels; c++) {
+                ax[c] += a * block[i * 4 + c];
+                bx[c] += b * block[i * 4 + c];
+            }
+        }
+        float determinant = aa * bb - ab * ab;
+        if (std::fabs(determinant) < 1e-6f)
+            return false;
+        for (int c = 0; c < channels; c++) {
+            e0.c[c] = std::min(std::max((ax[c] * bb - bx[c] * ab) / determinant, 0.0f), 255.0f);
+            e1.c[c] = std::min(std::max((bx[c] * aa - ax[c] * ab) / determinant, 0.0f), 255.0f);
+        }
+        return true;
+    }
+
+    unsigned short packRGB565(const Color& color) {
+        int r = (int)(color.c[0] * 31.0f / 255.0f + 0.5f);
+        int g = (int)(color.c[1] * 63.0f / 255.0f + 0.5f);
+        int b = (int)(color.c[2] * 31.0f / 255.0f + 0.5f);
+        return (unsigned short)((r << 11) | (g << 5) | b);
+    }
+
+    void unpackRGB565(unsigned short packed, int* rgb) {
+        int r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+        rgb[0] = (r << 3) | (r >> 2);
+        rgb[1] = (g << 2) | (g >> 4);
+        rgb[2] = (b << 3) | (b >> 2);
+    }
+
+    int squaredDistance(const unsigned char* texel, const int* color, int channels) {
+        int sum = 0;
+        for (int c = 0; c < channels; c++) {
+            int d = texel[c] - color[c];
+            sum += d * d;
+        }
+        return sum;
+    }
+
+    // BC1 colour block in four-colour mode for two endpoints; returns the total squared error
+    int encodeColorBlock(const unsigned char* block, const Color& high, const Color& low, unsigned char* out, int* indices) {
+        unsigned short color0 = packRGB565(high), color1 = packRGB565(low);
+        if (color0 < color1)
+            std::swap(color0, color1);
+
+        int palette[4][3];
+        unpackRGB565(color0, palette[0]);
+        unpackRGB565(color1, palette[1]);
+        for (int c = 0; c < 3; c++) {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+
+        unsigned int bits = 0;
+        int error = 0;
+        for (int i = 0; i < 16; i++) {
+            int best = 0, bestDistance = squaredDistance(block + i * 4, palette[0], 3);
+            // equal endpoints would select three-colour mode, keep every texel on color0
+            for (int p = 1; p < 4 && color0 != color1; p++) {
+                int distance = squaredDistance(block + i * 4, palette[p], 3);
+                if (distance < bestDistance) {
+                    bestDistance = distance;
+                    best = p;
+                }
+            }
+            indices[i] = best;
+            error += bestDistance;
+            bits |= (unsigned int)best << (2 * i);
+        }
+        out[0] = color0 & 0xFF;
+        out[1] = color0 >> 8;
+        out[2] = color1 & 0xFF;
+        out[3] = color1 >> 8;
+        for (int i = 0; i < 4; i++)
+            out[4 + i] = (bits >> (8 * i)) & 0xFF;
+        return error;
+    }
+
+    // appends count bits of value, least significant first
+    void putBits(unsigned char* out, int& position, unsigned int value, int count) {
+        for (int i = 0; i < count; i++, position++) {
+            if (value & (1u << i))
+                out[position >> 3] |= (unsigned char)(1u << (position & 7));
+        }
+    }
+
+    // nearest 7-bit value plus shared p-bit for an RGBA endpoint
+    void quantizeBC7Endpoint(const Color& color, int* quantized, int& pBit) {
+        int bestError = -1;
+        for (int p = 0; p < 2; p++) {
+            int q[4], error = 0;
+            for (int c = 0; c < 4; c++) {
+                q[c] = std::min(std::max((int)std::floor((color.c[c] - p) / 2.0f + 0.5f), 0), 127);
+                int d = (q[c] * 2 + p) - (int)(color.c[c] + 0.5f);
+                error += d * d;
+            }
+            if (bestError < 0 || error < bestError) {
+                bestError = error;
+                pBit = p;
+                std::copy(q, q + 4, quantized);
+            }
+        }
+    }
+
+    // BC7 mode 6 indices for quantized endpoints; returns the total squared error
+    int bc7Indices(const unsigned char* block, const int* q0, int p0, const int* q1, int p1, int* indices) {
+        int palette[16][4];
+        for (int c = 0; c < 4; c++) {
+            int e0 = q0[c] * 2 + p0, e1 = q1[c] * 2 + p1;
+            for (int i = 0; i < 16; i++)
+                palette[i][c] = ((64 - BC7_WEIGHTS[i]) * e0 + BC7_WEIGHTS[i] * e1 + 32) >> 6;
+        }
+        int error = 0;
+        for (int t = 0; t < 16; t++) {
+            int best = 0, bestDistance = squaredDistance(block + t * 4, palette[0], 4);
+            for (int i = 1; i < 16; i++) {
+                int distance = squaredDistance(block + t * 4, palette[i], 4);
+                if (distance < bestDistance) {
+                    bestDistance = distance;
+                    best = i;
+                }
+            }
+            indices[t] = best;
+            error += bestDistance;
+        }
+        return error;
+    }
+}
+
+void TextureCompressor::encodeBC1(const unsigned char* block, unsigned char* out) {
+    static const float WEIGHTS[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+    Color low, high;
+    fitEndpoints(block, 3, low, high);
+    int indices[16];
+    int error = encodeColorBlock(block, high, low, out, indices);
+
+    // one least-squares pass over the chosen indices, kept if it helps
+    unsigned short color0 = (unsigned short)(out[0] | (out[1] << 8));
+    unsigned short color1 = (unsigned short)(out[2] | (out[3] << 8));
+    if (color0 == color1)
+        return;
+    float weights[16];
+    for (int i = 0; i < 16; i++)
+        weights[i] = WEIGHTS[indices[i]];
+    Color e0, e1;
+    if (!refitEndpoints(block, 3, weights, e0, e1))
+        return;
+    unsigned char refitted[8];
+    if (encodeColorBlock(block, e0, e1, refitted, indices) < error)
+        std::copy(refitted, refitted + 8, out);
+}
+
+void TextureCompressor::encodeBC4(const unsigned char* block, int channel, unsigned char* out) {
+    int high = 0, low = 255;
+    for (int i = 0; i < 16; i++) {
+        high = std::max(high, (int)block[i * 4 + channel]);
+        low = std::min(low, (int)block[i * 4 + channel]);
+    }
+    out[0] = (unsigned char)high;
+    out[1] = (unsigned char)low;
+
+    // eight-value mode: both endpoints and six steps between them
+    int palette[8] = { high, low };
+    for (int i = 1; i < 7; i++)
+        palette[i + 1] = ((7 - i) * high + i * low) / 7;
+
+    unsigned long long bits = 0;
+    for (int i = 0; i < 16 && high != low; i++) {
+        int value = block[i * 4 + channel];
+        int best = 0, bestDistance = std::abs(value - palette[0]);
+        for (int p = 1; p < 8; p++) {
+            int distance = std::abs(value - palette[p]);
+            if (distance < bestDistance) {
+                bestDistance = distance;
+                best = p;
+            }
+        }
+        bits |= (unsigned long long)best << (3 * i);
+    }
+    for (int i = 0; i < 6; i++)
+        out[2 + i] = (bits >> (8 * i)) & 0xFF;
+}
+
+void TextureCompressor::encodeBC3(const unsigned char* block, unsigned char* out) {
+    encodeBC4(block, 3, out);
+    encodeBC1(block, out + 8);
+}
+
+void TextureCompressor::encodeBC5(const unsigned char* block, unsigned char* out) {
+    encodeBC4(block, 0, out);
+    encodeBC4(block, 1, out + 8);
+}
+
+void TextureCompressor::encodeBC7(const unsigned char* block, unsigned char* out) {
+    Color low, high;
+    fitEndpoints(block, 4, low, high);
+
+    int q0[4], q1[4], p0, p1, indices[16];
+    quantizeBC7Endpoint(low, q0, p0);
+    quantizeBC7Endpoint(high, q1, p1);
+    int error = bc7Indices(block, q0, p0, q1, p1, indices);
+
+    // one least-squares pass over the chosen indices, kept if it helps
+    float weights[16];
+    for (int i = 0; i < 16; i++)
+        weights[i] = BC7_WEIGHTS[indices[i]] / 64.0f;
+    Color e0 = low, e1 = high;
+    if (refitEndpoints(block, 4, weights, e0, e1)) {
+        int r0[4], r1[4], rp0, rp1, refitted[16];
+        quantizeBC7Endpoint(e0, r0, rp0);
+        quantizeBC7Endpoint(e1, r1, rp1);
+        if (bc7Indices(block, r0, rp0, r1, rp1, refitted) < error) {
+            std::copy(r0, r0 + 4, q0);
+            std::copy(r1, r1 + 4, q1);
+            std::copy(refitted, refitted + 16, indices);
+            p0 = rp0;
+            p1 = rp1;
+        }
+    }
+
+    // the first texel's index is stored with its top bit implied zero
+    if (indices[0] & 8) {
+        for (int c = 0; c < 4; c++)
+            std::swap(q0[c], q1[c]);
+        std::swap(p0, p1);
+        for (int i = 0; i < 16; i++)
+            indices[i] = 15 - indices[i];
+    }
+
+    std::fill(out, out + 16, (unsigned char)0);
+    int position = 0;
+    putBits(out, position, 1u << 6, 7); // mode 6
+    for (int c = 0; c < 4; c++) {
+        putBits(out, position, q0[c], 7);
+        putBits(out, position, q1[c], 7);
+    }
+    putBits(out, position, p0, 1);
+    putBits(out, position, p1, 1);
+    putBits(out, position, indices[0], 3);
+    for (int i = 1; i < 16; i++)
+        putBits(out, position, indices[i], 4);
+}
+
+void TextureCompressor::downsample(const std::vector<unsigned char>& source, int width, int height,
+    std::vector<unsigned char>& target, int targetWidth, int targetHeight, bool normalMap) {
+    target.resize(size_t(targetWidth) * targetHeight * 4);
+    for (int y = 0; y < targetHeight; y++) {
+        for (int x = 0; x < targetWidth; x++) {
+            float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+            for (int sy = 0; sy < 2; sy++) {
+                for (int sx = 0; sx < 2; sx++) {
+                    int px = std::min(x * 2 + sx, width - 1), py = std::min(y * 2 + sy, height - 1);
+                    const unsigned char* texel = &source[(size_t(py) * width + px) * 4];
+                    for (int c = 0; c < 4; c++)
+                        sum[c] += normalMap && c < 3 ? texel[c] / 127.5f - 1.0f : texel[c];
+                }
+            }
+            unsigned char* out = &target[(size_t(y) * targetWidth + x) * 4];
+            if (normalMap) {
+                float length = std::sqrt(sum[0] * sum[0] + sum[1] * sum[1] + sum[2] * sum[2]);
+                for (int c = 0; c < 3; c++)
+                    out[c] = (unsigned char)std::min(std::max(((length > 0.0f ? sum[c] / length : 0.0f) + 1.0f) * 127.5f + 0.5f, 0.0f), 255.0f);
+                out[3] = (unsigned char)(sum[3] / 4.0f + 0.5f);
+            }
+            else {
+                for (int c = 0; c < 4; c++)
+                    out[c] = (unsigned char)(sum[c] / 4.0f + 0.5f);
+            }
+        }
+    }
+}
+
+CompressedImage TextureCompressor::compress(const unsigned char* rgba, int width, int height, BlockFormat format, bool normalMap) {
+    CompressedImage image;
+    image.format = format;
+    image.width = width;
+    image.height = height;
+    void (*encode)(const unsigned char*, unsigned char*) =
+        format == BLOCK_BC1 ? encodeBC1 : format == BLOCK_BC3 ? encodeBC3 : format == BLOCK_BC5 ? encodeBC5 : encodeBC7;
+
+    std::vector<unsigned char> level(rgba, rgba + size_t(width) * height * 4), next;
+    int levelWidth = width, levelHeight = height;
+    for (;;) {
+        const int blocksX = (levelWidth + 3) / 4, blocksY = (levelHeight + 3) / 4;
+        std::vector<unsigned char> blocks(levelBytes(format, levelWidth, levelHeight));
+        const int bytes = blockBytes(format);
+
+        // rows of blocks are independent; a job per few rows
+        auto encodeRows = [&](int firstRow, int endRow) {
+            unsigned char texels[64];
+            for (int by = firstRow; by < endRow; by++) {
+                for (int bx = 0; bx < blocksX; bx++) {
+                    // edge blocks repeat the last row and column
+                    for (int i = 0; i < 16; i++) {
+                        int x = std::min(bx * 4 + (i & 3), levelWidth - 1), y = std::min(by * 4 + (i >> 2), levelHeight - 1);
+                        std::copy(&level[(size_t(y) * levelWidth + x) * 4], &level[(size_t(y) * levelWidth + x) * 4] + 4, texels + i * 4);
+                    }
+                    encode(texels, &blocks[(size_t(by) * blocksX + bx) * bytes]);
+                }
+            }
+        };
+        JobSystem::shared().parallelFor(0, blocksY, 4, encodeRows);
+        image.levels.push_back(blocks);
+
+        if (levelWidth == 1 && levelHeight == 1)
+            break;
+        int nextWidth = std::max(levelWidth / 2, 1), nextHeight = std::max(levelHeight / 2, 1);
+        downsample(level, levelWidth, levelHeight, next, nextWidth, nextHeight, normalMap);
+        level.swap(next);
+        levelWidth = nextWidth;
+        levelHeight = nextHeight;
+    }
+    return image;
+}
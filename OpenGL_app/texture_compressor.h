@@ -0,0 +1,51 @@
+#ifndef TEXTURE_COMPRESSOR_H
+#define TEXTURE_COMPRESSOR_H
+
+#include <cstddef>
+#include <vector>
+
+// GPU block formats, all made of 4x4 texel blocks
+enum BlockFormat {
+    BLOCK_BC1, // RGB, 8 bytes per block
+    BLOCK_BC3, // RGBA: BC1 colour plus a BC4 alpha block, 16 bytes
+    BLOCK_BC5, // two BC4 channels, RG, 16 bytes; for tangent-space normal maps
+    BLOCK_BC7  // RGBA, 16 bytes; mode 6 only
+};
+
+// a compressed image with its whole mip chain, level 0 first
+struct CompressedImage {
+    BlockFormat format = BLOCK_BC1;
+    int width = 0;
+    int height = 0;
+    int faces = 1; // 6 for a cube map: every level holds the faces one after the other, +X, -X, +Y, -Y, +Z, -Z
+    std::vector<std::vector<unsigned char>> levels;
+};
+
+// CPU block compression for the texture cooking step. The encoders fit each block's endpoints
+// along its principal axis and then pick the nearest palette entry per texel: far from the
+// best an offline tool can do, but fast enough to cook at load time.
+class TextureCompressor {
+public:
+    static int blockBytes(BlockFormat format) { return format == BLOCK_BC1 ? 8 : 16; }
+    static size_t levelBytes(BlockFormat format, int width, int height) {
+        return size_t((width + 3) / 4) * size_t((height + 3) / 4) * blockBytes(format);
+    }
+
+    // compresses RGBA8 pixels with a box-filtered mip chain down to 1x1. For normal maps the
+    // mips are renormalized and X, Y go to the two BC5 channels; Z is rebuilt in the shader.
+    static CompressedImage compress(const unsigned char* rgba, int width, int height, BlockFormat format, bool normalMap);
+
+    // one 4x4 block of RGBA8 texels, row by row
+    static void encodeBC1(const unsigned char* block, unsigned char* out);
+    static void encodeBC3(const unsigned char* block, unsigned char* out);
+    static void encodeBC5(const unsigned char* block, unsigned char* out);
+    static void encodeBC7(const unsigned char* block, unsigned char* out);
+
+private:
+    // BC4 block of one channel (0-3) of the texels
+    static void encodeBC4(const unsigned char* block, int channel, unsigned char* out);
+    static void downsample(const std::vector<unsigned char>& source, int width, int height,
+        std::vector<unsigned char>& target, int targetWidth, int targetHeight, bool normalMap);
+};
+
+#endif
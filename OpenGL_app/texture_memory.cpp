@@ -0,0 +1,117 @@
+#include "texture_memory.h"
+#include "gl_extensions.h"
+#include <algorithm>
+
+namespace {
+    // glTexParameter allows 1000 levels, but no texture we make is larger than 32K
+    const int MAX_LEVELS = 16;
+
+    GLenum bindingOf(GLenum target) {
+        switch (target) {
+        case GL_TEXTURE_2D_ARRAY: return GL_TEXTURE_BINDING_2D_ARRAY;
+        case GL_TEXTURE_CUBE_MAP: return GL_TEXTURE_BINDING_CUBE_MAP;
+        case GL_TEXTURE_3D: return GL_TEXTURE_BINDING_3D;
+        default: return GL_TEXTURE_BINDING_2D;
+        }
+    }
+
+    // bytes of one image of the level, 0 if it is not defined
+    size_t levelBytes(GLenum imageTarget, int level) {
+        GLint width = 0, height = 0, depth = 0;
+        glGetTexLevelParameteriv(imageTarget, level, GL_TEXTURE_WIDTH, &width);
+        if (width == 0)
+            return 0;
+        glGetTexLevelParameteriv(imageTarget, level, GL_TEXTURE_HEIGHT, &height);
+        glGetTexLevelParameteriv(imageTarget, level, GL_TEXTURE_DEPTH, &depth);
+
+        GLint compressed = GL_FALSE;
+        glGetTexLevelParameteriv(imageTarget, level, GL_TEXTURE_COMPRESSED, &compressed);
+        if (compressed) {
+            GLint size = 0;
+            glGetTexLevelParameteriv(imageTarget, level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+            return static_cast<size_t>(size);
+        }
+        const GLenum channels[] = { GL_TEXTURE_RED_SIZE, GL_TEXTURE_GREEN_SIZE, GL_TEXTURE_BLUE_SIZE, GL_TEXTURE_ALPHA_SIZE,
+            GL_TEXTURE_DEPTH_SIZE, GL_TEXTURE_STENCIL_SIZE };
+        size_t bits = 0;
+        for (GLenum channel : channels) {
+            GLint size = 0;
+            glGetTexLevelParameteriv(imageTarget, level, channel, &size);
+            bits += size;
+        }
+        return size_t(width) * height * std::max(depth, 1) * bits / 8;
+    }
+}
+
+TextureMemory& TextureMemory::shared() {
+    static TextureMemory memory;
+    return memory;
+}
+
+size_t TextureMemory::defaultBudget() {
+    if (!hasGLExtension("GL_NVX_gpu_memory_info"))
+        return DEFAULT_BUDGET;
+    GLint dedicatedKB = 0;
+    glGetIntegerv(GL_GPU_MEMORY_INFO_DEDICATED_VIDMEM_NVX, &dedicatedKB);
+    // the rest is for buffers, the framebuffer and everything else on the machine
+    return dedicatedKB > 0 ? size_t(dedicatedKB) * 1024 / 2 : DEFAULT_BUDGET;
+}
+
+const char* TextureMemory::categoryName(TextureCategory category) {
+    switch (category) {
+    case TEXTURES_MODELS: return "models";
+    case TEXTURES_SKYBOX: return "skybox";
+    case TEXTURES_RENDER_TARGETS: return "render targets";
+    default: return "unknown";
+    }
+}
+
+size_t TextureMemory::measure(unsigned int texture, GLenum target) {
+    GLint previous = 0;
+    glGetIntegerv(bindingOf(target), &previous);
+    glBindTexture(target, texture);
+    size_t bytes = 0;
+    for (int level = 0; level < MAX_LEVELS; level++) {
+        // levels below GL_TEXTURE_BASE_LEVEL may be undefined while coarser ones are not
+        if (target == GL_TEXTURE_CUBE_MAP) {
+            for (int face = 0; face < 6; face++)
+                bytes += levelBytes(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level);
+        }
+        else
+            bytes += levelBytes(target, level);
+    }
+    glBindTexture(target, previous);
+    return bytes;
+}
+
+void TextureMemory::track(unsigned int texture, GLenum target, TextureCategory category) {
+    if (texture != 0)
+        setBytes(texture, measure(texture, target), category);
+}
+
+void TextureMemory::setBytes(unsigned int texture, size_t bytes, TextureCategory category) {
+    untrack(texture);
+    Entry entry = { category, bytes };
+    entries[texture] = entry;
+    categoryBytes[category] += bytes;
+}
+
+void TextureMemory::untrack(unsigned int texture) {
+    auto it = entries.find(texture);
+    if (it == entries.end())
+        return;
+    categoryBytes[it->second.category] -= it->second.bytes;
+    entries.erase(it);
+}
+
+size_t TextureMemory::getTotalBytes() const {
+    size_t bytes = 0;
+    for (size_t category : categoryBytes)
+        bytes += category;
+    return bytes;
+}
+
+size_t TextureMemory::getBytesOf(unsigned int texture) const {
+    auto it = entries.find(texture);
+    return it != entries.end() ? it->second.bytes : 0;
+}
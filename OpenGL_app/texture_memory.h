@@ -0,0 +1,60 @@
+#ifndef TEXTURE_MEMORY_H
+#define TEXTURE_MEMORY_H
+
+#include <glad/glad.h>
+#include <cstddef>
+#include <map>
+
+enum TextureCategory {
+    TEXTURES_MODELS,         // model and scene textures, streamed or not
+    TEXTURES_SKYBOX,
+    TEXTURES_RENDER_TARGETS, // G-buffer, shadow maps, Hi-Z pyramid
+    TEXTURE_CATEGORY_COUNT
+};
+
+// Keeps count of the GPU memory of every texture we create, by category, against one budget.
+//
+// Fixed textures are measured from their levels once they are filled in; the texture streamer
+// reports its own textures as their resident levels change. The streamer is the one that
+// enforces the budget: it gets whatever the fixed textures leave over.
+class TextureMemory {
+public:
+    // process-wide registry
+    static TextureMemory& shared();
+
+    // a budget for this GPU: half of its dedicated memory where GL_NVX_gpu_memory_info tells
+    // it, DEFAULT_BUDGET otherwise; needs a current context
+    static size_t defaultBudget();
+    static const size_t DEFAULT_BUDGET = 256u << 20;
+
+    static const char* categoryName(TextureCategory category);
+
+    // measures the texture's defined levels (every face of a cube map, every layer of an array)
+    void track(unsigned int texture, GLenum target, TextureCategory category);
+    // a texture whose size the caller knows
+    void setBytes(unsigned int texture, size_t bytes, TextureCategory category);
+    // call before deleting the texture; unknown textures are ignored
+    void untrack(unsigned int texture);
+
+    size_t getBytes(TextureCategory category) const { return categoryBytes[category]; }
+    size_t getTotalBytes() const;
+    size_t getBytesOf(unsigned int texture) const;
+
+    void setBudget(size_t bytes) { budget = bytes; }
+    size_t getBudget() const { return budget; }
+
+    // sums the storage of the texture's levels as the driver reports it
+    static size_t measure(unsigned int texture, GLenum target);
+
+private:
+    struct Entry {
+        TextureCategory category;
+        size_t bytes;
+    };
+
+    std::map<unsigned int, Entry> entries;
+    size_t categoryBytes[TEXTURE_CATEGORY_COUNT] = {};
+    size_t budget = DEFAULT_BUDGET;
+};
+
+#endif
@@ -0,0 +1,471 @@
+#include "texture_streamer.h"
+#include "ktx2.h"
+#include "texture_memory.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+namespace {
+    // updates in a row a wanted level must not fit before every texture gets a level coarser
+    const int PRESSURE_UPDATES = 30;
+    // and in a row the textures must use less than 3/4 of the budget before they get it back
+    const int RELAXED_UPDATES = 120;
+}
+
+TextureStreamer::TextureStreamer(size_t uploadBytesPerFrame, int workerCount, size_t stagingBytes)
+    : uploadBytesPerFrame(uploadBytesPerFrame), stagingBytes(stagingBytes) {
+    for (int i = 0; i < workerCount; i++)
+        workers.emplace_back(&TextureStreamer::workerLoop, this);
+}
+
+TextureStreamer::~TextureStreamer() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quitting = true;
+    }
+    wake.notify_all();
+    for (std::thread& worker : workers)
+        worker.join();
+    for (LevelLoad* load : requests)
+        delete load;
+    for (LevelLoad* load : completed)
+        delete load;
+    delete uploading;
+}
+
+TextureStreamer& TextureStreamer::shared() {
+    static TextureStreamer streamer;
+    return streamer;
+}
+
+size_t TextureStreamer::layerBytes(const StreamedTexture& texture, int level) const {
+    return TextureCompressor::levelBytes(texture.format, std::max(texture.width >> level, 1), std::max(texture.height >> level, 1));
+}
+
+size_t TextureStreamer::levelBytes(const StreamedTexture& texture, int level) const {
+    return layerBytes(texture, level) * texture.layerPaths.size();
+}
+
+size_t TextureStreamer::residentBytesOf(const StreamedTexture& texture) const {
+    size_t bytes = 0;
+    for (int level = texture.resident; level < texture.levelCount; level++)
+        bytes += levelBytes(texture, level);
+    return bytes;
+}
+
+void TextureStreamer::report(unsigned int id, const StreamedTexture& texture) const {
+    TextureMemory::shared().setBytes(id, residentBytesOf(texture), TEXTURES_MODELS);
+}
+
+unsigned int TextureStreamer::load(const std::string& path, TextureUsage usage) {
+    if (!prepareCookedTexture(path, usage))
+        return 0;
+    return loadKtx2(path + ".ktx2");
+}
+
+unsigned int TextureStreamer::loadKtx2(const std::string& cookedPath) {
+    StreamedTexture texture;
+    texture.target = GL_TEXTURE_2D;
+    texture.layerPaths.push_back(cookedPath);
+    CompressedImage image;
+    if (!readKtx2Header(cookedPath, image) || image.faces != 1 || !isBlockFormatSupported(image.format))
+        return 0;
+
+    texture.format = image.format;
+    texture.internalFormat = compressedInternalFormat(image.format);
+    texture.width = image.width;
+    texture.height = image.height;
+    texture.levelCount = static_cast<int>(image.levels.size());
+    texture.tailLevel = 0;
+    while (texture.tailLevel < texture.levelCount - 1 && std::max(image.width >> texture.tailLevel, image.height >> texture.tailLevel) > TAIL_SIZE)
+        texture.tailLevel++;
+    texture.resident = texture.wanted = texture.tailLevel;
+    if (!readKtx2(texture.layerPaths[0], image, texture.tailLevel))
+        return 0;
+
+    unsigned int textureID;
+    glGenTextures(1, &textureID);
+    glBindTexture(GL_TEXTURE_2D, textureID);
+    size_t bytes = 0;
+    for (int level = texture.tailLevel; level < texture.levelCount; level++) {
+        glCompressedTexImage2D(GL_TEXTURE_2D, level, texture.internalFormat, std::max(image.width >> level, 1), std::max(image.height >> level, 1), 0,
+            static_cast<GLsizei>(image.levels[level].size()), image.levels[level].data());
+        bytes += image.levels[level].size();
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, texture.tailLevel);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, texture.levelCount - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    residentBytes += bytes;
+    texture.lastVisible = frame;
+    textures[textureID] = texture;
+    report(textureID, texture);
+
+    std::cout << "Streaming " << texture.layerPaths[0] << ": " << image.width << "x" << image.height << " "
+        << blockFormatName(image.format) << ", " << texture.levelCount << " levels, " << bytes / 1024 << " KB tail resident" << std::endl;
+    return textureID;
+}
+
+void TextureStreamer::request(unsigned int texture, float uvPerPixel) {
+    auto it = textures.find(texture);
+    if (it == textures.end() || !(uvPerPixel > 0.0f))
+        return;
+    StreamedTexture& streamed = it->second;
+    // texels of level 0 under one pixel; each finer level halves it, so one texel per pixel is log2 levels up
+    float texelsPerPixel = uvPerPixel * std::max(streamed.width, streamed.height);
+    int level = texelsPerPixel > 1.0f ? static_cast<int>(std::floor(std::log2(texelsPerPixel))) : 0;
+    level += qualityBias;
+    streamed.lastVisible = frame;
+    streamed.wanted = std::min(streamed.wanted, std::min(level, streamed.tailLevel));
+}
+
+void TextureStreamer::update() {
+    if (!ring && stagingBytes > 0 && UploadRing::isSupported())
+        ring.reset(new UploadRing(stagingBytes));
+    if (ring)
+        ring->reclaim();
+
+    size_t bytesLeft = uploadBytesPerFrame;
+    uploadSome(bytesLeft);
+
+    // whatever the textures that do not stream leave over
+    const TextureMemory& memory = TextureMemory::shared();
+    const size_t fixedBytes = memory.getTotalBytes() - std::min(memory.getTotalBytes(), residentBytes);
+    budgetBytes = memory.getBudget() - std::min(memory.getBudget(), fixedBytes);
+
+    // textures that want a finer level, neediest first
+    std::vector<std::pair<int, unsigned int>> deficits;
+    for (auto& entry : textures) {
+        if (!entry.second.loading && entry.second.resident > entry.second.wanted)
+            deficits.push_back(std::make_pair(entry.second.resident - entry.second.wanted, entry.first));
+    }
+    std::sort(deficits.begin(), deficits.end(), [](const std::pair<int, unsigned int>& a, const std::pair<int, unsigned int>& b) {
+        return a.first > b.first;
+    });
+
+    size_t pendingBytes = 0;
+    for (auto& entry : textures) {
+        if (entry.second.loading)
+            pendingBytes += levelBytes(entry.second, entry.second.resident - 1);
+    }
+
+    // drops the finest level of the least recently seen texture with detail beyond what it wants
+    // (the one with the most of it among equals), except from keep; false if no texture has any to spare
+    auto evictSurplus = [this](unsigned int keep) {
+        unsigned int victim = 0;
+        int mostSurplus = 0;
+        unsigned long long oldest = 0;
+        for (auto& entry : textures) {
+            const StreamedTexture& texture = entry.second;
+            int surplus = texture.wanted - texture.resident;
+            if (entry.first == keep || texture.loading || surplus <= 0)
+                continue;
+            if (victim == 0 || texture.lastVisible < oldest || (texture.lastVisible == oldest && surplus > mostSurplus)) {
+                victim = entry.first;
+                oldest = texture.lastVisible;
+                mostSurplus = surplus;
+            }
+        }
+        if (victim == 0)
+            return false;
+        evictFinestLevel(victim, textures[victim]);
+        return true;
+    };
+
+    while (residentBytes + pendingBytes > budgetBytes && evictSurplus(0))
+        ;
+    bool pressured = residentBytes + pendingBytes > budgetBytes;
+
+    std::vector<LevelLoad*> issued;
+    for (const auto& deficit : deficits) {
+        StreamedTexture& texture = textures[deficit.second];
+        size_t bytes = levelBytes(texture, texture.resident - 1);
+        while (residentBytes + pendingBytes + bytes > budgetBytes && evictSurplus(deficit.second))
+            ;
+        if (residentBytes + pendingBytes + bytes > budgetBytes) {
+            pressured = true;
+            continue;
+        }
+
+        LevelLoad* load = new LevelLoad();
+        load->texture = deficit.second;
+        load->level = texture.resident - 1;
+        load->paths = texture.layerPaths;
+        load->layerBytes = layerBytes(texture, load->level);
+        issued.push_back(load);
+        texture.loading = true;
+        pendingBytes += bytes;
+    }
+    if (!issued.empty()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            requests.insert(requests.end(), issued.begin(), issued.end());
+        }
+        wake.notify_all();
+    }
+
+    // quality fallback: the textures in view do not fit, so all of them step down a level; the
+    // levels they no longer want are evicted next update
+    pressuredUpdates = pressured ? pressuredUpdates + 1 : 0;
+    relaxedUpdates = !pressured && (residentBytes + pendingBytes) * 4 < budgetBytes * 3 ? relaxedUpdates + 1 : 0;
+    if (pressuredUpdates >= PRESSURE_UPDATES && qualityBias < MAX_QUALITY_BIAS) {
+        qualityBias++;
+        pressuredUpdates = 0;
+        std::cout << "WARNING::TEXTURE_STREAMER::OVER_BUDGET: " << budgetBytes / (1024 * 1024) << " MB, mip bias raised to " << qualityBias << std::endl;
+    }
+    else if (relaxedUpdates >= RELAXED_UPDATES && qualityBias > 0) {
+        qualityBias--;
+        relaxedUpdates = 0;
+        std::cout << "Texture streaming back within budget, mip bias lowered to " << qualityBias << std::endl;
+    }
+
+    for (auto& entry : textures)
+        entry.second.wanted = entry.second.tailLevel;
+    frame++;
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+void TextureStreamer::uploadSome(size_t& bytesLeft) {
+    while (bytesLeft > 0) {
+        if (!uploading) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (completed.empty())
+                return;
+            uploading = completed.front();
+            completed.pop_front();
+        }
+
+        // released or merged while it was read (the id may even belong to a new texture by now),
+        // or a file that went bad
+        auto it = textures.find(uploading->texture);
+        if (it != textures.end() && it->second.layerPaths != uploading->paths)
+            it = textures.end();
+        if (it == textures.end() || !uploading->ok) {
+            if (it != textures.end()) {
+                std::cout << "WARNING::TEXTURE_STREAMER::LEVEL_NOT_READ: " << uploading->paths[0] << " level " << uploading->level << std::endl;
+                it->second.loading = false;
+            }
+            finish(uploading);
+            uploading = nullptr;
+            continue;
+        }
+
+        StreamedTexture& texture = it->second;
+        const int width = std::max(texture.width >> uploading->level, 1);
+        const int height = std::max(texture.height >> uploading->level, 1);
+        const GLsizei layers = static_cast<GLsizei>(texture.layerPaths.size());
+        const size_t levelSize = uploading->layerBytes * layers;
+        glBindTexture(texture.target, uploading->texture);
+        if (uploading->uploadedRows == 0) {
+            // storage first, so the level can be filled over several frames while the coarser ones are sampled
+            if (texture.target == GL_TEXTURE_2D_ARRAY)
+                glCompressedTexImage3D(texture.target, uploading->level, texture.internalFormat, width, height, layers, 0,
+                    static_cast<GLsizei>(levelSize), NULL);
+            else
+                glCompressedTexImage2D(texture.target, uploading->level, texture.internalFormat, width, height, 0,
+                    static_cast<GLsizei>(levelSize), NULL);
+        }
+
+        // rows of blocks are counted through all layers; one upload stays within a layer
+        const int rowCount = (height + 3) / 4;
+        const size_t rowBytes = layerBytes(texture, uploading->level) / rowCount;
+        const int layer = uploading->uploadedRows / rowCount;
+        const int row = uploading->uploadedRows % rowCount;
+        int rows = std::min(static_cast<int>(std::max<size_t>(bytesLeft / rowBytes, 1)), rowCount - row);
+        int y = row * 4;
+        // from the upload ring the data argument is an offset into it
+        const unsigned char* data;
+        if (uploading->region.data) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ring->getBuffer());
+            data = reinterpret_cast<const unsigned char*>(uploading->region.offset);
+        }
+        else
+            data = uploading->data.data();
+        data += uploading->uploadedRows * rowBytes;
+        if (texture.target == GL_TEXTURE_2D_ARRAY)
+            glCompressedTexSubImage3D(texture.target, uploading->level, 0, y, layer, width, std::min(rows * 4, height - y), 1,
+                texture.internalFormat, static_cast<GLsizei>(rows * rowBytes), data);
+        else
+            glCompressedTexSubImage2D(texture.target, uploading->level, 0, y, width, std::min(rows * 4, height - y),
+                texture.internalFormat, static_cast<GLsizei>(rows * rowBytes), data);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        uploading->uploadedRows += rows;
+        bytesLeft -= std::min(bytesLeft, rows * rowBytes);
+
+        if (uploading->uploadedRows == rowCount * layers) {
+            texture.resident = uploading->level;
+            texture.loading = false;
+            residentBytes += levelSize;
+            glTexParameteri(texture.target, GL_TEXTURE_BASE_LEVEL, texture.resident);
+            report(uploading->texture, texture);
+            finish(uploading);
+            uploading = nullptr;
+        }
+    }
+}
+
+void TextureStreamer::evictFinestLevel(unsigned int id, StreamedTexture& texture) {
+    glBindTexture(texture.target, id);
+    glTexParameteri(texture.target, GL_TEXTURE_BASE_LEVEL, texture.resident + 1);
+    // an empty image in its place frees the storage; levels below the base do not affect completeness
+    if (texture.target == GL_TEXTURE_2D_ARRAY)
+        glTexImage3D(texture.target, texture.resident, GL_RGBA8, 0, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    else
+        glTexImage2D(texture.target, texture.resident, GL_RGBA8, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    residentBytes -= levelBytes(texture, texture.resident);
+    texture.resident++;
+    report(id, texture);
+}
+
+bool TextureStreamer::getFormat(unsigned int texture, BlockFormat& format, int& width, int& height) const {
+    auto it = textures.find(texture);
+    if (it == textures.end())
+        return false;
+    format = it->second.format;
+    width = it->second.width;
+    height = it->second.height;
+    return true;
+}
+
+void TextureStreamer::forget(unsigned int id) {
+    auto it = textures.find(id);
+    if (it == textures.end())
+        return;
+    residentBytes -= residentBytesOf(it->second);
+    if (uploading && uploading->texture == id) {
+        finish(uploading);
+        uploading = nullptr;
+    }
+    // reads still queued are dropped when they complete
+    textures.erase(it);
+    TextureMemory::shared().untrack(id);
+}
+
+void TextureStreamer::release(unsigned int texture) {
+    auto it = textures.find(texture);
+    if (it == textures.end())
+        return;
+    StreamedTexture& streamed = it->second;
+    glBindTexture(streamed.target, texture);
+    std::vector<unsigned char> data;
+    for (int level = streamed.resident - 1; level >= 0; level--) {
+        const int width = std::max(streamed.width >> level, 1), height = std::max(streamed.height >> level, 1);
+        data.clear();
+        for (const std::string& path : streamed.layerPaths) {
+            std::vector<unsigned char> layer;
+            if (!readKtx2Level(path, level, layer)) {
+                std::cout << "WARNING::TEXTURE_STREAMER::LEVEL_NOT_READ: " << path << " level " << level << std::endl;
+                forget(texture);
+                return;
+            }
+            data.insert(data.end(), layer.begin(), layer.end());
+        }
+        if (streamed.target == GL_TEXTURE_2D_ARRAY)
+            glCompressedTexImage3D(streamed.target, level, streamed.internalFormat, width, height, static_cast<GLsizei>(streamed.layerPaths.size()), 0,
+                static_cast<GLsizei>(data.size()), data.data());
+        else
+            glCompressedTexImage2D(streamed.target, level, streamed.internalFormat, width, height, 0, static_cast<GLsizei>(data.size()), data.data());
+        glTexParameteri(streamed.target, GL_TEXTURE_BASE_LEVEL, level);
+    }
+    const GLenum target = streamed.target;
+    forget(texture);
+    // still counted, now at its full size
+    TextureMemory::shared().track(texture, target, TEXTURES_MODELS);
+}
+
+unsigned int TextureStreamer::mergeIntoArray(const std::vector<unsigned int>& layers) {
+    if (layers.empty())
+        return 0;
+    std::vector<StreamedTexture*> members;
+    for (unsigned int layer : layers) {
+        auto it = textures.find(layer);
+        if (it == textures.end())
+            return 0;
+        members.push_back(&it->second);
+        if (it->second.target != GL_TEXTURE_2D || it->second.format != members[0]->format
+            || it->second.width != members[0]->width || it->second.height != members[0]->height)
+            return 0;
+    }
+
+    // the array starts again from the tail, like a freshly loaded texture
+    StreamedTexture merged = *members[0];
+    merged.target = GL_TEXTURE_2D_ARRAY;
+    merged.layerPaths.clear();
+    merged.resident = merged.wanted = merged.tailLevel;
+    merged.loading = false;
+    std::vector<std::vector<unsigned char>> levels(merged.levelCount);
+    for (StreamedTexture* member : members) {
+        CompressedImage image;
+        if (!readKtx2(member->layerPaths[0], image, merged.tailLevel) || static_cast<int>(image.levels.size()) != merged.levelCount)
+            return 0;
+        for (int level = merged.tailLevel; level < merged.levelCount; level++)
+            levels[level].insert(levels[level].end(), image.levels[level].begin(), image.levels[level].end());
+        merged.layerPaths.push_back(member->layerPaths[0]);
+    }
+
+    unsigned int arrayID;
+    glGenTextures(1, &arrayID);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, arrayID);
+    for (int level = merged.tailLevel; level < merged.levelCount; level++)
+        glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, merged.internalFormat, std::max(merged.width >> level, 1), std::max(merged.height >> level, 1),
+            static_cast<GLsizei>(layers.size()), 0, static_cast<GLsizei>(levels[level].size()), levels[level].data());
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, merged.tailLevel);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, merged.levelCount - 1);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    for (unsigned int layer : layers) {
+        forget(layer);
+        glDeleteTextures(1, &layer);
+    }
+    residentBytes += residentBytesOf(merged);
+    merged.lastVisible = frame;
+    textures[arrayID] = merged;
+    report(arrayID, merged);
+    return arrayID;
+}
+
+void TextureStreamer::finish(LevelLoad* load) {
+    if (load->region.data)
+        ring->release(load->region);
+    delete load;
+}
+
+int TextureStreamer::getPendingLoads() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return static_cast<int>(requests.size() + completed.size()) + (uploading ? 1 : 0);
+}
+
+void TextureStreamer::workerLoop() {
+    for (;;) {
+        LevelLoad* load;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this] { return quitting || !requests.empty(); });
+            if (quitting)
+                return;
+            load = requests.front();
+            requests.pop_front();
+        }
+        // straight into the upload ring when it has room, otherwise into memory of our own
+        const size_t levelSize = load->layerBytes * load->paths.size();
+        unsigned char* data;
+        if (ring && ring->allocate(levelSize, load->region))
+            data = load->region.data;
+        else {
+            load->data.resize(levelSize);
+            data = load->data.data();
+        }
+        load->ok = true;
+        for (size_t i = 0; i < load->paths.size() && load->ok; i++)
+            load->ok = readKtx2Level(load->paths[i], load->level, data + i * load->layerBytes, load->layerBytes);
+        std::lock_guard<std::mutex> lock(mutex);
+        completed.push_back(load);
+    }
+}
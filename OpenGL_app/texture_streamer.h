@@ -0,0 +1,148 @@
+#ifndef TEXTURE_STREAMER_H
+#define TEXTURE_STREAMER_H
+
+#include <glad/glad.h>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "texture_cache.h"
+#include "upload_ring.h"
+
+// Streams the mip levels of cooked (KTX2) textures by demand.
+//
+// A texture starts with only its mip tail resident (levels of at most TAIL_SIZE texels), so the
+// scene appears right away. Every frame the renderer reports how many UV units one screen pixel
+// covers on each visible texture; the finest level that still has about a texel per pixel is
+// the level the texture wants. Finer levels are read from the cooked file on worker threads,
+// one level at a time from coarse to fine, and uploaded on the render thread in rows of blocks
+// under a per-frame byte limit, so even a 4K level never stalls a frame. Where buffer storage is
+// available the workers read straight into a persistently mapped UploadRing and the uploads copy
+// from there, so the driver does not copy client memory either.
+//
+// The budget is what TextureMemory's budget leaves over after every other texture. When the
+// resident levels exceed it, the finest levels of the textures that were seen longest ago are
+// dropped first. When the textures in view alone want more than fits, the streamer lowers the
+// quality of all of them with a mip bias, and raises it again once there is room to spare.
+//
+// Levels finer than GL_TEXTURE_BASE_LEVEL are left undefined (or shrunk to nothing when
+// evicted), which keeps the texture complete while only the resident levels use memory.
+// Textures of the same format and size can be merged into a GL_TEXTURE_2D_ARRAY, which then
+// streams as one texture: a level is loaded for every layer at once.
+class TextureStreamer {
+public:
+    static const int TAIL_SIZE = 128;
+
+    static const int MAX_QUALITY_BIAS = 4;
+
+    explicit TextureStreamer(size_t uploadBytesPerFrame = 2u << 20, int workerCount = 2, size_t stagingBytes = 32u << 20);
+    ~TextureStreamer();
+
+    TextureStreamer(const TextureStreamer&) = delete;
+    TextureStreamer& operator=(const TextureStreamer&) = delete;
+
+    // process-wide streamer used by the model loader
+    static TextureStreamer& shared();
+
+    // cooks the image if needed and creates its texture with the mip tail resident;
+    // 0 if it cannot be streamed (then upload it some other way)
+    unsigned int load(const std::string& path, TextureUsage usage);
+    // the same for a file that is cooked already, such as a texture atlas
+    unsigned int loadKtx2(const std::string& cookedPath);
+
+    // this frame the texture is seen with uvPerPixel UV units per screen pixel; the smallest
+    // value reported during a frame wins
+    void request(unsigned int texture, float uvPerPixel);
+
+    bool isStreamed(unsigned int texture) const { return textures.count(texture) != 0; }
+    // format and size of a streamed texture; false if it is not streamed
+    bool getFormat(unsigned int texture, BlockFormat& format, int& width, int& height) const;
+
+    // loads every level of the texture now and stops streaming it, e.g. before its state is
+    // frozen by a bindless handle
+    void release(unsigned int texture);
+
+    // moves streamed textures of one format and size into the layers of a new array texture,
+    // in order, and deletes them; 0 (and the textures are left alone) if they do not match
+    unsigned int mergeIntoArray(const std::vector<unsigned int>& layers);
+
+    // issues reads, uploads finished ones within the per-frame limit and evicts over budget;
+    // call once per frame, after the requests
+    void update();
+
+    size_t getResidentBytes() const { return residentBytes; }
+    // the share of the texture memory budget left to streaming as of the last update
+    size_t getBudgetBytes() const { return budgetBytes; }
+    // levels every texture is kept coarser than it wants, to stay within the budget
+    int getQualityBias() const { return qualityBias; }
+    int getPendingLoads() const;
+    // bytes of the upload ring waiting to be copied or for the GPU; 0 without one
+    size_t getStagingBytesInUse() const { return ring ? ring->getBytesInUse() : 0; }
+    size_t getStagingBytes() const { return ring ? ring->getCapacity() : 0; }
+
+private:
+    struct StreamedTexture {
+        GLenum target;                       // GL_TEXTURE_2D, or GL_TEXTURE_2D_ARRAY for merged textures
+        std::vector<std::string> layerPaths; // cooked file of every layer
+        GLenum internalFormat;
+        BlockFormat format;
+        int width, height;
+        int levelCount;
+        int tailLevel;        // coarsest level that is never evicted and the finest loaded at startup
+        int resident;         // finest resident level, GL_TEXTURE_BASE_LEVEL
+        int wanted;           // finest level asked for this frame
+        bool loading = false; // a finer level is being read or uploaded
+        unsigned long long lastVisible = 0; // update in which it was last requested
+    };
+
+    struct LevelLoad {
+        unsigned int texture;
+        int level;
+        std::vector<std::string> paths;
+        size_t layerBytes;
+        // the level of every layer, one after the other: in the upload ring when it had room
+        UploadRing::Region region;
+        std::vector<unsigned char> data;
+        bool ok = false;
+        int uploadedRows = 0; // rows of blocks already uploaded
+    };
+
+    std::map<unsigned int, StreamedTexture> textures;
+    size_t budgetBytes = 0;
+    unsigned long long frame = 0;
+    int qualityBias = 0;
+    int pressuredUpdates = 0; // in a row in which a wanted level did not fit
+    int relaxedUpdates = 0;   // in a row well within the budget
+    size_t uploadBytesPerFrame;
+    size_t residentBytes = 0;
+    size_t stagingBytes;
+    std::unique_ptr<UploadRing> ring; // created by the first update, on the GL thread
+
+    // worker threads read levels from requests into completed
+    std::vector<std::thread> workers;
+    mutable std::mutex mutex;
+    std::condition_variable wake;
+    bool quitting = false;
+    std::deque<LevelLoad*> requests;
+    std::deque<LevelLoad*> completed;
+    LevelLoad* uploading = nullptr;
+
+    size_t layerBytes(const StreamedTexture& texture, int level) const;
+    size_t levelBytes(const StreamedTexture& texture, int level) const;
+    size_t residentBytesOf(const StreamedTexture& texture) const;
+    // tells TextureMemory how much of the texture is resident now
+    void report(unsigned int id, const StreamedTexture& texture) const;
+    // stops streaming the texture, dropping its upload in progress
+    void forget(unsigned int id);
+    void uploadSome(size_t& bytesLeft);
+    void evictFinestLevel(unsigned int id, StreamedTexture& texture);
+    // frees the load and its upload ring region
+    void finish(LevelLoad* load);
+    void workerLoop();
+};
+
+#endif
@@ -0,0 +1,102 @@
+#include "upload_ring.h"
+#include "gl_extensions.h"
+
+namespace {
+    // enough for any texel or vertex format and for glCompressedTexSubImage offsets
+    const size_t REGION_ALIGNMENT = 16;
+}
+
+UploadRing::UploadRing(size_t capacity) : capacity(capacity) {
+    const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    glBufferStorage(GL_COPY_WRITE_BUFFER, capacity, nullptr, flags);
+    mapped = static_cast<unsigned char*>(glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, capacity, flags));
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+UploadRing::~UploadRing() {
+    for (const Allocation& allocation : allocations) {
+        if (allocation.fence)
+            glDeleteSync(allocation.fence);
+    }
+    if (mapped) {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+    glDeleteBuffers(1, &buffer);
+}
+
+bool UploadRing::isSupported() {
+    return (GLAD_GL_VERSION_4_4 || hasGLExtension("GL_ARB_buffer_storage")) && glBufferStorage != nullptr;
+}
+
+bool UploadRing::allocate(size_t size, Region& region) {
+    size = (size + REGION_ALIGNMENT - 1) / REGION_ALIGNMENT * REGION_ALIGNMENT;
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!mapped || size > capacity)
+        return false;
+
+    size_t offset;
+    if (allocations.empty())
+        offset = 0;
+    else {
+        const size_t tail = allocations.front().offset;
+        if (head > tail) {
+            // free: the end of the buffer, then the start up to the oldest region
+            if (head + size <= capacity)
+                offset = head;
+            else if (size <= tail)
+                offset = 0;
+            else
+                return false;
+        }
+        else if (head + size <= tail)
+            offset = head;
+        else
+            return false;
+    }
+
+    Allocation allocation = { offset, size, nullptr };
+    allocations.push_back(allocation);
+    head = offset + size;
+    region.offset = offset;
+    region.data = mapped + offset;
+    region.size = size;
+    return true;
+}
+
+void UploadRing::release(const Region& region) {
+    GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    std::lock_guard<std::mutex> lock(mutex);
+    for (Allocation& allocation : allocations) {
+        if (allocation.offset == region.offset && !allocation.fence) {
+            allocation.fence = fence;
+            return;
+        }
+    }
+    glDeleteSync(fence);
+}
+
+void UploadRing::reclaim() {
+    std::lock_guard<std::mutex> lock(mutex);
+    // in allocation order: a region released early waits for the ones before it
+    while (!allocations.empty() && allocations.front().fence) {
+        GLenum status = glClientWaitSync(allocations.front().fence, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+            break;
+        glDeleteSync(allocations.front().fence);
+        allocations.pop_front();
+    }
+    if (allocations.empty())
+        head = 0;
+}
+
+size_t UploadRing::getBytesInUse() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t bytes = 0;
+    for (const Allocation& allocation : allocations)
+        bytes += allocation.size;
+    return bytes;
+}
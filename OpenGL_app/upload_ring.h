@@ -0,0 +1,59 @@
+#ifndef UPLOAD_RING_H
+#define UPLOAD_RING_H
+
+#include <glad/glad.h>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+
+// A staging buffer that stays mapped for its whole life (GL_MAP_PERSISTENT_BIT, GL 4.4 or
+// ARB_buffer_storage), used as a ring of regions.
+//
+// Any thread may allocate a region and write texels or vertices straight into it; the GL thread
+// then copies from it with the buffer bound as GL_PIXEL_UNPACK_BUFFER (or GL_COPY_READ_BUFFER)
+// and releases it, which puts a fence behind those copies. The space is reused once the fence
+// has passed, so the driver never has to copy client memory or wait on the CPU.
+class UploadRing {
+public:
+    explicit UploadRing(size_t capacity);
+    ~UploadRing();
+
+    UploadRing(const UploadRing&) = delete;
+    UploadRing& operator=(const UploadRing&) = delete;
+
+    static bool isSupported();
+
+    struct Region {
+        size_t offset = 0; // into the buffer, for the copy commands
+        unsigned char* data = nullptr;
+        size_t size = 0;
+    };
+
+    // reserves size bytes, from any thread; false if the ring has no room for them right now
+    bool allocate(size_t size, Region& region);
+
+    // GL thread: the copies from the region are issued, it can be reused once the GPU is past them
+    void release(const Region& region);
+
+    // GL thread: frees the space of released regions whose copies have finished, once per frame
+    void reclaim();
+
+    unsigned int getBuffer() const { return buffer; }
+    size_t getCapacity() const { return capacity; }
+    size_t getBytesInUse() const;
+
+private:
+    struct Allocation {
+        size_t offset, size;
+        GLsync fence = nullptr; // set by release
+    };
+
+    unsigned int buffer = 0;
+    unsigned char* mapped = nullptr;
+    size_t capacity;
+    size_t head = 0; // where the next region starts, unless it has to wrap
+    mutable std::mutex mutex;
+    std::deque<Allocation> allocations; // live regions, oldest first
+};
+
+#endif
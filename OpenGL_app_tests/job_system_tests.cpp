@@ -0,0 +1,111 @@
+#include "test.h"
+#include "job_system.h"
+#include <algorithm>
+#include <chrono>
+
+TEST(jobSystemRunsNestedJobsAndContinuations) {
+    // parents that spawn and wait on children, a continuation that must see all of them
+    // finished, and a parallelFor that must visit every item once
+    const int ROUNDS = 50, PARENTS = 500, CHILDREN = 8, ITEMS = 100000;
+    const int hardwareThreads = std::max((int)std::thread::hardware_concurrency(), 2);
+    JobSystem system(hardwareThreads - 1);
+    for (int round = 0; round < ROUNDS; round++) {
+        std::atomic<int> done(0), seenByContinuation(-1);
+        JobCounter parents, after;
+        for (int i = 0; i < PARENTS; i++) {
+            system.run([&system, &done] {
+                JobCounter children;
+                for (int j = 0; j < CHILDREN; j++)
+                    system.run([&done] { done++; }, &children);
+                system.wait(children);
+                done++;
+            }, &parents);
+        }
+        system.runAfter(parents, [&done, &seenByContinuation] { seenByContinuation = done.load(); }, &after);
+        system.wait(after);
+        system.wait(parents);
+        CHECK(parents.isDone() && after.isDone());
+        CHECK(seenByContinuation.load() == PARENTS * (CHILDREN + 1));
+
+        std::vector<int> visits(ITEMS, 0);
+        system.parallelFor(0, ITEMS, 97, [&visits](int first, int last) {
+            for (int i = first; i < last; i++)
+                visits[i]++;
+        });
+        CHECK(std::count(visits.begin(), visits.end(), 1) == ITEMS);
+    }
+}
+
+TEST(jobSystemParallelForCoversRange) {
+    JobSystem system(3);
+    // ranges that do not start at 0, shorter than one grain, and empty
+    const int ranges[][3] = { { 10, 1000, 7 }, { 5, 8, 100 }, { 0, 1, 1 }, { 4, 4, 1 }, { 9, 3, 1 } };
+    for (const int* range : ranges) {
+        std::vector<std::atomic<int>> visits(1000);
+        for (std::atomic<int>& visit : visits)
+            visit = 0;
+        std::atomic<int> calls(0);
+        const int begin = range[0], end = range[1], grain = range[2];
+        system.parallelFor(begin, end, grain, [&](int first, int last) {
+            CHECK(first >= begin && last <= end && first < last && last - first <= grain);
+            for (int i = first; i < last; i++)
+                visits[i]++;
+            calls++;
+        });
+        for (int i = 0; i < 1000; i++)
+            CHECK(visits[i] == (i >= begin && i < end ? 1 : 0));
+        CHECK(calls == (end > begin ? (end - begin + grain - 1) / grain : 0));
+    }
+}
+
+TEST(jobSystemRunsContinuationOfFinishedCounter) {
+    JobSystem system(1);
+    JobCounter empty, after;
+    bool ran = false;
+    system.runAfter(empty, [&ran] { ran = true; }, &after);
+    system.wait(after);
+    CHECK(ran);
+}
+
+TEST(jobSystemWithoutWorkersRunsOnWaitingThread) {
+    JobSystem system(0);
+    CHECK(system.getWorkerCount() == 0);
+    const std::thread::id caller = std::this_thread::get_id();
+    std::atomic<int> onCaller(0);
+    JobCounter counter;
+    for (int i = 0; i < 100; i++)
+        system.run([&] { onCaller += std::this_thread::get_id() == caller; }, &counter);
+    system.wait(counter);
+    CHECK(onCaller == 100);
+}
+
+BENCHMARK(jobSystemScaling) {
+    // the same arithmetic-bound parallelFor on 1 to N threads, best of three runs
+    const int hardwareThreads = std::max((int)std::thread::hardware_concurrency(), 1);
+    const int ITEMS = 1 << 20, ITERATIONS = 32, GRAIN = 2048;
+    std::vector<float> results(ITEMS);
+    auto workload = [&results](int first, int last) {
+        for (int i = first; i < last; i++) {
+            float x = static_cast<float>(i);
+            for (int k = 0; k < ITERATIONS; k++)
+                x = std::sqrt(x * 0.5f + 1.0f) + std::sin(x);
+            results[i] = x;
+        }
+    };
+    std::cout << "Job system scaling:";
+    double singleMs = 0.0;
+    for (int threads = 1; threads <= hardwareThreads; threads++) {
+        JobSystem system(threads - 1);
+        double bestMs = 1e30;
+        for (int run = 0; run < 3; run++) {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            system.parallelFor(0, ITEMS, GRAIN, workload);
+            bestMs = std::min(bestMs, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        }
+        if (threads == 1)
+            singleMs = bestMs;
+        std::cout << (threads > 1 ? ", " : " ") << threads << (threads > 1 ? " threads " : " thread ") << bestMs << " ms ("
+            << singleMs / bestMs << "x)";
+    }
+    std::cout << std::endl;
+}
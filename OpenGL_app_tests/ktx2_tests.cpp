@@ -0,0 +1,120 @@
+#include "test.h"
+#include "ktx2.h"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+
+namespace {
+    const char* TEST_FILE = "ktx2_tests.ktx2";
+
+    // a full mip chain of made-up block data, a different byte pattern for every level
+    CompressedImage testImage(BlockFormat format, int width, int height, int faces) {
+        CompressedImage image;
+        image.format = format;
+        image.width = width;
+        image.height = height;
+        image.faces = faces;
+        for (int level = 0; ; level++) {
+            int levelWidth = std::max(width >> level, 1), levelHeight = std::max(height >> level, 1);
+            std::vector<unsigned char> data(TextureCompressor::levelBytes(format, levelWidth, levelHeight) * faces);
+            for (size_t i = 0; i < data.size(); i++)
+                data[i] = static_cast<unsigned char>(i * 7 + level * 31);
+            image.levels.push_back(data);
+            if (levelWidth == 1 && levelHeight == 1)
+                break;
+        }
+        return image;
+    }
+
+    std::vector<unsigned char> readFile(const char* path) {
+        std::ifstream file(path, std::ios::binary);
+        return std::vector<unsigned char>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+
+    void writeFile(const char* path, const std::vector<unsigned char>& bytes) {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+    }
+
+    unsigned long long get64(const unsigned char* in) {
+        unsigned long long value = 0;
+        for (int i = 7; i >= 0; i--)
+            value = (value << 8) | in[i];
+        return value;
+    }
+
+    // the offset and size of level in the level index, which follows the 80-byte header
+    void levelIndexEntry(const std::vector<unsigned char>& bytes, size_t level, unsigned long long& offset, unsigned long long& size) {
+        const unsigned char* entry = bytes.data() + 80 + level * 24;
+        offset = get64(entry);
+        size = get64(entry + 8);
+    }
+
+    void checkRoundTrip(const CompressedImage& image) {
+        CHECK(writeKtx2(TEST_FILE, image));
+
+        CompressedImage header;
+        CHECK(readKtx2Header(TEST_FILE, header));
+        CHECK(header.format == image.format && header.width == image.width && header.height == image.height);
+        CHECK(header.faces == image.faces && header.levels.size() == image.levels.size());
+        for (const std::vector<unsigned char>& level : header.levels)
+            CHECK(level.empty());
+
+        // the finest level left out, as when the texture budget drops it
+        CompressedImage coarse;
+        CHECK(readKtx2(TEST_FILE, coarse, 1));
+        CHECK(coarse.levels.size() == image.levels.size() && coarse.levels[0].empty());
+        for (size_t level = 1; level < image.levels.size(); level++)
+            CHECK(coarse.levels[level] == image.levels[level]);
+
+        for (size_t level = 0; level < image.levels.size(); level++) {
+            std::vector<unsigned char> data;
+            CHECK(readKtx2Level(TEST_FILE, static_cast<int>(level), data));
+            CHECK(data == image.levels[level]);
+            std::vector<unsigned char> mapped(image.levels[level].size());
+            CHECK(readKtx2Level(TEST_FILE, static_cast<int>(level), mapped.data(), mapped.size()));
+            CHECK(mapped == image.levels[level]);
+            CHECK(!readKtx2Level(TEST_FILE, static_cast<int>(level), mapped.data(), mapped.size() + 1));
+        }
+        std::vector<unsigned char> data;
+        CHECK(!readKtx2Level(TEST_FILE, static_cast<int>(image.levels.size()), data));
+
+        // every level starts on a block boundary of the file
+        std::vector<unsigned char> bytes = readFile(TEST_FILE);
+        for (size_t level = 0; level < image.levels.size(); level++) {
+            unsigned long long offset, size;
+            levelIndexEntry(bytes, level, offset, size);
+            CHECK(offset % TextureCompressor::blockBytes(image.format) == 0);
+            CHECK(size == image.levels[level].size() && offset + size <= bytes.size());
+        }
+        std::remove(TEST_FILE);
+    }
+}
+
+TEST(ktx2RoundTripsBC1) {
+    checkRoundTrip(testImage(BLOCK_BC1, 20, 12, 1));
+}
+
+TEST(ktx2RoundTripsBC5) {
+    checkRoundTrip(testImage(BLOCK_BC5, 32, 16, 1));
+}
+
+TEST(ktx2RoundTripsCubeMap) {
+    checkRoundTrip(testImage(BLOCK_BC7, 16, 16, 6));
+}
+
+TEST(ktx2RejectsWrongLevelSize) {
+    CHECK(writeKtx2(TEST_FILE, testImage(BLOCK_BC1, 16, 16, 1)));
+    std::vector<unsigned char> bytes = readFile(TEST_FILE);
+    // level 1 claims one block more than an 8x8 BC1 level holds
+    bytes[80 + 24 + 8] += 8;
+    writeFile(TEST_FILE, bytes);
+
+    CompressedImage image;
+    CHECK(!readKtx2Header(TEST_FILE, image));
+    CHECK(!readKtx2(TEST_FILE, image));
+    std::vector<unsigned char> data;
+    CHECK(!readKtx2Level(TEST_FILE, 0, data));
+    std::remove(TEST_FILE);
+}
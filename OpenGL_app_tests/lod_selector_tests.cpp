@@ -0,0 +1,37 @@
+#include "test.h"
+#include "lod_selector.h"
+
+TEST(lodScreenSizeFromDistance) {
+    const float fovy = 2.0f * std::atan(1.0f); // 90 degrees, tan(fovy / 2) = 1
+    CHECK_NEAR(LodSelector::screenSize(glm::vec3(0.0f, 0.0f, -10.0f), 1.0f, glm::vec3(0.0f), fovy), 0.1f, 1e-6);
+    CHECK_NEAR(LodSelector::screenSize(glm::vec3(0.0f, 0.0f, -20.0f), 1.0f, glm::vec3(0.0f), fovy), 0.05f, 1e-6);
+    // the camera inside the bounds sees it full screen
+    CHECK(LodSelector::screenSize(glm::vec3(0.0f), 1.0f, glm::vec3(0.5f, 0.0f, 0.0f), fovy) == 1.0f);
+}
+
+TEST(lodHalvesThresholdPerLevel) {
+    // thresholds 0.5, 0.25, 0.125 with 15% hysteresis on either side
+    LodSelector selector(0.5f, 0.15f);
+    CHECK(selector.select(0.6f, 4) == 0);
+    CHECK(selector.select(0.4f, 4) == 1);
+    CHECK(selector.select(0.2f, 4) == 2);
+    CHECK(selector.select(0.01f, 4) == 3);
+    CHECK(selector.select(1.0f, 4) == 0);
+}
+
+TEST(lodHysteresisHoldsLevelNearThreshold) {
+    LodSelector selector(0.5f, 0.15f);
+    CHECK(selector.select(0.45f, 4) == 0); // below 0.5 but not below 0.425
+    CHECK(selector.select(0.42f, 4) == 1);
+    CHECK(selector.select(0.55f, 4) == 1); // above 0.5 but not above 0.575
+    CHECK(selector.select(0.58f, 4) == 0);
+    CHECK(selector.getLod() == 0);
+}
+
+TEST(lodClampsToAvailableLevels) {
+    LodSelector selector;
+    CHECK(selector.select(0.001f, 2) == 1);
+    CHECK(selector.select(0.001f, 4) == 3);
+    // a mesh with fewer levels than last frame's choice
+    CHECK(selector.select(0.001f, 1) == 0);
+}
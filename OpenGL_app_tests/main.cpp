@@ -0,0 +1,21 @@
+#include "test.h"
+#include <cstring>
+
+// runs every test; with --benchmark the benchmarks too. Exits with 1 if any check failed.
+int main(int argc, char** argv) {
+    bool benchmarks = false;
+    for (int i = 1; i < argc; i++)
+        benchmarks = benchmarks || std::strcmp(argv[i], "--benchmark") == 0;
+
+    int run = 0;
+    for (const TestCase& test : testCases()) {
+        if (test.benchmark && !benchmarks)
+            continue;
+        int failuresBefore = testFailures();
+        test.function();
+        run++;
+        std::cout << (testFailures() == failuresBefore ? "ok     " : "FAILED ") << test.name << std::endl;
+    }
+    std::cout << run << " run, " << testFailures() << " failed checks" << std::endl;
+    return testFailures() == 0 ? 0 : 1;
+}
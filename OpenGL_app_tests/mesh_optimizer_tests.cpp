@@ -0,0 +1,178 @@
+#include "test.h"
+#include "test_meshes.h"
+#include "mesh_optimizer.h"
+#include <algorithm>
+#include <array>
+#include <random>
+#include <set>
+
+namespace {
+    typedef std::array<unsigned int, 3> Triangle;
+
+    std::vector<Triangle> sortedTriangles(const std::vector<unsigned int>& indices) {
+        std::vector<Triangle> triangles;
+        for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+            Triangle triangle = { { indices[t], indices[t + 1], indices[t + 2] } };
+            triangles.push_back(triangle);
+        }
+        std::sort(triangles.begin(), triangles.end());
+        return triangles;
+    }
+
+    // the same triangles with their corners in the same order (so the same winding), in any order
+    bool sameTriangles(const std::vector<unsigned int>& a, const std::vector<unsigned int>& b) {
+        return a.size() == b.size() && sortedTriangles(a) == sortedTriangles(b);
+    }
+
+    std::vector<unsigned int> shuffledTriangles(const std::vector<unsigned int>& indices, unsigned int seed) {
+        std::vector<Triangle> triangles;
+        for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+            Triangle triangle = { { indices[t], indices[t + 1], indices[t + 2] } };
+            triangles.push_back(triangle);
+        }
+        std::mt19937 random(seed);
+        std::shuffle(triangles.begin(), triangles.end(), random);
+        std::vector<unsigned int> result;
+        for (const Triangle& triangle : triangles)
+            result.insert(result.end(), triangle.begin(), triangle.end());
+        return result;
+    }
+}
+
+TEST(optimizerAcmrCountsCacheMisses) {
+    std::vector<unsigned int> one = { 0, 1, 2 };
+    CHECK_NEAR(MeshOptimizer::acmr(one, 3), 3.0, 1e-6);
+    std::vector<unsigned int> quad = { 0, 1, 2, 0, 2, 3 };
+    CHECK_NEAR(MeshOptimizer::acmr(quad, 4), 2.0, 1e-6);
+    // a cache of 3 has lost vertex 0 by the time it is used again
+    std::vector<unsigned int> fan = { 0, 1, 2, 3, 4, 5, 0, 1, 2 };
+    CHECK_NEAR(MeshOptimizer::acmr(fan, 6, 3), 3.0, 1e-6);
+}
+
+TEST(optimizerVertexCacheIsPermutation) {
+    std::vector<glm::vec3> positions;
+    std::vector<unsigned int> grid;
+    buildGrid(32, positions, grid);
+    std::vector<unsigned int> indices = shuffledTriangles(grid, 7);
+
+    std::vector<unsigned int> clusters;
+    std::vector<unsigned int> optimized = MeshOptimizer::optimizeVertexCache(indices, positions.size(),
+        MeshOptimizer::DEFAULT_CACHE_SIZE, &clusters);
+    CHECK(sameTriangles(optimized, indices));
+
+    // clusters start at triangle 0 and strictly increase
+    CHECK(!clusters.empty() && clusters[0] == 0);
+    for (size_t i = 1; i < clusters.size(); i++)
+        CHECK(clusters[i] > clusters[i - 1] && clusters[i] < optimized.size() / 3);
+}
+
+TEST(optimizerVertexCacheLowersAcmr) {
+    std::vector<glm::vec3> positions;
+    std::vector<unsigned int> grid;
+    buildGrid(32, positions, grid);
+    std::vector<unsigned int> indices = shuffledTriangles(grid, 11);
+
+    std::vector<unsigned int> optimized = MeshOptimizer::optimizeVertexCache(indices, positions.size());
+    float before = MeshOptimizer::acmr(indices, positions.size());
+    float after = MeshOptimizer::acmr(optimized, positions.size());
+    // a shuffled grid misses nearly every vertex; a good order gets close to the 0.5 ideal
+    CHECK(before > 2.0f);
+    CHECK(after < 0.8f);
+}
+
+TEST(optimizerOverdrawIsPermutation) {
+    std::vector<glm::vec3> positions;
+    std::vector<unsigned int> sphere;
+    buildSphere(16, 24, positions, sphere);
+    std::vector<unsigned int> indices = shuffledTriangles(sphere, 3);
+
+    std::vector<unsigned int> clusters;
+    std::vector<unsigned int> cacheOrder = MeshOptimizer::optimizeVertexCache(indices, positions.size(),
+        MeshOptimizer::DEFAULT_CACHE_SIZE, &clusters);
+    std::vector<unsigned int> overdrawOrder = MeshOptimizer::optimizeOverdraw(cacheOrder, positions, clusters);
+    CHECK(sameTriangles(overdrawOrder, indices));
+    // clusters only split where the cache is about as cold, so most of the gain stays
+    CHECK(MeshOptimizer::acmr(overdrawOrder, positions.size()) < MeshOptimizer::acmr(indices, positions.size()) * 0.5f);
+}
+
+TEST(optimizerVertexFetchRenumbersInFirstUseOrder) {
+    std::vector<glm::vec3> positions;
+    std::vector<unsigned int> grid;
+    buildGrid(8, positions, grid);
+    // one vertex no triangle uses
+    positions.push_back(glm::vec3(5.0f));
+    std::vector<unsigned int> original = shuffledTriangles(grid, 5);
+    std::vector<unsigned int> indices = original;
+
+    std::vector<unsigned int> remap = MeshOptimizer::optimizeVertexFetch(indices, positions.size());
+
+    // a permutation of the vertices, with the unused one last
+    CHECK(remap.size() == positions.size());
+    std::set<unsigned int> targets(remap.begin(), remap.end());
+    CHECK(targets.size() == positions.size() && *targets.rbegin() == positions.size() - 1);
+    CHECK(remap.back() == positions.size() - 1);
+
+    // every index points at the same vertex as before, and new numbers appear in order
+    unsigned int next = 0;
+    for (size_t i = 0; i < indices.size(); i++) {
+        CHECK(indices[i] == remap[original[i]]);
+        CHECK(indices[i] <= next);
+        if (indices[i] == next)
+            next++;
+    }
+    CHECK(next == positions.size() - 1);
+}
+
+TEST(optimizerMeshletsRespectLimits) {
+    std::vector<glm::vec3> positions;
+    std::vector<unsigned int> sphere;
+    buildSphere(32, 48, positions, sphere);
+    std::vector<unsigned int> indices = MeshOptimizer::optimizeVertexCache(sphere, positions.size());
+
+    std::vector<Meshlet> meshlets = MeshOptimizer::buildMeshlets(indices, positions);
+    CHECK(!meshlets.empty());
+
+    // consecutive runs covering every index once
+    unsigned int expectedFirst = 0;
+    for (const Meshlet& meshlet : meshlets) {
+        CHECK(meshlet.firstIndex == expectedFirst);
+        CHECK(meshlet.indexCount > 0 && meshlet.indexCount % 3 == 0);
+        CHECK(meshlet.indexCount <= 3u * MeshOptimizer::MAX_MESHLET_TRIANGLES);
+        expectedFirst = meshlet.firstIndex + meshlet.indexCount;
+
+        std::set<unsigned int> vertices(indices.begin() + meshlet.firstIndex, indices.begin() + expectedFirst);
+        CHECK(vertices.size() <= (size_t)MeshOptimizer::MAX_MESHLET_VERTICES);
+        for (unsigned int vertex : vertices)
+            CHECK(glm::length(positions[vertex] - meshlet.center) <= meshlet.radius * 1.0001f + 1e-6f);
+    }
+    CHECK(expectedFirst == indices.size());
+}
+
+TEST(optimizerMeshletConesAreConservative) {
+    // a meshlet may only be culled from a viewpoint that sees the back of every one of its triangles
+    std::vector<glm::vec3> positions;
+    std::vector<unsigned int> sphere;
+    buildSphere(32, 48, positions, sphere);
+    std::vector<unsigned int> indices = MeshOptimizer::optimizeVertexCache(sphere, positions.size());
+    std::vector<Meshlet> meshlets = MeshOptimizer::buildMeshlets(indices, positions);
+
+    std::mt19937 random(17);
+    std::uniform_real_distribution<float> coordinate(-4.0f, 4.0f);
+    int culled = 0, tested = 0;
+    for (int view = 0; view < 200; view++) {
+        glm::vec3 viewer(coordinate(random), coordinate(random), coordinate(random));
+        for (const Meshlet& meshlet : meshlets) {
+            tested++;
+            if (glm::dot(glm::normalize(meshlet.coneApex - viewer), meshlet.coneAxis) < meshlet.coneCutoff)
+                continue;
+            culled++;
+            for (unsigned int i = meshlet.firstIndex; i < meshlet.firstIndex + meshlet.indexCount; i += 3) {
+                const glm::vec3& a = positions[indices[i]];
+                glm::vec3 normal = glm::cross(positions[indices[i + 1]] - a, positions[indices[i + 2]] - a);
+                CHECK(glm::dot(normal, viewer - a) <= 1e-5f);
+            }
+        }
+    }
+    // and the cones are tight enough to cull something
+    CHECK(culled > tested / 10);
+}
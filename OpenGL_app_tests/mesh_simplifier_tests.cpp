@@ -0,0 +1,123 @@
+#include "test.h"
+#include "test_meshes.h"
+#include "mesh_simplifier.h"
+
+namespace {
+    glm::vec3 triangleNormal(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices, size_t triangle) {
+        const glm::vec3& a = positions[indices[triangle * 3]];
+        return glm::cross(positions[indices[triangle * 3 + 1]] - a, positions[indices[triangle * 3 + 2]] - a);
+    }
+
+    // every index in range and no triangle collapsed to a line or a point
+    bool wellFormed(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices) {
+        if (indices.size() % 3 != 0)
+            return false;
+        for (size_t t = 0; t < indices.size() / 3; t++) {
+            for (int c = 0; c < 3; c++)
+                if (indices[t * 3 + c] >= positions.size())
+                    return false;
+            if (glm::length(triangleNormal(positions, indices, t)) <= 0.0f)
+                return false;
+        }
+        return true;
+    }
+}
+
+TEST(simplifierReachesTargetTriangleCount) {
+    std::vector<glm::vec3> positions;
+    std::vector<unsigned int> indices;
+    buildSphere(24, 32, positions, indices);
+    const size_t original = indices.size() / 3;
+
+    MeshSimplifier simplifier(positions, indices);
+    const size_t targets[] = { original / 2, original / 4, original / 8 };
+    size_t previous = original;
+    for (size_t target : targets) {
+        std::vector<unsigned int> lod = simplifier.simplify(target, 1.0f);
+        CHECK(lod.size() / 3 <= target);
+        CHECK(lod.size() / 3 == simplifier.getTriangleCount());
+        CHECK(lod.size() / 3 < previous);
+        CHECK(wellFormed(positions, lod));
+        previous = lod.size() / 3;
+    }
+}
+
+TEST(simplifierStaysWithinErrorBound) {
+    std::vector<glm::vec3> positions;
+    std::vector<unsigned int> indices;
+    buildSphere(24, 32, positions, indices);
+
+    // with no triangle target, the error bound alone decides how far it goes
+    const float maxError = 0.01f;
+    MeshSimplifier simplifier(positions, indices);
+    std::vector<unsigned int> lod = simplifier.simplify(0, maxError);
+    CHECK(simplifier.getError() <= maxError);
+    CHECK(lod.size() < indices.size());
+    CHECK(lod.size() / 3 >= 8);
+    CHECK(wellFormed(positions, lod));
+
+    // the simplified surface stays close to the sphere: a triangle's centre sinks in by its
+    // sagitta, which collapses within the bound keep small
+    for (size_t t = 0; t < lod.size() / 3; t++) {
+        glm::vec3 centre = (positions[lod[t * 3]] + positions[lod[t * 3 + 1]] + positions[lod[t * 3 + 2]]) / 3.0f;
+        CHECK(1.0f - glm::length(centre) <= 4.0f * maxError);
+    }
+
+    // a looser bound goes further
+    MeshSimplifier looser(positions, indices);
+    std::vector<unsigned int> coarser = looser.simplify(0, 0.05f);
+    CHECK(coarser.size() < lod.size());
+}
+
+TEST(simplifierKeepsFlatGridShape) {
+    // a flat grid collapses at no cost; its open border must stay put, and no triangle may flip
+    std::vector<glm::vec3> positions;
+    std::vector<unsigned int> indices;
+    buildGrid(16, positions, indices);
+
+    MeshSimplifier simplifier(positions, indices);
+    std::vector<unsigned int> lod = simplifier.simplify(0, 0.0001f);
+    CHECK(lod.size() / 3 < indices.size() / 3 / 4);
+    CHECK(wellFormed(positions, lod));
+
+    float area = 0.0f;
+    for (size_t t = 0; t < lod.size() / 3; t++) {
+        glm::vec3 normal = triangleNormal(positions, lod, t);
+        CHECK(normal.z > 0.0f);
+        area += 0.5f * normal.z;
+    }
+    CHECK_NEAR(area, 1.0f, 1e-4);
+}
+
+TEST(simplifierKeepsSeamsInPlace) {
+    // two halves of a grid, each with its own vertices along x = 0.5 as a UV seam would give
+    std::vector<glm::vec3> shared;
+    std::vector<unsigned int> sharedIndices;
+    buildGrid(16, shared, sharedIndices);
+    std::vector<glm::vec3> positions = shared;
+    positions.insert(positions.end(), shared.begin(), shared.end());
+    std::vector<unsigned int> indices;
+    const unsigned int rightHalf = static_cast<unsigned int>(shared.size());
+    for (size_t t = 0; t < sharedIndices.size() / 3; t++) {
+        bool right = shared[sharedIndices[t * 3]].x + shared[sharedIndices[t * 3 + 1]].x + shared[sharedIndices[t * 3 + 2]].x > 1.5f;
+        for (int c = 0; c < 3; c++)
+            indices.push_back(sharedIndices[t * 3 + c] + (right ? rightHalf : 0));
+    }
+
+    MeshSimplifier simplifier(positions, indices);
+    std::vector<unsigned int> lod = simplifier.simplify(0, 0.0001f);
+    CHECK(lod.size() / 3 < indices.size() / 3 / 4);
+    CHECK(wellFormed(positions, lod));
+
+    // each half keeps to its side of the seam and the two still cover the square
+    float area = 0.0f;
+    for (size_t t = 0; t < lod.size() / 3; t++) {
+        bool right = lod[t * 3] >= rightHalf;
+        for (int c = 0; c < 3; c++) {
+            CHECK((lod[t * 3 + c] >= rightHalf) == right);
+            CHECK(right ? positions[lod[t * 3 + c]].x >= 0.5f : positions[lod[t * 3 + c]].x <= 0.5f);
+        }
+        area += 0.5f * triangleNormal(positions, lod, t).z;
+    }
+    CHECK_NEAR(area, 1.0f, 1e-4);
+}
@@ -0,0 +1,202 @@
+#include "test.h"
+#include "occlusion_rasterizer.h"
+#include <chrono>
+#include <random>
+
+namespace {
+    const int WIDTH = 256;
+    const int HEIGHT = 192;
+
+    // with an identity view-projection, positions are NDC; these take pixel coordinates and a
+    // depth in [0, 1] there instead
+    void addVertex(std::vector<float>& positions, float x, float y, float depth) {
+        positions.push_back(x / WIDTH * 2.0f - 1.0f);
+        positions.push_back(y / HEIGHT * 2.0f - 1.0f);
+        positions.push_back(depth * 2.0f - 1.0f);
+    }
+
+    void addTriangles(OcclusionRasterizer& rasterizer, const std::vector<float>& positions) {
+        std::vector<unsigned int> indices;
+        for (unsigned int i = 0; i < positions.size() / 3; i++)
+            indices.push_back(i);
+        rasterizer.addOccluder(positions.data(), indices.data(), indices.size(), glm::mat4(1.0f));
+    }
+
+    void addRectangle(OcclusionRasterizer& rasterizer, float x0, float y0, float x1, float y1, float depth) {
+        std::vector<float> positions;
+        addVertex(positions, x0, y0, depth);
+        addVertex(positions, x1, y0, depth);
+        addVertex(positions, x1, y1, depth);
+        addVertex(positions, x0, y0, depth);
+        addVertex(positions, x1, y1, depth);
+        addVertex(positions, x0, y1, depth);
+        addTriangles(rasterizer, positions);
+    }
+
+    int coveredPixels(const OcclusionRasterizer& rasterizer) {
+        int covered = 0;
+        for (int y = 0; y < rasterizer.getHeight(); y++)
+            for (int x = 0; x < rasterizer.getWidth(); x++)
+                covered += rasterizer.getDepth(x, y) < 1.0f;
+        return covered;
+    }
+}
+
+TEST(rasterizerRoundsWidthToFour) {
+    OcclusionRasterizer rasterizer(250, 10);
+    CHECK(rasterizer.getWidth() == 252);
+    CHECK(rasterizer.getHeight() == 10);
+}
+
+TEST(rasterizerFillsFullScreenQuad) {
+    OcclusionRasterizer rasterizer(WIDTH, HEIGHT);
+    rasterizer.beginFrame(glm::mat4(1.0f));
+    addRectangle(rasterizer, 0.0f, 0.0f, WIDTH, HEIGHT, 0.5f);
+    rasterizer.rasterize();
+
+    CHECK(rasterizer.getTrianglesRasterized() == 2);
+    CHECK(coveredPixels(rasterizer) == WIDTH * HEIGHT);
+    CHECK_NEAR(rasterizer.getDepth(0, 0), 0.5f, 1e-5);
+    CHECK_NEAR(rasterizer.getDepth(WIDTH - 1, HEIGHT - 1), 0.5f, 1e-5);
+    CHECK_NEAR(rasterizer.getDepth(WIDTH / 2, HEIGHT / 2), 0.5f, 1e-5);
+}
+
+TEST(rasterizerCoversPixelCentresInside) {
+    // the legs are a quarter pixel longer than 64, so no pixel centre lies on the hypotenuse:
+    // pixel (x, y) is covered when x + y <= 63, 64 + 63 + ... + 1 pixels
+    for (int winding = 0; winding < 2; winding++) {
+        OcclusionRasterizer rasterizer(WIDTH, HEIGHT);
+        rasterizer.beginFrame(glm::mat4(1.0f));
+        std::vector<float> positions;
+        addVertex(positions, 0.0f, 0.0f, 0.25f);
+        addVertex(positions, winding ? 0.0f : 64.25f, winding ? 64.25f : 0.0f, 0.25f);
+        addVertex(positions, winding ? 64.25f : 0.0f, winding ? 0.0f : 64.25f, 0.25f);
+        addTriangles(rasterizer, positions);
+        rasterizer.rasterize();
+
+        CHECK(coveredPixels(rasterizer) == 64 * 65 / 2);
+        CHECK(rasterizer.getDepth(0, 0) < 1.0f);
+        CHECK(rasterizer.getDepth(63, 0) < 1.0f);
+        CHECK(rasterizer.getDepth(0, 63) < 1.0f);
+        CHECK(rasterizer.getDepth(32, 31) < 1.0f);
+        CHECK(rasterizer.getDepth(32, 32) == 1.0f);
+        CHECK(rasterizer.getDepth(64, 0) == 1.0f);
+    }
+}
+
+TEST(rasterizerInterpolatesDepth) {
+    // depth rises linearly from 0.2 at the left edge to 0.8 at the right one
+    OcclusionRasterizer rasterizer(WIDTH, HEIGHT);
+    rasterizer.beginFrame(glm::mat4(1.0f));
+    std::vector<float> positions;
+    addVertex(positions, 0.0f, 0.0f, 0.2f);
+    addVertex(positions, WIDTH, 0.0f, 0.8f);
+    addVertex(positions, WIDTH, HEIGHT, 0.8f);
+    addVertex(positions, 0.0f, 0.0f, 0.2f);
+    addVertex(positions, WIDTH, HEIGHT, 0.8f);
+    addVertex(positions, 0.0f, HEIGHT, 0.2f);
+    addTriangles(rasterizer, positions);
+    rasterizer.rasterize();
+
+    const int columns[] = { 0, 1, 63, 64, 130, WIDTH - 1 };
+    const int rows[] = { 0, 31, 32, HEIGHT - 1 };
+    for (int x : columns)
+        for (int y : rows)
+            CHECK_NEAR(rasterizer.getDepth(x, y), 0.2f + 0.6f * (x + 0.5f) / WIDTH, 1e-4);
+}
+
+TEST(rasterizerKeepsNearestDepth) {
+    // the same two overlapping rectangles in both orders
+    for (int order = 0; order < 2; order++) {
+        OcclusionRasterizer rasterizer(WIDTH, HEIGHT);
+        rasterizer.beginFrame(glm::mat4(1.0f));
+        if (order == 0) {
+            addRectangle(rasterizer, 0.0f, 0.0f, 128.0f, 128.0f, 0.7f);
+            addRectangle(rasterizer, 64.0f, 64.0f, 192.0f, 192.0f, 0.3f);
+        }
+        else {
+            addRectangle(rasterizer, 64.0f, 64.0f, 192.0f, 192.0f, 0.3f);
+            addRectangle(rasterizer, 0.0f, 0.0f, 128.0f, 128.0f, 0.7f);
+        }
+        rasterizer.rasterize();
+
+        CHECK_NEAR(rasterizer.getDepth(10, 10), 0.7f, 1e-5);
+        CHECK_NEAR(rasterizer.getDepth(100, 100), 0.3f, 1e-5);
+        CHECK_NEAR(rasterizer.getDepth(150, 150), 0.3f, 1e-5);
+        CHECK(rasterizer.getDepth(200, 10) == 1.0f);
+        CHECK(coveredPixels(rasterizer) == 128 * 128 * 2 - 64 * 64);
+    }
+}
+
+TEST(rasterizerSkipsTrianglesCrossingNearPlane) {
+    OcclusionRasterizer rasterizer(WIDTH, HEIGHT);
+    rasterizer.beginFrame(glm::mat4(1.0f));
+    std::vector<float> positions;
+    addVertex(positions, 0.0f, 0.0f, 0.5f);
+    addVertex(positions, 100.0f, 0.0f, -0.5f); // NDC z below -1
+    addVertex(positions, 0.0f, 100.0f, 0.5f);
+    addTriangles(rasterizer, positions);
+    rasterizer.rasterize();
+
+    CHECK(rasterizer.getTrianglesRasterized() == 0);
+    CHECK(coveredPixels(rasterizer) == 0);
+}
+
+TEST(rasterizerBeginFrameClears) {
+    OcclusionRasterizer rasterizer(WIDTH, HEIGHT);
+    rasterizer.beginFrame(glm::mat4(1.0f));
+    addRectangle(rasterizer, 0.0f, 0.0f, WIDTH, HEIGHT, 0.5f);
+    rasterizer.rasterize();
+    rasterizer.beginFrame(glm::mat4(1.0f));
+    rasterizer.rasterize();
+
+    CHECK(rasterizer.getTrianglesRasterized() == 0);
+    CHECK(coveredPixels(rasterizer) == 0);
+}
+
+TEST(rasterizerTestsBoxesAgainstDepth) {
+    // an occluder over the middle of the screen at NDC z 0
+    OcclusionRasterizer rasterizer(WIDTH, HEIGHT);
+    rasterizer.beginFrame(glm::mat4(1.0f));
+    addRectangle(rasterizer, 64.0f, 48.0f, 192.0f, 144.0f, 0.5f);
+    rasterizer.rasterize();
+
+    // NDC boxes: behind and inside the occluder, in front of it, behind but reaching past its edge
+    CHECK(!rasterizer.isVisible(glm::vec3(-0.2f, -0.2f, 0.2f), glm::vec3(0.2f, 0.2f, 0.4f)));
+    CHECK(rasterizer.isVisible(glm::vec3(-0.2f, -0.2f, -0.4f), glm::vec3(0.2f, 0.2f, -0.2f)));
+    CHECK(rasterizer.isVisible(glm::vec3(-0.2f, -0.2f, 0.2f), glm::vec3(0.8f, 0.2f, 0.4f)));
+    // a box straddling the occluder's depth is visible
+    CHECK(rasterizer.isVisible(glm::vec3(-0.2f, -0.2f, -0.2f), glm::vec3(0.2f, 0.2f, 0.4f)));
+    // entirely outside the view
+    CHECK(!rasterizer.isVisible(glm::vec3(1.5f, -0.2f, 0.2f), glm::vec3(2.0f, 0.2f, 0.4f)));
+}
+
+BENCHMARK(rasterizerTrianglesPerMillisecond) {
+    // small triangles spread over the screen, as a tessellated occluder would give
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<float> position(0.0f, 1.0f), offset(-12.0f, 12.0f), depth(0.1f, 0.9f);
+    std::vector<float> positions;
+    const int triangleCount = 20000;
+    for (int i = 0; i < triangleCount; i++) {
+        float x = position(random) * WIDTH, y = position(random) * HEIGHT, z = depth(random);
+        for (int v = 0; v < 3; v++)
+            addVertex(positions, x + offset(random), y + offset(random), z);
+    }
+
+    OcclusionRasterizer rasterizer(WIDTH, HEIGHT);
+    const int frames = 50;
+    double rasterizeMs = 0.0, frameMs = 0.0;
+    int rasterized = 0;
+    for (int frame = 0; frame < frames; frame++) {
+        std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+        rasterizer.beginFrame(glm::mat4(1.0f));
+        addTriangles(rasterizer, positions);
+        rasterizer.rasterize();
+        frameMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+        rasterizeMs += rasterizer.getRasterizeMilliseconds();
+        rasterized += rasterizer.getTrianglesRasterized();
+    }
+    std::cout << "Occlusion rasterizer: " << rasterized / frames << " triangles, " << rasterizeMs / frames << " ms to rasterize ("
+        << rasterized / rasterizeMs << " triangles/ms), " << frameMs / frames << " ms with transform and binning ("
+        << rasterized / frameMs << " triangles/ms)" << std::endl;
+}
@@ -0,0 +1,66 @@
+#ifndef TEST_H
+#define TEST_H
+
+#include <atomic>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+// A minimal test runner for the parts of the renderer that do not need a GL context.
+//
+// TEST(name) { ... } registers a test; CHECK and CHECK_NEAR report a failure and let the test
+// go on. BENCHMARK(name) registers a benchmark, which only runs with --benchmark and prints
+// its own results.
+struct TestCase {
+    const char* name;
+    void (*function)();
+    bool benchmark;
+};
+
+inline std::vector<TestCase>& testCases() {
+    static std::vector<TestCase> cases;
+    return cases;
+}
+
+// checks may run on job system workers
+inline std::atomic<int>& testFailures() {
+    static std::atomic<int> failures(0);
+    return failures;
+}
+
+struct TestRegistrar {
+    TestRegistrar(const char* name, void (*function)(), bool benchmark) {
+        TestCase test = { name, function, benchmark };
+        testCases().push_back(test);
+    }
+};
+
+#define TEST(name) \
+    static void name(); \
+    static TestRegistrar name##Registrar(#name, name, false); \
+    static void name()
+
+#define BENCHMARK(name) \
+    static void name(); \
+    static TestRegistrar name##Registrar(#name, name, true); \
+    static void name()
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            std::cout << "FAILED::CHECK: " << __FILE__ << "(" << __LINE__ << "): " << #condition << std::endl; \
+            testFailures()++; \
+        } \
+    } while (0)
+
+#define CHECK_NEAR(actual, expected, tolerance) \
+    do { \
+        double actualValue = (actual), expectedValue = (expected); \
+        if (!(std::fabs(actualValue - expectedValue) <= (tolerance))) { \
+            std::cout << "FAILED::CHECK_NEAR: " << __FILE__ << "(" << __LINE__ << "): " << #actual << " is " << actualValue \
+                << ", expected " << expectedValue << std::endl; \
+            testFailures()++; \
+        } \
+    } while (0)
+
+#endif
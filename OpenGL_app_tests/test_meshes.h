@@ -0,0 +1,51 @@
+#ifndef TEST_MESHES_H
+#define TEST_MESHES_H
+
+#include <glm/glm.hpp>
+#include <cmath>
+#include <vector>
+
+// small indexed triangle meshes shared by the mesh tests
+
+// closed unit sphere with shared vertices and one vertex per pole, counter-clockwise outside
+inline void buildSphere(int stacks, int slices, std::vector<glm::vec3>& positions, std::vector<unsigned int>& indices) {
+    const float pi = 3.14159265f;
+    positions.push_back(glm::vec3(0.0f, 1.0f, 0.0f));
+    for (int stack = 1; stack < stacks; stack++) {
+        float phi = pi * stack / stacks;
+        for (int slice = 0; slice < slices; slice++) {
+            float theta = 2.0f * pi * slice / slices;
+            positions.push_back(glm::vec3(std::sin(phi) * std::cos(theta), std::cos(phi), std::sin(phi) * std::sin(theta)));
+        }
+    }
+    positions.push_back(glm::vec3(0.0f, -1.0f, 0.0f));
+    const unsigned int bottom = static_cast<unsigned int>(positions.size() - 1);
+    auto ring = [slices](int stack, int slice) { return 1u + (stack - 1) * slices + (slice % slices); };
+
+    for (int slice = 0; slice < slices; slice++) {
+        indices.insert(indices.end(), { 0u, ring(1, slice + 1), ring(1, slice) });
+        indices.insert(indices.end(), { bottom, ring(stacks - 1, slice), ring(stacks - 1, slice + 1) });
+    }
+    for (int stack = 1; stack + 1 < stacks; stack++) {
+        for (int slice = 0; slice < slices; slice++) {
+            unsigned int a = ring(stack, slice), b = ring(stack, slice + 1);
+            unsigned int c = ring(stack + 1, slice), d = ring(stack + 1, slice + 1);
+            indices.insert(indices.end(), { a, b, d, a, d, c });
+        }
+    }
+}
+
+// n x n quads over the unit square at z = 0, facing +z
+inline void buildGrid(int n, std::vector<glm::vec3>& positions, std::vector<unsigned int>& indices) {
+    for (int y = 0; y <= n; y++)
+        for (int x = 0; x <= n; x++)
+            positions.push_back(glm::vec3((float)x / n, (float)y / n, 0.0f));
+    for (int y = 0; y < n; y++) {
+        for (int x = 0; x < n; x++) {
+            unsigned int a = y * (n + 1) + x, b = a + 1, c = a + n + 1, d = c + 1;
+            indices.insert(indices.end(), { a, b, d, a, d, c });
+        }
+    }
+}
+
+#endif
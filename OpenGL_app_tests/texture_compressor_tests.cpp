@@ -0,0 +1,129 @@
+#include "test.h"
+#include "texture_compressor.h"
+#include <algorithm>
+#include <cstdlib>
+
+namespace {
+    // decodes one BC1 block into 16 RGBA8 texels
+    void decodeBC1(const unsigned char* in, unsigned char* texels) {
+        unsigned int c[2] = { static_cast<unsigned int>(in[0] | (in[1] << 8)), static_cast<unsigned int>(in[2] | (in[3] << 8)) };
+        int palette[4][4];
+        for (int e = 0; e < 2; e++) {
+            palette[e][0] = ((c[e] >> 11) & 31) * 255 / 31;
+            palette[e][1] = ((c[e] >> 5) & 63) * 255 / 63;
+            palette[e][2] = (c[e] & 31) * 255 / 31;
+            palette[e][3] = 255;
+        }
+        for (int k = 0; k < 4; k++) {
+            if (c[0] > c[1]) {
+                palette[2][k] = (2 * palette[0][k] + palette[1][k]) / 3;
+                palette[3][k] = (palette[0][k] + 2 * palette[1][k]) / 3;
+            }
+            else {
+                palette[2][k] = (palette[0][k] + palette[1][k]) / 2;
+                palette[3][k] = 0;
+            }
+        }
+        unsigned int indices = in[4] | (in[5] << 8u) | (in[6] << 16u) | ((unsigned int)in[7] << 24u);
+        for (int i = 0; i < 16; i++)
+            for (int k = 0; k < 4; k++)
+                texels[i * 4 + k] = static_cast<unsigned char>(palette[(indices >> (2 * i)) & 3][k]);
+    }
+
+    unsigned int readBits(const unsigned char* in, int& position, int count) {
+        unsigned int value = 0;
+        for (int i = 0; i < count; i++, position++)
+            value |= ((in[position / 8] >> (position % 8)) & 1u) << i;
+        return value;
+    }
+
+    // decodes one BC7 mode 6 block; false if it is another mode
+    bool decodeBC7Mode6(const unsigned char* in, unsigned char* texels) {
+        static const int WEIGHTS[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+        int position = 0;
+        if (readBits(in, position, 7) != 64)
+            return false;
+        int endpoints[2][4];
+        for (int k = 0; k < 4; k++)
+            for (int e = 0; e < 2; e++)
+                endpoints[e][k] = readBits(in, position, 7) << 1;
+        for (int e = 0; e < 2; e++) {
+            unsigned int pBit = readBits(in, position, 1);
+            for (int k = 0; k < 4; k++)
+                endpoints[e][k] |= pBit;
+        }
+        for (int i = 0; i < 16; i++) {
+            int weight = WEIGHTS[readBits(in, position, i == 0 ? 3 : 4)];
+            for (int k = 0; k < 4; k++)
+                texels[i * 4 + k] = static_cast<unsigned char>((endpoints[0][k] * (64 - weight) + endpoints[1][k] * weight + 32) >> 6);
+        }
+        return true;
+    }
+
+    int largestError(const unsigned char* a, const unsigned char* b, int channels) {
+        int error = 0;
+        for (int i = 0; i < 16; i++)
+            for (int k = 0; k < channels; k++)
+                error = std::max(error, std::abs(a[i * 4 + k] - b[i * 4 + k]));
+        return error;
+    }
+
+    // pure red on the left half, pure green on the right: all the variance is at right angles to grey
+    void redGreenEdge(unsigned char* block) {
+        for (int i = 0; i < 16; i++) {
+            bool red = (i % 4) < 2;
+            block[i * 4 + 0] = red ? 255 : 0;
+            block[i * 4 + 1] = red ? 0 : 255;
+            block[i * 4 + 2] = 0;
+            block[i * 4 + 3] = 255;
+        }
+    }
+}
+
+TEST(compressorBC1KeepsRedGreenEdge) {
+    unsigned char block[64], encoded[8], decoded[64];
+    redGreenEdge(block);
+    TextureCompressor::encodeBC1(block, encoded);
+    decodeBC1(encoded, decoded);
+    CHECK(largestError(block, decoded, 3) <= 8);
+}
+
+TEST(compressorBC7KeepsRedGreenEdge) {
+    unsigned char block[64], encoded[16], decoded[64];
+    redGreenEdge(block);
+    TextureCompressor::encodeBC7(block, encoded);
+    CHECK(decodeBC7Mode6(encoded, decoded));
+    CHECK(largestError(block, decoded, 4) <= 4);
+}
+
+TEST(compressorKeepsFlatBlock) {
+    unsigned char block[64], encoded[16], decoded[64];
+    for (int i = 0; i < 16; i++) {
+        block[i * 4 + 0] = 100;
+        block[i * 4 + 1] = 150;
+        block[i * 4 + 2] = 200;
+        block[i * 4 + 3] = 255;
+    }
+    TextureCompressor::encodeBC1(block, encoded);
+    decodeBC1(encoded, decoded);
+    CHECK(largestError(block, decoded, 3) <= 8);
+    TextureCompressor::encodeBC7(block, encoded);
+    CHECK(decodeBC7Mode6(encoded, decoded));
+    CHECK(largestError(block, decoded, 4) <= 2);
+}
+
+TEST(compressorFollowsGradient) {
+    // a grey ramp along the block: every texel within a palette step of its value
+    unsigned char block[64], encoded[16], decoded[64];
+    for (int i = 0; i < 16; i++) {
+        unsigned char value = static_cast<unsigned char>(i * 17);
+        block[i * 4 + 0] = block[i * 4 + 1] = block[i * 4 + 2] = value;
+        block[i * 4 + 3] = 255;
+    }
+    TextureCompressor::encodeBC1(block, encoded);
+    decodeBC1(encoded, decoded);
+    CHECK(largestError(block, decoded, 3) <= 48);
+    TextureCompressor::encodeBC7(block, encoded);
+    CHECK(decodeBC7Mode6(encoded, decoded));
+    CHECK(largestError(block, decoded, 4) <= 12);
+}